@@ -0,0 +1,33 @@
+#include "bench.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Counts every allocation made through the global operator new. The other
+// non-aligned forms of operator new and delete forward to these by default.
+
+static std::atomic<long long> allocations = 0;
+
+void* operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  std::free(p);
+}
+
+namespace cb::bench {
+
+long long allocationCount() {
+  return allocations.load(std::memory_order_relaxed);
+}
+
+}  // namespace cb::bench
\ No newline at end of file
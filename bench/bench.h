@@ -0,0 +1,65 @@
+#ifndef CB_CONTROL_BENCH_H
+#define CB_CONTROL_BENCH_H
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+namespace cb::bench {
+
+// Number of calls to the global operator new so far, counted by alloc.cpp
+long long allocationCount();
+
+struct Measurement {
+  double nsPerOp = 0;
+  double allocsPerOp = 0;
+};
+
+// Calls `f` repeatedly for at least `minMs` milliseconds and returns the
+// average time and number of heap allocations per call
+template <typename F>
+Measurement measure(F&& f, int minMs = 200) {
+  using Clock = std::chrono::steady_clock;
+
+  auto warmUpStart = Clock::now();
+  f();  // Warm up caches and allocations
+  // Slow operations (e.g. replaying a whole capture) are timed one at a time
+  int batch = Clock::now() - warmUpStart > std::chrono::milliseconds(1) ? 1 : 16;
+
+  long long iterations = 0;
+  long long startAllocations = allocationCount();
+  auto start = Clock::now();
+  auto elapsed = Clock::duration::zero();
+  do {
+    for (int i = 0; i < batch; i++)
+      f();
+    iterations += batch;
+    elapsed = Clock::now() - start;
+  } while (elapsed < std::chrono::milliseconds(minMs));
+
+  Measurement result;
+  result.nsPerOp =
+      std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+  result.allocsPerOp =
+      double(allocationCount() - startAllocations) / iterations;
+  return result;
+}
+
+inline void report(const char* name, Measurement result, size_t bytesPerOp) {
+  double mbPerSec = bytesPerOp / result.nsPerOp * 1e9 / (1024 * 1024);
+  printf("%-40s %12.1f ns/op %10.1f MB/s %8.1f allocs/op\n", name,
+         result.nsPerOp, mbPerSec, result.allocsPerOp);
+}
+
+void runPackBenchmarks();
+void runTextBenchmarks();
+// Replays the capture files given on the command line
+int runReplay(int argc, char** argv);
+// Times bringing up a rig of fake cameras in turn and all at once
+int runBringUp();
+// Times transactions on many fake cameras at once with each reactor backend
+int runTransactionBenchmarks();
+
+}  // namespace cb::bench
+
+#endif
\ No newline at end of file
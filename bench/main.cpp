@@ -0,0 +1,17 @@
+#include "bench.h"
+
+int main(int argc, char** argv) {
+  // cb-bench replay <capture>...
+  if (argc > 1 && strcmp(argv[1], "replay") == 0)
+    return cb::bench::runReplay(argc - 2, argv + 2);
+  // cb-bench bringup
+  if (argc > 1 && strcmp(argv[1], "bringup") == 0)
+    return cb::bench::runBringUp();
+  // cb-bench transactions
+  if (argc > 1 && strcmp(argv[1], "transactions") == 0)
+    return cb::bench::runTransactionBenchmarks();
+
+  cb::bench::runPackBenchmarks();
+  cb::bench::runTextBenchmarks();
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,154 @@
+#include "bench.h"
+
+#include <cb/dispatch.h>
+#include <cb/ptp/ipData.h>
+#include <cb/ptp/ptpData.h>
+#include <cb/ptp/vendors/canonData.h>
+#include <cb/template.h>
+
+namespace cb::bench {
+
+// Framed packets should encode their payload exactly once, so packing an
+// EndData packet should cost about the same as encoding its payload alone.
+// A ratio near 2x would mean the payload is being packed twice.
+static void benchEndData(size_t payloadSize) {
+  EndData packet(1, Buffer(payloadSize, 0xab));
+  Buffer buffer(payloadSize + 64);
+
+  Measurement payload = measure([&] {
+    int offset = 0;
+    Codec<Buffer>::pack(packet.payload, buffer, offset);
+  });
+  Measurement pack = measure([&] {
+    int offset = 0;
+    packet.pack(buffer, offset);
+  });
+
+  char name[64];
+  snprintf(name, sizeof(name), "EndData payload only (%zu KiB)",
+           payloadSize / 1024);
+  report(name, payload, payloadSize);
+  snprintf(name, sizeof(name), "EndData pack (%zu KiB)", payloadSize / 1024);
+  report(name, pack, payloadSize);
+  printf("%-40s %12.2fx\n", "  pack / payload", pack.nsPerOp / payload.nsPerOp);
+}
+
+// Object downloads arrive as Data packets; unpacking should run at close to
+// memory bandwidth
+static void benchDataUnpack(size_t payloadSize) {
+  EndData source(1, Buffer(payloadSize, 0xab));
+  Buffer buffer = source.pack();
+  Data packet;
+
+  Measurement unpack = measure([&] { packet.unpack(buffer); });
+
+  char name[64];
+  snprintf(name, sizeof(name), "Data unpack (%zu KiB)", payloadSize / 1024);
+  report(name, unpack, payloadSize);
+}
+
+// Every operation and event poll sends an OperationRequest, which only needs
+// a few fields changed from one to the next
+static void benchOperationRequest() {
+  uint32_t transactionId = 0;
+  Buffer buffer;
+
+  Measurement pack = measure([&] {
+    OperationRequest packet(1, 0x9116, transactionId++, {0x1, 0x2});
+    int offset = 0;
+    packet.pack(buffer, offset);
+  });
+  report("OperationRequest pack", pack, buffer.size());
+
+  PacketTemplate<OperationRequest> packetTemplate;
+  Measurement patch = measure([&] {
+    packetTemplate.set<&OperationRequest::operationCode>(0x9116);
+    packetTemplate.set<&OperationRequest::transactionId>(transactionId++);
+    packetTemplate.set<&OperationRequest::params>({0x1, 0x2});
+  });
+  report("OperationRequest template patch", patch,
+         packetTemplate.data().size());
+
+  OperationRequest packet;
+  Measurement unpack = measure([&] { packet.unpack(buffer); });
+  report("OperationRequest unpack", unpack, buffer.size());
+}
+
+// Fetched once per connection, but it is the largest dataset most cameras
+// send during bring-up and is mostly arrays and strings
+static void benchDeviceInfo() {
+  DeviceInfo source;
+  source.standardVersion = 100;
+  source.vendorExtensionId = 0x0000000b;
+  source.vendorExtensionVersion = 200;
+  source.vendorExtensionDesc = "Canon PTP Extensions";
+  for (uint16_t code = 0x1001; code <= 0x101b; code++)
+    source.operationsSupported.push_back(code);
+  for (uint16_t code = 0x9101; code <= 0x91ff; code++)
+    source.operationsSupported.push_back(code);
+  for (uint16_t code = 0x4001; code <= 0x400e; code++)
+    source.eventsSupported.push_back(code);
+  for (uint16_t code = 0xd101; code <= 0xd1ff; code++)
+    source.devicePropertiesSupported.push_back(code);
+  source.captureFormats = {0x3801, 0xb103};
+  source.imageFormats = {0x3001, 0x3801, 0xb103, 0xbf02, 0x300c};
+  source.manufacturer = "Canon Inc.";
+  source.model = "Canon EOS R5";
+  source.deviceVersion = "3-1.8.1";
+  source.serialNumber = "0123456789abcdef0123456789abcdef";
+
+  Buffer buffer;
+  Measurement pack = measure([&] {
+    int offset = 0;
+    source.pack(buffer, offset);
+  });
+  report("DeviceInfo pack", pack, buffer.size());
+
+  DeviceInfo packet;
+  Measurement unpack = measure([&] { packet.unpack(buffer); });
+  report("DeviceInfo unpack", unpack, buffer.size());
+}
+
+// EOS cameras report every property in the first event poll after opening a
+// session, so a single EOSGetEvent payload can hold hundreds of events
+static void benchEOSEventData(int numEvents) {
+  using EventDispatch = PacketDispatch<EOSEventPacket, EOSPropChanged>;
+
+  EOSEventData source;
+  for (int i = 0; i < numEvents; i++) {
+    EOSPropChanged event;
+    event.propertyCode = 0xd101 + i;
+    event.propertyValue = i;
+    source.events.push_back(event.pack());
+  }
+  source.events.push_back(EOSEventPacket(0).pack());
+  Buffer buffer = source.pack();
+
+  EOSEventData packet;
+  Measurement unpack = measure([&] { packet.unpack(buffer); });
+
+  EventDispatch::Result event;
+  Measurement dispatch = measure([&] {
+    packet.unpack(buffer);
+    for (const Buffer& eventBuffer : packet.events)
+      EventDispatch::unpack(eventBuffer, event);
+  });
+
+  char name[64];
+  snprintf(name, sizeof(name), "EOSEventData unpack (%d events)", numEvents);
+  report(name, unpack, buffer.size());
+  snprintf(name, sizeof(name), "EOSEventData dispatch (%d events)", numEvents);
+  report(name, dispatch, buffer.size());
+}
+
+void runPackBenchmarks() {
+  benchOperationRequest();
+  benchDeviceInfo();
+  benchEOSEventData(300);
+  for (size_t size : {64 * 1024, 1024 * 1024, 8 * 1024 * 1024}) {
+    benchEndData(size);
+    benchDataUnpack(size);
+  }
+}
+
+}  // namespace cb::bench
\ No newline at end of file
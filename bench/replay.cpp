@@ -0,0 +1,271 @@
+#include "bench.h"
+
+#include <cb/capture.h>
+#include <cb/dispatch.h>
+#include <cb/protocols/http.h>
+#include <cb/protocols/xml.h>
+#include <cb/ptp/ipData.h>
+#include <cb/ptp/vendors/canonData.h>
+
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace cb::bench {
+
+// Replays captured traffic (see cb/capture.h) through the same decoders that
+// the library runs on live traffic, and reports the throughput of each
+// channel. Decoding is repeated over the whole capture, so the figures are
+// for the parsers only and do not include any socket overhead.
+
+using IPDispatch = PacketDispatch<IPPacket,
+                                  InitCommandRequest,
+                                  InitCommandAck,
+                                  InitEventRequest,
+                                  InitFail,
+                                  OperationRequest,
+                                  OperationResponse,
+                                  Event,
+                                  StartData,
+                                  DataView,
+                                  Cancel,
+                                  EndDataView>;
+using EOSEventDispatch = PacketDispatch<EOSEventPacket, EOSPropChanged>;
+
+// EOSGetEvent, whose data phase holds the EOS event burst
+static const uint16_t EOS_GET_EVENT = 0x9116;
+
+// One direction of one recorded connection
+struct ReplayStream {
+  int file;
+  CaptureChannel channel;
+  CaptureDirection direction;
+  uint32_t stream;
+  std::vector<Buffer> records;
+  // Stream channels are decoded from the concatenation of their records
+  Buffer bytes;
+  // Operation codes of the requests sent on a PTP/IP command connection, by
+  // transaction ID
+  std::map<uint32_t, uint16_t> operations;
+};
+
+// Decodes the packets of a PTP/IP connection the way PTPIP::recvResponse()
+// receives them: the payloads of Data and EndData packets are collected apart
+// from the packets themselves. Returns the number of packets and events.
+static int replayPTPIP(const ReplayStream& stream) {
+  static thread_local Buffer packetBuffer;
+  static thread_local Buffer payload;
+  static thread_local IPDispatch::Result packet;
+  static thread_local EOSEventData eventData;
+  static thread_local EOSEventDispatch::Result event;
+
+  const Buffer& bytes = stream.bytes;
+  int messages = 0;
+  int offset = 0;
+  payload.clear();
+  while (bytes.size() - offset >= IPPacket::HEADER_SIZE) {
+    packetBuffer.assign(bytes.begin() + offset,
+                        bytes.begin() + offset + IPPacket::HEADER_SIZE);
+    IPPacket header;
+    header.unpack(packetBuffer);
+    if (header.length < IPPacket::HEADER_SIZE ||
+        header.length > bytes.size() - offset)
+      break;  // Cut off at the end of the capture
+
+    auto begin = bytes.begin() + offset + IPPacket::HEADER_SIZE;
+    auto end = bytes.begin() + offset + header.length;
+    bool isData = header.packetType == DataView().packetType ||
+                  header.packetType == EndDataView().packetType;
+    if (isData && end - begin >= sizeof(uint32_t)) {
+      packetBuffer.insert(packetBuffer.end(), begin, begin + sizeof(uint32_t));
+      payload.insert(payload.end(), begin + sizeof(uint32_t), end);
+    } else {
+      packetBuffer.insert(packetBuffer.end(), begin, end);
+    }
+    offset += header.length;
+
+    IPDispatch::unpack(packetBuffer, packet);
+    messages++;
+
+    if (auto response = std::get_if<OperationResponse>(&packet)) {
+      auto it = stream.operations.find(response->transactionId);
+      if (it != stream.operations.end() && it->second == EOS_GET_EVENT) {
+        eventData.unpack(payload);
+        for (const Buffer& eventBuffer : eventData.events)
+          EOSEventDispatch::unpack(eventBuffer, event);
+        messages += eventData.events.size();
+      }
+      payload.clear();
+    }
+  }
+  return messages;
+}
+
+// Requests and responses of a device description fetch
+static int replayHTTP(const ReplayStream& stream) {
+  static thread_local HTTPRequest request;
+  static thread_local HTTPResponse response;
+  static thread_local XMLDoc doc;
+
+  const Buffer& bytes = stream.bytes;
+  int messages = 0;
+  int offset = 0;
+  while (offset < bytes.size()) {
+    int startOffset = offset;
+    if (stream.direction == CaptureDirection::Sent) {
+      request.unpack(bytes, offset, std::nullopt);
+    } else {
+      response.unpack(bytes, offset, std::nullopt);
+      if (response.headers["Content-Type"].find("xml") != std::string::npos)
+        doc.unpack(response.body);
+    }
+    if (offset == startOffset)
+      break;
+    messages++;
+  }
+  return messages;
+}
+
+// SSDP messages are each received as a single datagram
+static int replaySSDP(const ReplayStream& stream) {
+  static thread_local HTTPRequest request;
+
+  for (const Buffer& datagram : stream.records)
+    request.unpack(datagram);
+  return stream.records.size();
+}
+
+static int replayStream(const ReplayStream& stream) {
+  switch (stream.channel) {
+    case CaptureChannel::PTPIPCommand:
+    case CaptureChannel::PTPIPEvent:
+      return replayPTPIP(stream);
+    case CaptureChannel::SSDP:
+      return replaySSDP(stream);
+    case CaptureChannel::HTTP:
+      return replayHTTP(stream);
+  }
+  return 0;
+}
+
+static const char* channelName(CaptureChannel channel) {
+  switch (channel) {
+    case CaptureChannel::PTPIPCommand:
+      return "PTP/IP command";
+    case CaptureChannel::PTPIPEvent:
+      return "PTP/IP event";
+    case CaptureChannel::SSDP:
+      return "SSDP";
+    case CaptureChannel::HTTP:
+      return "HTTP";
+  }
+  return "Unknown";
+}
+
+// Request operation codes are needed to tell which data phases hold events
+static void findOperations(const ReplayStream& sent, ReplayStream& received) {
+  OperationRequest request;
+  const Buffer& bytes = sent.bytes;
+  Buffer packetBuffer;
+  int offset = 0;
+  while (bytes.size() - offset >= IPPacket::HEADER_SIZE) {
+    packetBuffer.assign(bytes.begin() + offset,
+                        bytes.begin() + offset + IPPacket::HEADER_SIZE);
+    IPPacket header;
+    header.unpack(packetBuffer);
+    if (header.length < IPPacket::HEADER_SIZE ||
+        header.length > bytes.size() - offset)
+      break;
+
+    if (header.packetType == request.packetType) {
+      packetBuffer.assign(bytes.begin() + offset,
+                          bytes.begin() + offset + header.length);
+      request.unpack(packetBuffer);
+      received.operations[request.transactionId] = request.operationCode;
+    }
+    offset += header.length;
+  }
+}
+
+// Streams of different capture files are kept apart, since their IDs overlap
+using StreamKey =
+    std::tuple<int, CaptureChannel, uint32_t, CaptureDirection>;
+
+static void loadCapture(int file,
+                        const char* path,
+                        std::map<StreamKey, ReplayStream>& streams) {
+  CaptureReader reader(path);
+  CaptureRecord record;
+  while (reader.next(record)) {
+    ReplayStream& stream = streams[{file, record.channel, record.stream,
+                                    record.direction}];
+    stream.file = file;
+    stream.channel = record.channel;
+    stream.direction = record.direction;
+    stream.stream = record.stream;
+    stream.bytes.insert(stream.bytes.end(), record.data.begin(),
+                        record.data.end());
+    stream.records.push_back(std::move(record.data));
+  }
+}
+
+int runReplay(int argc, char** argv) {
+  std::map<StreamKey, ReplayStream> streams;
+  for (int i = 0; i < argc; i++) {
+    try {
+      loadCapture(i, argv[i], streams);
+    } catch (const std::exception& e) {
+      fprintf(stderr, "%s: %s\n", argv[i], e.what());
+      return 1;
+    }
+  }
+
+  for (auto& [key, stream] : streams) {
+    if (stream.channel == CaptureChannel::PTPIPCommand &&
+        stream.direction == CaptureDirection::Received) {
+      auto sent = streams.find({stream.file, stream.channel, stream.stream,
+                                CaptureDirection::Sent});
+      if (sent != streams.end())
+        findOperations(sent->second, stream);
+    }
+  }
+
+  // Decode every stream once up front, dropping the ones which the decoders
+  // reject, so that the timed runs are not cut short by exceptions
+  std::map<CaptureChannel, std::vector<const ReplayStream*>> channels;
+  for (auto& [key, stream] : streams) {
+    try {
+      replayStream(stream);
+      channels[stream.channel].push_back(&stream);
+    } catch (const std::exception& e) {
+      fprintf(stderr, "%s stream %u: %s, skipping\n",
+              channelName(stream.channel), stream.stream, e.what());
+    }
+  }
+
+  for (auto& [channel, channelStreams] : channels) {
+    size_t bytes = 0;
+    int messages = 0;
+    for (const ReplayStream* stream : channelStreams) {
+      bytes += stream->bytes.size();
+      messages += replayStream(*stream);
+    }
+
+    Measurement result = measure([&] {
+      for (const ReplayStream* stream : channelStreams)
+        replayStream(*stream);
+    });
+
+    double seconds = result.nsPerOp / 1e9;
+    char name[64];
+    snprintf(name, sizeof(name), "%s (%d messages)", channelName(channel),
+             messages);
+    printf("%-40s %10.1f MB/s %12.0f msgs/s %8.2f allocs/msg\n", name,
+           bytes / seconds / (1024 * 1024), messages / seconds,
+           messages ? result.allocsPerOp / messages : 0.0);
+  }
+  return 0;
+}
+
+}  // namespace cb::bench
\ No newline at end of file
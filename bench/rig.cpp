@@ -0,0 +1,445 @@
+#include "bench.h"
+
+#include <cb/factory.h>
+#include <cb/platforms/reactorImpl.h>
+#include <cb/platforms/socketImpl.h>
+#include <cb/ptp/ip.h>
+#include <cb/ptp/ipData.h>
+#include <cb/scheduler.h>
+
+#if defined(CB_CONTROL_REACTOR_IMPL) && !defined(_WIN32)
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <functional>
+#include <future>
+#include <iostream>
+#include <thread>
+#include <vector>
+#endif
+
+namespace cb::bench {
+
+#if defined(CB_CONTROL_REACTOR_IMPL) && !defined(_WIN32)
+
+// Brings up a rig of fake PTP/IP cameras on the loopback interface, one of
+// which never accepts the connection, first one camera at a time with
+// create() and then all at once with createAll(). The fake cameras wait
+// before every reply, standing in for a body that is slow to answer. All at
+// once, the rig should come up as fast as it does without the unreachable
+// camera, since its connect deadline is shorter than a reachable bring-up.
+
+static const int CAMERA_COUNT = 8;
+static const std::chrono::milliseconds REPLY_DELAY(150);
+static const unsigned int CONNECT_TIMEOUT_MS = 250;
+
+static int listenLoopback(int backlog, int& port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(address);
+  if (bind(fd, (sockaddr*)&address, length) != 0 || listen(fd, backlog) != 0 ||
+      getsockname(fd, (sockaddr*)&address, &length) != 0) {
+    close(fd);
+    return -1;
+  }
+  port = ntohs(address.sin_port);
+  return fd;
+}
+
+static bool recvPacket(int fd, Buffer& buffer) {
+  buffer.resize(IPPacket::HEADER_SIZE);
+  if (recv(fd, buffer.data(), buffer.size(), MSG_WAITALL) != buffer.size())
+    return false;
+  IPPacket header;
+  header.unpack(buffer);
+  buffer.resize(header.length);
+  int remaining = header.length - IPPacket::HEADER_SIZE;
+  return remaining <= 0 ||
+         recv(fd, buffer.data() + IPPacket::HEADER_SIZE, remaining,
+              MSG_WAITALL) == remaining;
+}
+
+static void sendPacket(int fd, Packet& packet) {
+  Buffer buffer = packet.pack();
+  send(fd, buffer.data(), buffer.size(), MSG_NOSIGNAL);
+}
+
+static const uint16_t GET_DEVICE_INFO = 0x1001;
+static const uint16_t GET_OBJECT = 0x1009;
+static const int OBJECT_SIZE = 1 << 20;
+
+// Answers the init handshake as a Canon body would, then every request with a
+// DeviceInfo, or an object of OBJECT_SIZE bytes for GetObject, until the
+// client closes the connection
+static void serveCamera(int listener, std::chrono::milliseconds replyDelay) {
+  Buffer buffer;
+  int command = accept(listener, nullptr, nullptr);
+  // Each reply goes out as several packets, which Nagle would hold back
+  int noDelay = 1;
+  setsockopt(command, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+  if (!recvPacket(command, buffer)) {
+    close(command);
+    return;
+  }
+  std::this_thread::sleep_for(replyDelay);
+  InitCommandAck initCommandAck;
+  initCommandAck.connectionNum = 1;
+  initCommandAck.name = "Fake";
+  sendPacket(command, initCommandAck);
+
+  int event = accept(listener, nullptr, nullptr);
+  recvPacket(event, buffer);
+  InitEventAck initEventAck;
+  sendPacket(event, initEventAck);
+
+  DeviceInfo deviceInfo;
+  deviceInfo.manufacturer = "Canon Inc.";
+  deviceInfo.model = "Canon EOS Fake";
+  Buffer info = deviceInfo.pack();
+  Buffer object(OBJECT_SIZE);
+  while (recvPacket(command, buffer)) {
+    OperationRequest request;
+    request.unpack(buffer);
+    std::this_thread::sleep_for(replyDelay);
+
+    Buffer data = request.operationCode == GET_OBJECT ? object : info;
+    StartData startData(request.transactionId, data.size());
+    sendPacket(command, startData);
+    EndData endData(request.transactionId, std::move(data));
+    sendPacket(command, endData);
+    OperationResponse response;
+    response.responseCode = 0x2001;
+    response.transactionId = request.transactionId;
+    sendPacket(command, response);
+  }
+
+  close(event);
+  close(command);
+}
+
+struct Rig {
+  std::vector<int> listeners;
+  std::vector<std::thread> servers;
+  // Connections filling the accept queue of the unreachable camera, so that
+  // further connects go unanswered until their deadline
+  std::vector<int> fillers;
+  std::vector<std::unique_ptr<PTPCameraFactory>> factories;
+
+  Rig(int reachableCount, bool withUnreachable) {
+    std::array<uint8_t, 16> guid = {};
+    PTPIPOptions options;
+    options.command.connectTimeoutMs = CONNECT_TIMEOUT_MS;
+    options.event.connectTimeoutMs = CONNECT_TIMEOUT_MS;
+
+    int port;
+    for (int i = 0; i < reachableCount; i++) {
+      int listener = listenLoopback(2, port);
+      listeners.push_back(listener);
+      servers.emplace_back(serveCamera, listener, REPLY_DELAY);
+      factories.push_back(std::make_unique<PTPCameraFactory>(
+          std::make_unique<PTPIPFactory>(guid, "Bench", "127.0.0.1", port,
+                                         options)));
+    }
+
+    if (!withUnreachable)
+      return;
+    int listener = listenLoopback(0, port);
+    listeners.push_back(listener);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    for (int i = 0; i < 2; i++) {
+      int filler = socket(AF_INET, SOCK_STREAM, 0);
+      fcntl(filler, F_SETFL, O_NONBLOCK);
+      connect(filler, (sockaddr*)&address, sizeof(address));
+      fillers.push_back(filler);
+    }
+    factories.push_back(std::make_unique<PTPCameraFactory>(
+        std::make_unique<PTPIPFactory>(guid, "Bench", "127.0.0.1", port,
+                                       options)));
+  }
+
+  ~Rig() {
+    for (int listener : listeners)
+      shutdown(listener, SHUT_RDWR);
+    for (std::thread& server : servers)
+      server.join();
+    for (int fd : fillers)
+      close(fd);
+    for (int listener : listeners)
+      close(listener);
+  }
+
+  std::vector<const PTPCameraFactory*> factoryList() const {
+    std::vector<const PTPCameraFactory*> list;
+    for (const auto& factory : factories)
+      list.push_back(factory.get());
+    return list;
+  }
+};
+
+static Task<void> createAllInto(
+    Scheduler& scheduler,
+    std::span<const PTPCameraFactory* const> factories,
+    std::promise<int>& created) {
+  std::vector<std::unique_ptr<EventCamera>> cameras =
+      co_await PTPCameraFactory::createAll(scheduler, factories);
+  int count = 0;
+  for (const auto& camera : cameras)
+    count += camera != nullptr;
+  created.set_value(count);
+}
+
+static double bringUpInTurn(int& created) {
+  Rig rig(CAMERA_COUNT, true);
+  std::vector<std::unique_ptr<EventCamera>> cameras;
+  auto start = std::chrono::steady_clock::now();
+  created = 0;
+  for (const auto& factory : rig.factories) {
+    try {
+      cameras.push_back(factory->create());
+      created++;
+    } catch (const std::exception&) {
+    }
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  cameras.clear();
+  return std::chrono::duration<double, std::milli>(elapsed).count();
+}
+
+static double bringUpAtOnce(bool withUnreachable, int& created) {
+  Rig rig(CAMERA_COUNT, withUnreachable);
+  std::vector<const PTPCameraFactory*> factories = rig.factoryList();
+  std::shared_ptr<Reactor> reactor = createReactor();
+  std::jthread loop([&reactor]() { reactor->run(); });
+  double elapsedMs;
+  {
+    Scheduler scheduler(reactor);
+    std::promise<int> result;
+    auto start = std::chrono::steady_clock::now();
+    scheduler.spawn(createAllInto(scheduler, factories, result));
+    created = result.get_future().get();
+    elapsedMs = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+  }
+  reactor->stop();
+  return elapsedMs;
+}
+
+int runBringUp() {
+  printf("Bring-up of %d fake cameras answering after %lld ms, plus one that "
+         "never accepts (%u ms connect deadline)\n",
+         CAMERA_COUNT, (long long)REPLY_DELAY.count(), CONNECT_TIMEOUT_MS);
+
+  // The library logs every packet, which would bury the results
+  std::cout.setstate(std::ios::failbit);
+  int inTurnCreated, atOnceCreated, reachableCreated;
+  double inTurnMs = bringUpInTurn(inTurnCreated);
+  double atOnceMs = bringUpAtOnce(true, atOnceCreated);
+  double reachableMs = bringUpAtOnce(false, reachableCreated);
+  std::cout.clear();
+
+  printf("%-40s %12.1f ms %8d cameras\n", "One at a time (create)", inTurnMs,
+         inTurnCreated);
+  printf("%-40s %12.1f ms %8d cameras\n", "All at once (createAll)", atOnceMs,
+         atOnceCreated);
+  printf("%-40s %12.1f ms %8d cameras\n", "All at once, reachable only",
+         reachableMs, reachableCreated);
+  return 0;
+}
+
+// Runs many transactions on a rig of fake cameras at once, with each reactor
+// backend built in. The cameras are served from a child process, so that the
+// CPU time measured is only that of the client side.
+
+static const int TRANSACTION_CAMERA_COUNT = 32;
+static const int SMALL_TRANSACTIONS = 200;
+static const int OBJECT_TRANSACTIONS = 8;
+
+struct TransactionRun {
+  double transactionsPerSec = 0;
+  double cpuUsPerTransaction = 0;
+};
+
+// Serves `count` cameras from a child process, returning its ID and their ports
+static pid_t forkCameras(int count, std::vector<int>& ports) {
+  int pipeFds[2];
+  if (pipe(pipeFds) != 0)
+    return -1;
+  pid_t child = fork();
+  if (child == 0) {
+    close(pipeFds[0]);
+    std::vector<int> listeners(count);
+    ports.resize(count);
+    for (int i = 0; i < count; i++)
+      listeners[i] = listenLoopback(2, ports[i]);
+    write(pipeFds[1], ports.data(), count * sizeof(int));
+    close(pipeFds[1]);
+    std::vector<std::thread> servers;
+    for (int listener : listeners)
+      servers.emplace_back(serveCamera, listener,
+                           std::chrono::milliseconds::zero());
+    for (std::thread& server : servers)
+      server.join();
+    _exit(0);
+  }
+  close(pipeFds[1]);
+  ports.resize(count);
+  int length = count * sizeof(int);
+  bool isRead = child > 0 && read(pipeFds[0], ports.data(), length) == length;
+  close(pipeFds[0]);
+  return isRead ? child : -1;
+}
+
+static double cpuSeconds() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static Task<void> openInto(Scheduler& scheduler, PTPIP& transport) {
+  co_await transport.openAsync(scheduler);
+}
+
+static Task<void> runTransactions(Scheduler& scheduler,
+                                  PTPIP& transport,
+                                  uint16_t operationCode,
+                                  int count) {
+  for (int i = 0; i < count; i++) {
+    OperationRequestData request(true, false, operationCode, 0, i + 1);
+    co_await transport.transactionAsync(scheduler, request);
+  }
+}
+
+static Task<void> whenAllInto(Scheduler& scheduler,
+                              std::vector<Task<void>> tasks,
+                              std::promise<void>& done) {
+  co_await scheduler.whenAll(std::move(tasks));
+  done.set_value();
+}
+
+// Runs `tasks` on `scheduler` and waits for them from this thread
+static void runAll(Scheduler& scheduler, std::vector<Task<void>> tasks) {
+  std::promise<void> done;
+  scheduler.spawn(whenAllInto(scheduler, std::move(tasks), done));
+  done.get_future().get();
+}
+
+static bool runOnBackend(std::shared_ptr<Reactor> reactor,
+                         TransactionRun& small,
+                         TransactionRun& objects) {
+  std::vector<int> ports;
+  pid_t child = forkCameras(TRANSACTION_CAMERA_COUNT, ports);
+  if (child < 0)
+    return false;
+
+  std::jthread loop([&reactor]() { reactor->run(); });
+  {
+    Scheduler scheduler(reactor);
+    std::array<uint8_t, 16> guid = {};
+    std::vector<std::unique_ptr<PTPIP>> transports;
+    std::vector<Task<void>> opens;
+    for (int port : ports) {
+      transports.push_back(std::make_unique<PTPIP>(
+          createTCPSocket(), createTCPSocket(), guid, "Bench", "127.0.0.1",
+          port));
+      opens.push_back(openInto(scheduler, *transports.back()));
+    }
+    runAll(scheduler, std::move(opens));
+
+    auto runRound = [&](uint16_t operationCode, int count,
+                        TransactionRun& run) {
+      std::vector<Task<void>> tasks;
+      for (const auto& transport : transports)
+        tasks.push_back(
+            runTransactions(scheduler, *transport, operationCode, count));
+      double startCpu = cpuSeconds();
+      auto start = std::chrono::steady_clock::now();
+      runAll(scheduler, std::move(tasks));
+      double elapsed = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+      double total = double(TRANSACTION_CAMERA_COUNT) * count;
+      run.transactionsPerSec = total / elapsed;
+      run.cpuUsPerTransaction = (cpuSeconds() - startCpu) * 1e6 / total;
+    };
+    runRound(GET_DEVICE_INFO, SMALL_TRANSACTIONS, small);
+    runRound(GET_OBJECT, OBJECT_TRANSACTIONS, objects);
+    transports.clear();
+  }
+  reactor->stop();
+  loop.join();
+  waitpid(child, nullptr, 0);
+  return true;
+}
+
+static void reportTransactions(const char* backend,
+                               const char* kind,
+                               const TransactionRun& run) {
+  char name[64];
+  snprintf(name, sizeof(name), "%s, %s", backend, kind);
+  printf("%-40s %12.0f tx/s %10.1f us CPU/tx\n", name,
+         run.transactionsPerSec, run.cpuUsPerTransaction);
+}
+
+int runTransactionBenchmarks() {
+  printf("%d fake cameras answering at once: %d GetDeviceInfo, then %d "
+         "GetObject of %d KiB each\n",
+         TRANSACTION_CAMERA_COUNT, SMALL_TRANSACTIONS, OBJECT_TRANSACTIONS,
+         OBJECT_SIZE / 1024);
+
+  std::vector<std::pair<const char*, std::function<std::shared_ptr<Reactor>()>>>
+      backends = {{"epoll", []() { return std::make_shared<ReactorImpl>(); }}};
+#if defined(CB_CONTROL_URING_REACTOR_IMPL)
+  backends.push_back(
+      {"io_uring", []() { return std::make_shared<UringReactorImpl>(); }});
+#endif
+
+  for (const auto& [backend, create] : backends) {
+    std::shared_ptr<Reactor> reactor;
+    try {
+      reactor = create();
+    } catch (const Exception&) {
+      printf("%-40s unavailable\n", backend);
+      continue;
+    }
+    TransactionRun small, objects;
+    std::cout.setstate(std::ios::failbit);
+    bool isRun = runOnBackend(reactor, small, objects);
+    std::cout.clear();
+    if (!isRun) {
+      printf("%-40s could not start the cameras\n", backend);
+      return 1;
+    }
+    reportTransactions(backend, "GetDeviceInfo", small);
+    reportTransactions(backend, "GetObject", objects);
+  }
+  return 0;
+}
+
+#else
+
+int runBringUp() {
+  printf("The bring-up benchmark needs POSIX sockets and a reactor\n");
+  return 1;
+}
+
+int runTransactionBenchmarks() {
+  printf("The transaction benchmark needs POSIX sockets and a reactor\n");
+  return 1;
+}
+
+#endif
+
+}  // namespace cb::bench
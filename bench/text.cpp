@@ -0,0 +1,135 @@
+#include "bench.h"
+
+#include <cb/protocols/http.h>
+#include <cb/protocols/ssdp.h>
+#include <cb/protocols/xml.h>
+#include <cb/ptp/ptpData.h>
+
+namespace cb::bench {
+
+static const char* notify =
+    "NOTIFY * HTTP/1.1\r\n"
+    "Host: 239.255.255.250:1900\r\n"
+    "Cache-Control: max-age=1800\r\n"
+    "Location: http://192.168.1.2:49152/upnp/CameraDevDesc.xml\r\n"
+    "NT: urn:schemas-canon-com:service:ICPO-SmartPhoneEOSSystemService:1\r\n"
+    "NTS: ssdp:alive\r\n"
+    "Server: Camera OS/1.0 UPnP/1.0 Canon Device Discovery/1.0\r\n"
+    "USN: uuid:00000000-0000-0000-0001-00000000000A::urn:schemas-canon-com:"
+    "service:ICPO-SmartPhoneEOSSystemService:1\r\n"
+    "\r\n";
+
+// SSDP announcements arrive continuously on busy networks, so parsing one
+// should be negligible next to receiving it
+static void benchNotify() {
+  Buffer buffer(notify, notify + strlen(notify));
+  HTTPRequest request;
+
+  Measurement unpack = measure([&] { request.unpack(buffer); });
+  report("SSDP NOTIFY unpack", unpack, buffer.size());
+
+  Buffer packed;
+  Measurement pack = measure([&] {
+    int offset = 0;
+    request.pack(packed, offset);
+  });
+  report("SSDP NOTIFY pack", pack, packed.size());
+
+  // Most advertisements on a busy network are for other devices and only
+  // get as far as the pre-filter
+  std::set<std::string> searchTargets = {
+      "urn:schemas-canon-com:service:ICPO-SmartPhoneEOSSystemService:1"};
+  Measurement filter = measure([&] { isNotifyFor(buffer, searchTargets); });
+  report("SSDP NOTIFY pre-filter", filter, buffer.size());
+}
+
+// The device description is fetched over HTTP for every discovered camera
+static void benchHTTPResponse(const Buffer& body) {
+  HTTPResponse source("200", "OK");
+  source.headers["Content-Type"] = "text/xml; charset=\"utf-8\"";
+  source.headers["Server"] = "Camera OS/1.0 UPnP/1.0";
+  source.headers["Connection"] = "close";
+  source.body = body;
+
+  Buffer buffer;
+  Measurement pack = measure([&] {
+    int offset = 0;
+    source.pack(buffer, offset);
+  });
+  report("HTTPResponse pack", pack, buffer.size());
+
+  HTTPResponse response;
+  Measurement unpack = measure([&] { response.unpack(buffer); });
+  report("HTTPResponse unpack", unpack, buffer.size());
+}
+
+static void benchDeviceDescription() {
+  std::string xml =
+      "<?xml version=\"1.0\"?>\r\n"
+      "<root xmlns=\"urn:schemas-upnp-org:device-1-0\">\r\n"
+      "  <specVersion><major>1</major><minor>0</minor></specVersion>\r\n"
+      "  <device>\r\n"
+      "    <deviceType>urn:schemas-upnp-org:device:Basic:1</deviceType>\r\n"
+      "    <friendlyName>EOS Camera</friendlyName>\r\n"
+      "    <manufacturer>Canon</manufacturer>\r\n"
+      "    <modelName>Canon EOS</modelName>\r\n"
+      "    <serialNumber>0123456789ab</serialNumber>\r\n"
+      "    <UDN>uuid:00000000-0000-0000-0001-00000000000A</UDN>\r\n"
+      "    <serviceList>\r\n";
+  for (int i = 0; i < 16; i++)
+    xml +=
+        "      <service>\r\n"
+        "        <serviceType>urn:schemas-canon-com:service:ICPO-"
+        "SmartPhoneEOSSystemService:1</serviceType>\r\n"
+        "        <serviceId>urn:schemas-canon-com:serviceId:ICPO-"
+        "SmartPhoneEOSSystemService-1</serviceId>\r\n"
+        "        <SCPDURL>/desc_iml/CameraDevDesc.xml</SCPDURL>\r\n"
+        "        <controlURL>/desc_iml/control</controlURL>\r\n"
+        "        <eventSubURL>/desc_iml/event</eventSubURL>\r\n"
+        "      </service>\r\n";
+  xml += "    </serviceList>\r\n  </device>\r\n</root>\r\n";
+
+  Buffer buffer(xml.begin(), xml.end());
+  XMLDoc doc;
+
+  Measurement unpack = measure([&] { doc.unpack(buffer); });
+  report("Device description XML unpack", unpack, buffer.size());
+
+  benchHTTPResponse(buffer);
+}
+
+// DeviceInfo and object info datasets are mostly PTP strings
+static void benchPTPString(const char* name, const std::string& value) {
+  std::string string = value;
+  Buffer buffer;
+
+  Measurement pack = measure([&] {
+    int offset = 0;
+    PTPStringCodec::pack(string, buffer, offset);
+  });
+  std::string label = std::string(name) + " pack";
+  report(label.c_str(), pack, buffer.size());
+
+  Measurement unpack = measure([&] {
+    int offset = 0;
+    PTPStringCodec::unpack(string, buffer, offset, std::nullopt);
+  });
+  label = std::string(name) + " unpack";
+  report(label.c_str(), unpack, buffer.size());
+}
+
+void runTextBenchmarks() {
+  benchNotify();
+  benchDeviceDescription();
+
+  std::string ascii;
+  std::string accented;
+  while (ascii.size() < 200) {
+    ascii += "Canon EOS R5 ";
+    accented += "Caméra Réflex ";
+  }
+  benchPTPString("PTP string (ASCII)", ascii);
+  benchPTPString("PTP string (accented)", accented);
+}
+
+}  // namespace cb::bench
\ No newline at end of file
@@ -0,0 +1,140 @@
+#include <cb/capture.h>
+#include <cb/exception.h>
+
+#include <algorithm>
+
+namespace cb {
+
+static std::mutex activeMutex;
+static std::shared_ptr<CaptureWriter> activeCapture;
+
+CaptureWriter::CaptureWriter(const std::string& path)
+    : file(fopen(path.c_str(), "wb")),
+      startTime(std::chrono::steady_clock::now()) {
+  if (!file)
+    throw Exception(ExceptionContext::Capture, ExceptionType::FileFailure);
+
+  CaptureFileHeader header;
+  int offset = 0;
+  header.pack(headerBuffer, offset);
+  if (fwrite(headerBuffer.data(), 1, headerBuffer.size(), file) !=
+      headerBuffer.size()) {
+    fclose(file);
+    throw Exception(ExceptionContext::Capture, ExceptionType::FileFailure);
+  }
+}
+
+CaptureWriter::~CaptureWriter() {
+  fclose(file);
+}
+
+uint32_t CaptureWriter::newStream() {
+  std::lock_guard lock(mutex);
+  return nextStream++;
+}
+
+// Recording must never break the connection being recorded, so write errors
+// only cost the capture its records
+void CaptureWriter::write(CaptureChannel channel,
+                          CaptureDirection direction,
+                          uint32_t stream,
+                          std::span<const BufferView> segments,
+                          int length) {
+  std::lock_guard lock(mutex);
+
+  CaptureRecordHeader header;
+  header.channel = static_cast<uint8_t>(channel);
+  header.direction = static_cast<uint8_t>(direction);
+  header.stream = stream;
+  header.timeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now() - startTime)
+                      .count();
+  header.length = length;
+
+  int offset = 0;
+  header.pack(headerBuffer, offset);
+  fwrite(headerBuffer.data(), 1, headerBuffer.size(), file);
+
+  for (BufferView segment : segments) {
+    if (length <= 0)
+      break;
+    int segmentLength = std::min<int>(segment.size(), length);
+    fwrite(segment.data(), 1, segmentLength, file);
+    length -= segmentLength;
+  }
+}
+
+void CaptureWriter::setActive(std::shared_ptr<CaptureWriter> capture) {
+  std::lock_guard lock(activeMutex);
+  activeCapture = std::move(capture);
+}
+
+std::shared_ptr<CaptureWriter> CaptureWriter::getActive() {
+  std::lock_guard lock(activeMutex);
+  return activeCapture;
+}
+
+std::unique_ptr<TCPSocket> recordSocket(std::unique_ptr<TCPSocket> socket,
+                                        CaptureChannel channel) {
+  std::shared_ptr<CaptureWriter> capture = CaptureWriter::getActive();
+  if (!capture)
+    return socket;
+  return std::make_unique<RecordingTCPSocket>(std::move(socket),
+                                              std::move(capture), channel);
+}
+
+std::unique_ptr<UDPMulticastSocket> recordSocket(
+    std::unique_ptr<UDPMulticastSocket> socket,
+    CaptureChannel channel) {
+  std::shared_ptr<CaptureWriter> capture = CaptureWriter::getActive();
+  if (!capture)
+    return socket;
+  return std::make_unique<RecordingUDPMulticastSocket>(
+      std::move(socket), std::move(capture), channel);
+}
+
+CaptureReader::CaptureReader(const std::string& path)
+    : file(fopen(path.c_str(), "rb")) {
+  if (!file)
+    throw Exception(ExceptionContext::Capture, ExceptionType::FileFailure);
+
+  headerBuffer.resize(CaptureFileHeader::SIZE);
+  bool valid = fread(headerBuffer.data(), 1, headerBuffer.size(), file) ==
+               headerBuffer.size();
+  if (valid) {
+    CaptureFileHeader header;
+    std::array<uint8_t, 4> magic = header.magic;
+    header.unpack(headerBuffer);
+    valid = header.magic == magic &&
+            header.version == CaptureFileHeader::VERSION;
+  }
+
+  if (!valid) {
+    fclose(file);
+    throw Exception(ExceptionContext::Capture, ExceptionType::UnsupportedType);
+  }
+}
+
+CaptureReader::~CaptureReader() {
+  fclose(file);
+}
+
+bool CaptureReader::next(CaptureRecord& record) {
+  headerBuffer.resize(CaptureRecordHeader::SIZE);
+  if (fread(headerBuffer.data(), 1, headerBuffer.size(), file) !=
+      headerBuffer.size())
+    return false;
+
+  CaptureRecordHeader header;
+  header.unpack(headerBuffer);
+
+  record.channel = static_cast<CaptureChannel>(header.channel);
+  record.direction = static_cast<CaptureDirection>(header.direction);
+  record.stream = header.stream;
+  record.timeNs = header.timeNs;
+  record.data.resize(header.length);
+  return fread(record.data.data(), 1, record.data.size(), file) ==
+         record.data.size();
+}
+
+}  // namespace cb
\ No newline at end of file
@@ -0,0 +1,292 @@
+#ifndef CB_CONTROL_CAPTURE_H
+#define CB_CONTROL_CAPTURE_H
+
+#include <cb/protocols/tcp.h>
+#include <cb/protocols/udp.h>
+#include <cb/schema.h>
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+
+namespace cb {
+
+/* Traffic captures
+
+   A capture file records the raw bytes that went through a set of sockets,
+   so that real traffic can be replayed through the decoders offline. The file
+   starts with a CaptureFileHeader, followed by records which each consist of
+   a CaptureRecordHeader and `length` bytes of data. All integers are little
+   endian.
+
+   Stream sockets are recorded one read or write at a time, so a record may
+   hold part of a packet or several packets; the bytes of each stream are
+   concatenated to rebuild it. Datagram sockets are recorded one datagram per
+   record. */
+
+enum class CaptureChannel : uint8_t {
+  PTPIPCommand = 0x01,
+  PTPIPEvent = 0x02,
+  SSDP = 0x03,
+  HTTP = 0x04,
+};
+
+enum class CaptureDirection : uint8_t {
+  Received = 0x01,
+  Sent = 0x02,
+};
+
+class CaptureFileHeader : public SchemaPacket<CaptureFileHeader, Packet> {
+ public:
+  static const int SIZE = 8;
+  static const uint16_t VERSION = 1;
+
+  std::array<uint8_t, 4> magic = {'C', 'B', 'C', 'P'};
+  uint16_t version = VERSION;
+  uint16_t reserved = 0;
+
+  using Schema = PacketSchema<Member<&CaptureFileHeader::magic>,
+                              Member<&CaptureFileHeader::version>,
+                              Member<&CaptureFileHeader::reserved>>;
+};
+
+class CaptureRecordHeader : public SchemaPacket<CaptureRecordHeader, Packet> {
+ public:
+  static const int SIZE = 20;
+
+  uint8_t channel = 0;
+  uint8_t direction = 0;
+  uint16_t reserved = 0;
+  // Distinguishes the connections recorded on the same channel
+  uint32_t stream = 0;
+  // Time since the capture started
+  uint64_t timeNs = 0;
+  uint32_t length = 0;
+
+  using Schema = PacketSchema<Member<&CaptureRecordHeader::channel>,
+                              Member<&CaptureRecordHeader::direction>,
+                              Member<&CaptureRecordHeader::reserved>,
+                              Member<&CaptureRecordHeader::stream>,
+                              Member<&CaptureRecordHeader::timeNs>,
+                              Member<&CaptureRecordHeader::length>>;
+};
+
+struct CaptureRecord {
+  CaptureChannel channel;
+  CaptureDirection direction;
+  uint32_t stream;
+  uint64_t timeNs;
+  Buffer data;
+};
+
+// Appends records to a capture file. Records may be written from any thread.
+class CaptureWriter {
+ public:
+  CaptureWriter(const std::string& path);
+  ~CaptureWriter();
+
+  CaptureWriter(const CaptureWriter&) = delete;
+  CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+  // Allocates a stream ID for a new connection
+  uint32_t newStream();
+
+  // Records the first `length` bytes of `segments` as a single record
+  void write(CaptureChannel channel,
+             CaptureDirection direction,
+             uint32_t stream,
+             std::span<const BufferView> segments,
+             int length);
+  void write(CaptureChannel channel,
+             CaptureDirection direction,
+             uint32_t stream,
+             BufferView data) {
+    write(channel, direction, stream, std::span(&data, 1), data.size());
+  }
+
+  // The capture that sockets created by the library (e.g. PTPIPFactory)
+  // record to, if any
+  static void setActive(std::shared_ptr<CaptureWriter> capture);
+  static std::shared_ptr<CaptureWriter> getActive();
+
+ private:
+  std::mutex mutex;
+  FILE* file = nullptr;
+  std::chrono::steady_clock::time_point startTime;
+  uint32_t nextStream = 0;
+  Buffer headerBuffer;
+};
+
+class CaptureReader {
+ public:
+  CaptureReader(const std::string& path);
+  ~CaptureReader();
+
+  CaptureReader(const CaptureReader&) = delete;
+  CaptureReader& operator=(const CaptureReader&) = delete;
+
+  // Reads the next record into `record`, returning false at the end of the
+  // file. Truncated records are treated as the end of the file, since the
+  // capture may not have been closed cleanly.
+  bool next(CaptureRecord& record);
+
+ private:
+  FILE* file = nullptr;
+  Buffer headerBuffer;
+};
+
+// Socket wrapper which forwards to `socket` and records everything sent and
+// received through it
+template <typename T>
+  requires std::derived_from<T, Socket>
+class RecordingSocket : public T {
+ public:
+  RecordingSocket(std::unique_ptr<T> socket,
+                  std::shared_ptr<CaptureWriter> capture,
+                  CaptureChannel channel)
+      : socket(std::move(socket)),
+        capture(std::move(capture)),
+        channel(channel),
+        stream(this->capture->newStream()) {}
+
+  int send(const Buffer& buffer) override {
+    int result = socket->send(buffer);
+    if (result > 0)
+      capture->write(channel, CaptureDirection::Sent, stream,
+                     BufferView(buffer.data(), result));
+    return result;
+  }
+
+  int send(std::span<const BufferView> segments) override {
+    int result = socket->send(segments);
+    if (result > 0)
+      capture->write(channel, CaptureDirection::Sent, stream, segments, result);
+    return result;
+  }
+
+  int recv(Buffer& buffer,
+           unsigned int timeoutMs = 0,
+           std::optional<int> length = std::nullopt) override {
+    int startSize = buffer.size();
+    int result = socket->recv(buffer, timeoutMs, length);
+    record(buffer, startSize);
+    return result;
+  }
+
+  int recvSome(Buffer& buffer, unsigned int timeoutMs, int maxLength) override {
+    int startSize = buffer.size();
+    int result = socket->recvSome(buffer, timeoutMs, maxLength);
+    record(buffer, startSize);
+    return result;
+  }
+
+  bool close() override { return socket->close(); }
+
+  SocketHandle getHandle() const override { return socket->getHandle(); }
+
+  void setReadSize(int readSize) override { socket->setReadSize(readSize); }
+
+  SocketMetrics getMetrics() const override { return socket->getMetrics(); }
+
+ protected:
+  // Waits on a scheduler go through the wrapper, but belong in the metrics of
+  // the wrapped socket
+  void countWait(std::chrono::steady_clock::duration waited) override {
+    static_cast<Socket&>(*socket).countWait(waited);
+  }
+
+  // Reads and writes done by a reactor are recorded here, as they bypass
+  // recv() and send()
+  bool canTransfer() const override {
+    return static_cast<const Socket&>(*socket).canTransfer();
+  }
+
+  int takeReceived(BufferView received, Buffer& buffer, int maxLength) override {
+    int startSize = buffer.size();
+    int result =
+        static_cast<Socket&>(*socket).takeReceived(received, buffer, maxLength);
+    record(buffer, startSize);
+    return result;
+  }
+
+  void countSent(BufferView sent, int result) override {
+    if (result > 0)
+      capture->write(channel, CaptureDirection::Sent, stream,
+                     sent.first(result));
+    static_cast<Socket&>(*socket).countSent(sent, result);
+  }
+
+  std::unique_ptr<T> socket;
+  std::shared_ptr<CaptureWriter> capture;
+  const CaptureChannel channel;
+  uint32_t stream;
+
+ private:
+  void record(const Buffer& buffer, int startSize) {
+    if (buffer.size() > startSize)
+      capture->write(channel, CaptureDirection::Received, stream,
+                     BufferView(buffer).subspan(startSize));
+  }
+};
+
+class RecordingTCPSocket : public RecordingSocket<TCPSocket> {
+ public:
+  using RecordingSocket::RecordingSocket;
+
+  // Each connection is recorded as a new stream
+  bool connect(const std::string& ip, int port) override {
+    stream = capture->newStream();
+    return socket->connect(ip, port);
+  }
+
+  Task<bool> connectAsync(Scheduler& scheduler,
+                          const std::string& ip,
+                          int port) override {
+    stream = capture->newStream();
+    return socket->connectAsync(scheduler, ip, port);
+  }
+
+  bool isConnected() override { return socket->isConnected(); }
+
+  bool setOptions(const TCPSocketOptions& options) override {
+    return socket->setOptions(options);
+  }
+};
+
+class RecordingUDPMulticastSocket
+    : public RecordingSocket<UDPMulticastSocket> {
+ public:
+  using RecordingSocket::RecordingSocket;
+
+  bool begin(const std::string& ip,
+             int port,
+             const std::string& interfaceIp = "") override {
+    return socket->begin(ip, port, interfaceIp);
+  }
+
+  bool setOptions(const SocketOptions& options) override {
+    return socket->setOptions(options);
+  }
+
+  std::string getRemoteIp() const override { return socket->getRemoteIp(); }
+  int getRemotePort() const override { return socket->getRemotePort(); }
+
+  int recvBatch(std::span<Datagram> datagrams) override {
+    int count = socket->recvBatch(datagrams);
+    for (int i = 0; i < count; i++)
+      capture->write(channel, CaptureDirection::Received, stream,
+                     datagrams[i].data);
+    return count;
+  }
+};
+
+// Wraps `socket` to record to the active capture, if there is one
+std::unique_ptr<TCPSocket> recordSocket(std::unique_ptr<TCPSocket> socket,
+                                        CaptureChannel channel);
+std::unique_ptr<UDPMulticastSocket> recordSocket(
+    std::unique_ptr<UDPMulticastSocket> socket,
+    CaptureChannel channel);
+
+}  // namespace cb
+
+#endif
\ No newline at end of file
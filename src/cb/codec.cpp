@@ -0,0 +1,91 @@
+#include <cb/codec.h>
+#include <cb/utf16.h>
+
+#include <algorithm>
+
+namespace cb {
+
+int getUnpackLimit(int hardLimit, std::optional<int> limitOffset) {
+  if (limitOffset.has_value() && limitOffset.value() < hardLimit)
+    hardLimit = limitOffset.value();
+  return hardLimit;
+}
+
+void SegmentBuffer::clear() {
+  buffer.clear();
+  views.clear();
+  joined.clear();
+}
+
+std::span<const BufferView> SegmentBuffer::segments() {
+  joined.clear();
+  int offset = 0;
+  for (auto& [viewOffset, view] : views) {
+    if (viewOffset > offset)
+      joined.emplace_back(buffer.data() + offset, viewOffset - offset);
+    if (!view.empty())
+      joined.push_back(view);
+    offset = viewOffset;
+  }
+  if (buffer.size() > offset)
+    joined.emplace_back(buffer.data() + offset, buffer.size() - offset);
+  return joined;
+}
+
+int SegmentBuffer::size() const {
+  int size = buffer.size();
+  for (auto& [viewOffset, view] : views)
+    size += view.size();
+  return size;
+}
+
+void Codec<std::string>::pack(std::string& value, Buffer& buffer, int& offset) {
+  // Reserved for the worst case so the string is only converted in one pass
+  size_t size = buffer.size();
+  uint8_t* dst =
+      reserveBytes(buffer, offset, (value.size() + 1) * sizeof(uint16_t));
+  int numUnits = utf8ToUtf16LE(value, dst);
+  dst[numUnits * 2] = 0;
+  dst[numUnits * 2 + 1] = 0;
+  offset += (numUnits + 1) * sizeof(uint16_t);
+  if (buffer.size() > size)
+    buffer.resize(std::max<size_t>(size, offset));
+}
+
+int Codec<std::string>::packedSize(std::string& value) {
+  return (utf16Length(value) + 1) * sizeof(uint16_t);
+}
+
+void Codec<std::string>::unpack(std::string& value,
+                                const Buffer& buffer,
+                                int& offset,
+                                std::optional<int> limitOffset,
+                                std::optional<uint32_t> count) {
+  int limit = getUnpackLimit(buffer.size(), limitOffset);
+  value.clear();
+  if (offset >= limit)
+    return;
+
+  int available = (limit - offset) / sizeof(uint16_t);
+  int maxUnits = available;
+  if (count.has_value() && count.value() < maxUnits)
+    maxUnits = count.value();
+
+  int numUnits = utf16LEToUtf8(buffer.data() + offset, maxUnits, value);
+  bool terminated = numUnits < maxUnits;
+
+  // When given, the count is trusted over the position of the terminator
+  if (count.has_value())
+    offset += maxUnits * sizeof(uint16_t);
+  else
+    offset += (numUnits + terminated) * sizeof(uint16_t);
+
+  // A trailing odd byte is read as a unit with a zero high byte
+  if (!terminated && maxUnits == available && offset < limit) {
+    uint8_t unit[2] = {buffer[offset++], 0};
+    if (unit[0] != 0)
+      utf16LEToUtf8(unit, 1, value);
+  }
+}
+
+}  // namespace cb
\ No newline at end of file
@@ -0,0 +1,302 @@
+#ifndef CB_CONTROL_CODEC_H
+#define CB_CONTROL_CODEC_H
+
+#include <array>
+#include <bit>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace cb {
+
+typedef std::vector<uint8_t> Buffer;
+typedef std::span<const uint8_t> BufferView;
+
+// TODO: Move this somewhere else?
+int getUnpackLimit(int hardLimit, std::optional<int> limitOffset);
+
+// Packed bytes interleaved with references to caller-owned memory, so large
+// payloads can be sent without first being copied into one contiguous buffer
+class SegmentBuffer {
+ public:
+  Buffer buffer;
+
+  // Adds a reference to `view` at the current end of `buffer`
+  void append(BufferView view) { views.emplace_back(buffer.size(), view); }
+
+  // Empties the buffer but keeps its capacity, so it can be packed into again
+  // without allocating
+  void clear();
+
+  // All segments in wire order, alternating between ranges of `buffer` and
+  // the appended views. These are invalidated by further packing.
+  std::span<const BufferView> segments();
+  int size() const;
+
+ private:
+  std::vector<std::pair<int, BufferView>> views;
+  std::vector<BufferView> joined;
+};
+
+// Integral types whose in-memory representation can be copied byte for byte
+template <typename T>
+concept BulkIntegral = std::integral<T> && !std::same_as<T, bool>;
+
+template <std::integral T>
+constexpr T byteSwap(T value) {
+  if constexpr (sizeof(T) == 1) {
+    return value;
+  } else {
+    using U = std::make_unsigned_t<T>;
+    U in = static_cast<U>(value);
+    U out = 0;
+    for (int i = 0; i < sizeof(T); i++)
+      out |= static_cast<U>((in >> i * 8) & 0xFF) << (sizeof(T) - 1 - i) * 8;
+    return static_cast<T>(out);
+  }
+}
+
+// Little endian load/store of `count` values. On little-endian hosts these are
+// plain copies; otherwise each value is byte-swapped in a tight loop that the
+// compiler can vectorize.
+template <BulkIntegral T>
+inline void storeLE(const T* values, size_t count, uint8_t* dst) {
+  if (count == 0)
+    return;
+  if constexpr (std::endian::native == std::endian::little || sizeof(T) == 1) {
+    std::memcpy(dst, values, count * sizeof(T));
+  } else {
+    for (size_t i = 0; i < count; i++) {
+      T value = byteSwap(values[i]);
+      std::memcpy(dst + i * sizeof(T), &value, sizeof(T));
+    }
+  }
+}
+
+template <BulkIntegral T>
+inline void loadLE(T* values, size_t count, const uint8_t* src) {
+  if (count == 0)
+    return;
+  std::memcpy(values, src, count * sizeof(T));
+  if constexpr (std::endian::native != std::endian::little && sizeof(T) > 1) {
+    for (size_t i = 0; i < count; i++)
+      values[i] = byteSwap(values[i]);
+  }
+}
+
+// Grows `buffer` if needed so that `size` bytes can be written at `offset`
+inline uint8_t* reserveBytes(Buffer& buffer, int offset, int size) {
+  if (offset + size > buffer.size())
+    buffer.resize(offset + size);
+  return buffer.data() + offset;
+}
+
+// Codecs are stateless encoders selected at compile time. Each one exposes the
+// same static pack/unpack/packedSize functions as the virtual Packer interface,
+// so packet schemas can encode fields without allocating packers or
+// dispatching through a vtable. The runtime packers delegate here to keep a
+// single wire format.
+template <typename T>
+struct Codec;
+
+// Primitive (little endian)
+template <std::integral T>
+struct Codec<T> {
+  static void pack(T& value, Buffer& buffer, int& offset) {
+    uint8_t* dst = reserveBytes(buffer, offset, sizeof(T));
+    if constexpr (std::same_as<T, bool>)
+      *dst = value;
+    else
+      storeLE(&value, 1, dst);
+    offset += sizeof(T);
+  }
+
+  static int packedSize(T&) { return sizeof(T); }
+
+  static void unpack(T& value,
+                     const Buffer& buffer,
+                     int& offset,
+                     std::optional<int> limitOffset) {
+    int limit = getUnpackLimit(buffer.size(), limitOffset);
+    if constexpr (BulkIntegral<T>) {
+      if (offset >= 0 && offset + (int)sizeof(T) <= limit) {
+        loadLE(&value, 1, buffer.data() + offset);
+        offset += sizeof(T);
+        return;
+      }
+    }
+
+    value = 0;
+    for (int i = 0; i < sizeof(T); i++) {
+      // Current behavior will assume byte=0x00 if out of range
+      if (offset >= limit)
+        break;
+      value |= static_cast<T>(buffer[offset]) << i * 8;
+      offset++;
+    }
+  }
+};
+
+// Vector of elements encoded back to back. When `count` is given, at most that
+// many elements are unpacked; otherwise the vector is greedy and consumes
+// until the end of the packet.
+template <typename T, typename ElementCodec = Codec<T>>
+struct VectorCodec {
+  static void pack(std::vector<T>& values, Buffer& buffer, int& offset) {
+    for (T& value : values)
+      ElementCodec::pack(value, buffer, offset);
+  }
+
+  static int packedSize(std::vector<T>& values) {
+    int size = 0;
+    for (T& value : values)
+      size += ElementCodec::packedSize(value);
+    return size;
+  }
+
+  static void unpack(std::vector<T>& values,
+                     const Buffer& buffer,
+                     int& offset,
+                     std::optional<int> limitOffset,
+                     std::optional<uint32_t> count = std::nullopt) {
+    int limit = getUnpackLimit(buffer.size(), limitOffset);
+
+    // Existing elements are unpacked over rather than destroyed, so vectors
+    // that are unpacked repeatedly keep the capacity of their elements
+    uint32_t i = 0;
+    for (; offset < limit && (!count.has_value() || i < count); i++) {
+      if (i == values.size())
+        values.emplace_back();
+      ElementCodec::unpack(values[i], buffer, offset, limitOffset);
+    }
+    values.resize(i);
+  }
+};
+
+// Bulk path for integral elements, which are copied as one block instead of
+// element by element
+template <BulkIntegral T>
+struct VectorCodec<T, Codec<T>> {
+  static void pack(std::vector<T>& values, Buffer& buffer, int& offset) {
+    int size = values.size() * sizeof(T);
+    storeLE(values.data(), values.size(), reserveBytes(buffer, offset, size));
+    offset += size;
+  }
+
+  static int packedSize(std::vector<T>& values) {
+    return values.size() * sizeof(T);
+  }
+
+  static void unpack(std::vector<T>& values,
+                     const Buffer& buffer,
+                     int& offset,
+                     std::optional<int> limitOffset,
+                     std::optional<uint32_t> count = std::nullopt) {
+    int limit = getUnpackLimit(buffer.size(), limitOffset);
+    size_t available = offset < limit ? limit - offset : 0;
+
+    // A trailing partial element is zero-padded, as in the scalar path
+    size_t whole = available / sizeof(T);
+    size_t total = whole + (available % sizeof(T) != 0);
+    if (count.has_value() && total > count.value())
+      total = count.value();
+    if (whole > total)
+      whole = total;
+
+    // Every element is overwritten below, so there is no need to clear first
+    values.resize(total);
+    loadLE(values.data(), whole, buffer.data() + offset);
+    offset += whole * sizeof(T);
+    if (whole < total)
+      Codec<T>::unpack(values[whole], buffer, offset, limitOffset);
+  }
+};
+
+template <std::integral T>
+struct Codec<std::vector<T>> : VectorCodec<T> {};
+
+// Fixed-length array
+template <std::integral T, size_t N>
+struct Codec<std::array<T, N>> {
+  static void pack(std::array<T, N>& values, Buffer& buffer, int& offset) {
+    if constexpr (BulkIntegral<T>) {
+      storeLE(values.data(), N, reserveBytes(buffer, offset, N * sizeof(T)));
+      offset += N * sizeof(T);
+    } else {
+      for (T& value : values)
+        Codec<T>::pack(value, buffer, offset);
+    }
+  }
+
+  static int packedSize(std::array<T, N>&) { return N * sizeof(T); }
+
+  static void unpack(std::array<T, N>& values,
+                     const Buffer& buffer,
+                     int& offset,
+                     std::optional<int> limitOffset) {
+    size_t whole = 0;
+    if constexpr (BulkIntegral<T>) {
+      int limit = getUnpackLimit(buffer.size(), limitOffset);
+      size_t available = offset < limit ? limit - offset : 0;
+      whole = available / sizeof(T) < N ? available / sizeof(T) : N;
+      loadLE(values.data(), whole, buffer.data() + offset);
+      offset += whole * sizeof(T);
+    }
+
+    // Elements past the end of the buffer are zeroed, as in the scalar path
+    for (size_t i = whole; i < N; i++)
+      Codec<T>::unpack(values[i], buffer, offset, limitOffset);
+  }
+};
+
+// Greedy view of the remaining bytes. Unpacking refers into the source buffer
+// instead of copying, so the view is only valid while that buffer is alive and
+// unmodified.
+template <>
+struct Codec<BufferView> {
+  static void pack(BufferView& value, Buffer& buffer, int& offset) {
+    storeLE(value.data(), value.size(),
+            reserveBytes(buffer, offset, value.size()));
+    offset += value.size();
+  }
+
+  static int packedSize(BufferView& value) { return value.size(); }
+
+  static void packSegments(BufferView& value, SegmentBuffer& segments) {
+    segments.append(value);
+  }
+
+  static void unpack(BufferView& value,
+                     const Buffer& buffer,
+                     int& offset,
+                     std::optional<int> limitOffset) {
+    int limit = getUnpackLimit(buffer.size(), limitOffset);
+    value = BufferView();
+    if (offset < limit) {
+      value = BufferView(buffer.data() + offset, limit - offset);
+      offset = limit;
+    }
+  }
+};
+
+// Wide string (UTF-8 in memory, null-terminated UTF-16LE as in PTP). When
+// `count` is given, exactly that many units (including the terminator) are
+// consumed; otherwise the string ends at the first null unit.
+template <>
+struct Codec<std::string> {
+  static void pack(std::string& value, Buffer& buffer, int& offset);
+  static int packedSize(std::string& value);
+  static void unpack(std::string& value,
+                     const Buffer& buffer,
+                     int& offset,
+                     std::optional<int> limitOffset,
+                     std::optional<uint32_t> count = std::nullopt);
+};
+
+}  // namespace cb
+
+#endif
\ No newline at end of file
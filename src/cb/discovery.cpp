@@ -1,14 +1,20 @@
 #include <cb/discovery.h>
 
+#include <cb/dispatch.h>
+
 namespace cb {
 
 void DiscoveryService::receiveEvent(std::unique_ptr<EventContainer> container) {
+  using DiscoveryDispatch =
+      PacketDispatch<EventPacket, DiscoveryAddEvent, DiscoveryRemoveEvent>;
+
+  DiscoveryDispatch::Result packet;
   for (const Buffer& event : container->events) {
     try {
-      if (auto addEvent = EventPacket::unpackAs<DiscoveryAddEvent>(event)) {
-        cameras[container->id] = createCamera(std::move(addEvent));
-      } else if (auto removeEvent =
-                     EventPacket::unpackAs<DiscoveryRemoveEvent>(event)) {
+      DiscoveryDispatch::unpack(event, packet);
+      if (auto addEvent = std::get_if<DiscoveryAddEvent>(&packet)) {
+        cameras[container->id] = createCamera(*addEvent);
+      } else if (std::holds_alternative<DiscoveryRemoveEvent>(packet)) {
         cameras.erase(container->id);
       }
     } catch (Exception& e) {
@@ -22,7 +28,7 @@ void DiscoveryService::pushAndReceive(std::string containerId,
                                       std::unique_ptr<EventPacket> event) {
   pushEvent<EventContainer>(containerId, std::vector<Buffer>{event->pack()});
   receiveEvent(std::make_unique<EventContainer>(
-      containerId, std::vector<Buffer>{event->pack()}));
+      std::move(containerId), std::vector<Buffer>{event->pack()}));
 }
 
 }  // namespace cb
\ No newline at end of file
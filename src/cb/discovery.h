@@ -3,6 +3,7 @@
 
 #include <cb/event.h>
 #include <cb/proxy.h>
+#include <cb/reactor.h>
 
 namespace cb {
 
@@ -17,10 +18,16 @@ class DiscoveryService : public EventProxy<EventContainer> {
       : cameras(cameras), discoveryMethod(discoveryMethod) {}
 
   virtual std::unique_ptr<CameraProxy> createCamera(
-      std::unique_ptr<DiscoveryAddEvent> addEvent) = 0;
+      const DiscoveryAddEvent& addEvent) = 0;
 
   void receiveEvent(std::unique_ptr<EventContainer> event) override;
 
+  // Handles discovery traffic on `reactor` as it arrives instead of when
+  // popEvent() is called, calling `onEvents` afterwards so new events can be
+  // popped. Returns false if there is nothing to watch.
+  virtual bool attach(Reactor& reactor, Reactor::Callback onEvents) = 0;
+  virtual void detach() = 0;
+
  protected:
   std::string createId(std::string connectionAddress) {
     return std::to_string(static_cast<int>(discoveryMethod)) + "|" +
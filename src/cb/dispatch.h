@@ -0,0 +1,64 @@
+#ifndef CB_CONTROL_DISPATCH_H
+#define CB_CONTROL_DISPATCH_H
+
+#include <cb/exception.h>
+#include <cb/schema.h>
+
+#include <unordered_map>
+#include <utility>
+#include <variant>
+
+namespace cb {
+
+// Registry of the packet types of one family (i.e. sharing the header of
+// `Base`) that a call site handles. Unpacking reads only the header to get the
+// type, looks up the matching type in O(1) and unpacks the buffer exactly once
+// into that alternative of `Result`.
+template <typename Base, typename... Ts>
+  requires(std::derived_from<Ts, Base> && ...)
+class PacketDispatch {
+ public:
+  using Result = std::variant<std::monostate, Ts...>;
+
+  // Returns false (leaving `result` empty) if the type matches none of `Ts`.
+  // Throws if two of `Ts` share a type, as one of them could never be
+  // unpacked.
+  static bool unpack(const Buffer& buffer, Result& result) {
+    static const std::unordered_map<uint32_t, Unpacker> unpackers =
+        makeUnpackers(std::index_sequence_for<Ts...>());
+
+    auto it = unpackers.find(Base::peekType(buffer));
+    if (it == unpackers.end()) {
+      result.template emplace<0>();
+      return false;
+    }
+    it->second(buffer, result);
+    return true;
+  }
+
+ private:
+  typedef void (*Unpacker)(const Buffer& buffer, Result& result);
+
+  // Packets are unpacked in place rather than into a temporary which would
+  // then be copied into `result`
+  template <size_t I>
+  static void unpackAt(const Buffer& buffer, Result& result) {
+    result.template emplace<I + 1>().unpack(buffer);
+  }
+
+  template <size_t... Is>
+  static std::unordered_map<uint32_t, Unpacker> makeUnpackers(
+      std::index_sequence<Is...>) {
+    std::unordered_map<uint32_t, Unpacker> unpackers;
+    bool isUnique =
+        (unpackers.try_emplace(Ts().getType(), &unpackAt<Is>).second && ...);
+    if (!isUnique)
+      throw Exception(ExceptionContext::PacketDispatch,
+                      ExceptionType::DuplicateType);
+    return unpackers;
+  }
+};
+
+}  // namespace cb
+
+#endif
\ No newline at end of file
@@ -2,7 +2,9 @@
 #define CB_CONTROL_EVENT_H
 
 #include <cb/exception.h>
+#include <cb/pool.h>
 #include <cb/protocols/tcp.h>
+#include <cb/schema.h>
 
 #include <mutex>
 #include <queue>
@@ -51,62 +53,63 @@ class EventProxy : public EventEmitter<T> {
   virtual void receiveEvent(std::unique_ptr<T> event) = 0;
 };
 
-class EventPacket : public TCPPacket {
+class EventPacket : public SchemaPacket<EventPacket, TCPPacket> {
  public:
   uint32_t length = 0;
   uint32_t eventCode = 0;
 
-  EventPacket(uint32_t eventCode) : eventCode(eventCode) {
-    lengthField(this->length);
-    typeField(this->eventCode);
-  }
-  EventPacket() : EventPacket(0) {}
+  using Schema = PacketSchema<LengthMember<&EventPacket::length>,
+                              TypeMember<&EventPacket::eventCode>>;
 
-  template <typename T>
-    requires(std::derived_from<T, EventPacket>)
-  static std::unique_ptr<T> unpackAs(const Buffer& buffer) {
-    return Packet::unpackAs<EventPacket, T>(buffer);
-  }
+  EventPacket(uint32_t eventCode) : eventCode(eventCode) {}
+  EventPacket() : EventPacket(0) {}
 };
 
-class EventContainer : public EventPacket {
+class EventContainer : public SchemaPacket<EventContainer, EventPacket>,
+                       public Pooled<EventContainer> {
  public:
   std::string id;
   std::vector<Buffer> events;
 
-  // TODO: Use move semantics for events
+  using Schema = EventPacket::Schema::Append<
+      Member<&EventContainer::id>,
+      Member<&EventContainer::events,
+             VectorCodec<Buffer, PacketBufferCodec<EventPacket>>>>;
+
   EventContainer(std::string id, std::vector<Buffer> events)
-      : EventPacket(0x01), id(id), events(events) {
-    field(this->id);
-    field<EventPacket>(this->events);
-  }
+      : SchemaPacket(0x01), id(std::move(id)), events(std::move(events)) {}
   EventContainer() : EventContainer("", {}) {}
 };
 
-class ExceptionEvent : public EventPacket {
+class ExceptionEvent : public SchemaPacket<ExceptionEvent, EventPacket>,
+                       public Pooled<ExceptionEvent> {
  public:
   uint16_t contextCode = 0;
   uint16_t typeCode = 0;
 
+  using Schema = EventPacket::Schema::Append<
+      Member<&ExceptionEvent::contextCode>,
+      Member<&ExceptionEvent::typeCode>>;
+
   ExceptionEvent(uint16_t contextCode, uint16_t typeCode)
-      : EventPacket(0x02), contextCode(contextCode), typeCode(typeCode) {
-    field(this->contextCode);
-    field(this->typeCode);
-  }
+      : SchemaPacket(0x02), contextCode(contextCode), typeCode(typeCode) {}
   ExceptionEvent() : ExceptionEvent(0, 0) {}
 
-  ExceptionEvent(Exception& e)
+  ExceptionEvent(const Exception& e)
       : ExceptionEvent(static_cast<uint16_t>(e.context),
                        static_cast<uint16_t>(e.type)) {}
 };
 
-class ConnectEvent : public EventPacket {
+class ConnectEvent : public SchemaPacket<ConnectEvent, EventPacket>,
+                     public Pooled<ConnectEvent> {
  public:
   bool isConnected = false;
 
-  ConnectEvent(bool isConnected) : EventPacket(0x03), isConnected(isConnected) {
-    field(this->isConnected);
-  }
+  using Schema = EventPacket::Schema::Append<
+      Member<&ConnectEvent::isConnected>>;
+
+  ConnectEvent(bool isConnected)
+      : SchemaPacket(0x03), isConnected(isConnected) {}
   ConnectEvent() : ConnectEvent(false) {}
 };
 
@@ -115,27 +118,29 @@ class CaptureEvent : public EventPacket {
   CaptureEvent() : EventPacket(0x04) {}
 };
 
-class SetPropEvent : public EventPacket {
+class SetPropEvent : public SchemaPacket<SetPropEvent, EventPacket>,
+                     public Pooled<SetPropEvent> {
  public:
   uint16_t propCode = 0;
   uint32_t valueNumerator = 0;
   uint32_t valueDenominator = 0;
 
+  using Schema = EventPacket::Schema::Append<
+      Member<&SetPropEvent::propCode>,
+      Member<&SetPropEvent::valueNumerator>,
+      Member<&SetPropEvent::valueDenominator>>;
+
   SetPropEvent(uint16_t propCode,
                uint32_t valueNumerator,
                uint32_t valueDenominator)
-      : EventPacket(0x05),
+      : SchemaPacket(0x05),
         propCode(propCode),
         valueNumerator(valueNumerator),
-        valueDenominator(valueDenominator) {
-    field(this->propCode);
-    field(this->valueNumerator);
-    field(this->valueDenominator);
-  }
+        valueDenominator(valueDenominator) {}
   SetPropEvent() : SetPropEvent(0, 0, 0) {}
 };
 
-class DiscoveryAddEvent : public EventPacket {
+class DiscoveryAddEvent : public SchemaPacket<DiscoveryAddEvent, EventPacket> {
  public:
   uint16_t methodCode = 0;
   std::string connectionAddress;
@@ -144,26 +149,27 @@ class DiscoveryAddEvent : public EventPacket {
   std::string model;
   std::string name;
 
+  using Schema = EventPacket::Schema::Append<
+      Member<&DiscoveryAddEvent::methodCode>,
+      Member<&DiscoveryAddEvent::connectionAddress>,
+      Member<&DiscoveryAddEvent::serialNumber>,
+      Member<&DiscoveryAddEvent::manufacturer>,
+      Member<&DiscoveryAddEvent::model>,
+      Member<&DiscoveryAddEvent::name>>;
+
   DiscoveryAddEvent(uint16_t methodCode,
                     std::string connectionAddress,
                     std::string serialNumber,
                     std::string manufacturer,
                     std::string model,
                     std::string name)
-      : EventPacket(0x06),
+      : SchemaPacket(0x06),
         methodCode(methodCode),
         connectionAddress(connectionAddress),
         serialNumber(serialNumber),
         manufacturer(manufacturer),
         model(model),
-        name(name) {
-    field(this->methodCode);
-    field(this->connectionAddress);
-    field(this->serialNumber);
-    field(this->manufacturer);
-    field(this->model);
-    field(this->name);
-  }
+        name(name) {}
   DiscoveryAddEvent() : DiscoveryAddEvent(0, "", "", "", "", "") {}
 };
 
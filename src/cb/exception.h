@@ -15,6 +15,8 @@ enum class ExceptionContext {
   PTPDevicePropDesc,
   Factory,
   CameraSetProp,
+  Capture,
+  PacketDispatch,
 };
 
 enum class ExceptionType {
@@ -34,6 +36,8 @@ enum class ExceptionType {
   UnsupportedTransport,
   UnsupportedProperty,
   UnsupportedValue,
+  FileFailure,
+  DuplicateType,
 };
 
 class Exception : public std::exception {
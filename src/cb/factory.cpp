@@ -1,3 +1,4 @@
+#include <cb/capture.h>
 #include <cb/factory.h>
 #include <cb/logger.h>
 #include <cb/platforms/socketImpl.h>
@@ -7,17 +8,56 @@
 
 namespace cb {
 
+namespace {
+
+Task<void> createInto(Scheduler& scheduler,
+                      const PTPCameraFactory& factory,
+                      std::unique_ptr<EventCamera>& camera) {
+  try {
+    camera = co_await factory.createAsync(scheduler);
+  } catch (const std::exception& e) {
+    Logger::log("Camera bring-up failed: %s", e.what());
+  }
+}
+
+}  // namespace
+
 std::unique_ptr<EventCamera> PTPCameraFactory::create() const {
   PTP ptp(transportFactory->create());
   ptp.openTransport();
   std::unique_ptr<DeviceInfo> deviceInfo = ptp.getDeviceInfo();
+  return createVendorCamera(std::move(ptp), *deviceInfo);
+}
 
+Task<std::unique_ptr<EventCamera>> PTPCameraFactory::createAsync(
+    Scheduler& scheduler) const {
+  PTP ptp(transportFactory->create());
+  co_await ptp.openTransportAsync(scheduler);
+  std::unique_ptr<DeviceInfo> deviceInfo =
+      co_await ptp.getDeviceInfoAsync(scheduler);
+  co_return createVendorCamera(std::move(ptp), *deviceInfo);
+}
+
+Task<std::vector<std::unique_ptr<EventCamera>>> PTPCameraFactory::createAll(
+    Scheduler& scheduler,
+    std::span<const PTPCameraFactory* const> factories) {
+  std::vector<std::unique_ptr<EventCamera>> cameras(factories.size());
+  std::vector<Task<void>> tasks;
+  for (size_t i = 0; i < factories.size(); i++)
+    tasks.push_back(createInto(scheduler, *factories[i], cameras[i]));
+  co_await scheduler.whenAll(std::move(tasks));
+  co_return cameras;
+}
+
+std::unique_ptr<EventCamera> PTPCameraFactory::createVendorCamera(
+    PTP ptp,
+    const DeviceInfo& deviceInfo) {
   // Canon and Nikon use the MTP VendorExtensionID instead of their designated
   // ones, so we check the manufacturer string instead
-  if (deviceInfo->manufacturer.find("Canon") != std::string::npos) {
+  if (deviceInfo.manufacturer.find("Canon") != std::string::npos) {
     Logger::log("Detected Canon camera.");
     return std::make_unique<CanonPTPCamera>(std::move(ptp));
-  } else if (deviceInfo->manufacturer.find("Nikon") != std::string::npos) {
+  } else if (deviceInfo.manufacturer.find("Nikon") != std::string::npos) {
     Logger::log("Detected Nikon camera.");
     return std::make_unique<NikonPTPCamera>(std::move(ptp));
   }
@@ -25,16 +65,19 @@ std::unique_ptr<EventCamera> PTPCameraFactory::create() const {
   throw Exception(ExceptionContext::Factory, ExceptionType::UnsupportedCamera);
 }
 
-// TODO: Find a less weird preprocessor "control" flow for this
 std::unique_ptr<PTPTransport> PTPIPFactory::create() const {
-#if defined(_WIN32)
-  return std::make_unique<PTPIP>(std::make_unique<TCPSocketImpl>(),
-                                 std::make_unique<TCPSocketImpl>(), clientGuid,
-                                 clientName, ip);
-#elif defined(ESP32)
-  return std::make_unique<PTPIP>(std::make_unique<TCPSocketImpl>(),
-                                 std::make_unique<TCPSocketImpl>(), clientGuid,
-                                 clientName, ip);
+#if defined(CB_CONTROL_SOCKET_IMPL)
+  std::unique_ptr<TCPSocket> commandSocket = createTCPSocket();
+  std::unique_ptr<TCPSocket> eventSocket = createTCPSocket();
+  // Not connected yet, so these only fail for unsupported options, which
+  // connecting reports
+  commandSocket->setOptions(options.command);
+  eventSocket->setOptions(options.event);
+
+  return std::make_unique<PTPIP>(
+      recordSocket(std::move(commandSocket), CaptureChannel::PTPIPCommand),
+      recordSocket(std::move(eventSocket), CaptureChannel::PTPIPEvent),
+      clientGuid, clientName, ip, port);
 #else
   throw Exception(ExceptionContext::Factory,
                   ExceptionType::UnsupportedTransport);
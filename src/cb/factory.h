@@ -3,6 +3,9 @@
 
 #include <cb/camera.h>
 #include <cb/ptp/ip.h>
+#include <cb/scheduler.h>
+
+#include <span>
 
 namespace cb {
 
@@ -20,9 +23,25 @@ class PTPCameraFactory : public Factory<EventCamera> {
       : transportFactory(std::move(transportFactory)) {}
 
   std::unique_ptr<EventCamera> create() const override;
+  // Like create(), but suspending on `scheduler` instead of blocking while
+  // waiting for the camera
+  Task<std::unique_ptr<EventCamera>> createAsync(Scheduler& scheduler) const;
+
+  // Creates a camera from each factory at once, so bringing up a rig takes
+  // about as long as its slowest reachable camera (or the connect timeout, if
+  // some are unreachable) rather than all of them in turn. Cameras that
+  // couldn't be created are logged and left null. The factories must outlive
+  // the task.
+  static Task<std::vector<std::unique_ptr<EventCamera>>> createAll(
+      Scheduler& scheduler,
+      std::span<const PTPCameraFactory* const> factories);
 
  private:
   std::unique_ptr<Factory<PTPTransport>> transportFactory;
+
+  static std::unique_ptr<EventCamera> createVendorCamera(
+      PTP ptp,
+      const DeviceInfo& deviceInfo);
 };
 
 class PTPIPFactory : public Factory<PTPTransport> {
@@ -30,8 +49,13 @@ class PTPIPFactory : public Factory<PTPTransport> {
   PTPIPFactory(std::array<uint8_t, 16> clientGuid,
                std::string clientName,
                std::string ip,
-               int port = 15740)
-      : clientGuid(clientGuid), clientName(clientName), ip(ip), port(port) {}
+               int port = 15740,
+               PTPIPOptions options = {})
+      : clientGuid(clientGuid),
+        clientName(clientName),
+        ip(ip),
+        port(port),
+        options(options) {}
 
   std::unique_ptr<PTPTransport> create() const override;
 
@@ -40,6 +64,7 @@ class PTPIPFactory : public Factory<PTPTransport> {
   const std::string clientName;
   const std::string ip;
   const int port;
+  const PTPIPOptions options;
 };
 
 }  // namespace cb
@@ -3,10 +3,10 @@
 
 #include <cb/packet.h>
 
-#if defined(_WIN32)
-#include <iostream>
-#elif defined(ESP32)
+#if defined(ESP32)
 #include <HardwareSerial.h>
+#else
+#include <iostream>
 #endif
 
 namespace cb {
@@ -17,15 +17,15 @@ class Logger {
   static void log(bool newLine, const char* format, Args... args) {
     char msg[256];
     snprintf(msg, sizeof(msg), format, args...);
-#if defined(_WIN32)
-    std::cout << msg;
-    if (newLine)
-      std::cout << std::endl;
-#elif defined(ESP32)
+#if defined(ESP32)
     if (newLine)
       Serial.println(msg);
     else
       Serial.print(msg);
+#else
+    std::cout << msg;
+    if (newLine)
+      std::cout << std::endl;
 #endif
   }
 
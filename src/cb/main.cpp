@@ -1,8 +1,13 @@
+#include <cb/capture.h>
+#include <cb/dispatch.h>
 #include <cb/logger.h>
+#include <cb/platforms/reactorImpl.h>
 #include <cb/platforms/socketImpl.h>
 #include <cb/protocols/ssdp.h>
 #include <cb/protocols/xml.h>
+#include <cb/scheduler.h>
 
+#include <cstdlib>
 #include <thread>
 
 int main() {
@@ -12,34 +17,68 @@ int main() {
   std::array<uint8_t, 16> guid = {'C', 'a', 'p', 't', 'u', 'r', 'e', 'B',
                                   'e', 'a', 'm', 'P', 'T', 'P', 'I', 'P'};
 
+  // Record all camera traffic for replay (see bench/replay.cpp)
+  if (const char* capturePath = std::getenv("CB_CAPTURE"))
+    CaptureWriter::setActive(std::make_shared<CaptureWriter>(capturePath));
+
+  // Cameras may be on any of the host's networks
+  std::map<std::string, std::unique_ptr<UDPMulticastSocket>> udpSockets;
+  for (const std::string& interfaceIp : getInterfaceAddresses()) {
+    udpSockets[interfaceIp] = recordSocket(
+        std::make_unique<UDPMulticastSocketImpl>(), CaptureChannel::SSDP);
+  }
+  if (udpSockets.empty()) {
+    udpSockets[""] = recordSocket(std::make_unique<UDPMulticastSocketImpl>(),
+                                  CaptureChannel::SSDP);
+  }
+
   SSDPDiscovery ssdp(
-      cameras, std::make_unique<UDPMulticastSocketImpl>(),
-      std::make_unique<TCPSocketImpl>(),
+      cameras, std::move(udpSockets),
+      recordSocket(createTCPSocket(), CaptureChannel::HTTP),
       {"urn:schemas-canon-com:service:ICPO-SmartPhoneEOSSystemService:1"}, guid,
       "CaptureBeam");
 
-  while (true) {
-    std::this_thread::sleep_for(std::chrono::milliseconds(200));
-    std::unique_ptr<EventContainer> container = ssdp.popEvent();
-    if (!container)
-      continue;
-    for (const Buffer& event : container->events) {
-      if (auto addEvent = EventPacket::unpackAs<DiscoveryAddEvent>(event)) {
-        Logger::log("===Discovery Add Event===");
-        Logger::log("Camera ID: %s", container->id.c_str());
-        Logger::log("IP address: %s", addEvent->connectionAddress.c_str());
-        Logger::log("Serial number: %s", addEvent->serialNumber.c_str());
-        Logger::log("Manufacturer: %s", addEvent->manufacturer.c_str());
-        Logger::log("Model: %s", addEvent->model.c_str());
-        Logger::log("Friendly name: %s", addEvent->name.c_str());
-        Logger::log();
-      } else if (EventPacket::unpackAs<DiscoveryRemoveEvent>(event)) {
-        Logger::log("===Discovery Remove Event===");
-        Logger::log("Camera ID: %s", container->id.c_str());
-        Logger::log();
+  auto logEvents = [&ssdp]() {
+    using DiscoveryDispatch =
+        PacketDispatch<EventPacket, DiscoveryAddEvent, DiscoveryRemoveEvent>;
+
+    DiscoveryDispatch::Result packet;
+    while (std::unique_ptr<EventContainer> container = ssdp.popEvent()) {
+      for (const Buffer& event : container->events) {
+        DiscoveryDispatch::unpack(event, packet);
+        if (auto addEvent = std::get_if<DiscoveryAddEvent>(&packet)) {
+          Logger::log("===Discovery Add Event===");
+          Logger::log("Camera ID: %s", container->id.c_str());
+          Logger::log("IP address: %s", addEvent->connectionAddress.c_str());
+          Logger::log("Serial number: %s", addEvent->serialNumber.c_str());
+          Logger::log("Manufacturer: %s", addEvent->manufacturer.c_str());
+          Logger::log("Model: %s", addEvent->model.c_str());
+          Logger::log("Friendly name: %s", addEvent->name.c_str());
+          Logger::log();
+        } else if (std::holds_alternative<DiscoveryRemoveEvent>(packet)) {
+          Logger::log("===Discovery Remove Event===");
+          Logger::log("Camera ID: %s", container->id.c_str());
+          Logger::log();
+        }
       }
     }
+  };
+
+#if defined(CB_CONTROL_REACTOR_IMPL)
+  // Discovery and every camera it adds share this thread
+  std::shared_ptr<Reactor> reactor = createReactor();
+  Reactor::setActive(reactor);
+  // Device descriptions and camera polls run here, off the reactor thread
+  auto scheduler = std::make_shared<Scheduler>(reactor);
+  Scheduler::setActive(scheduler);
+  ssdp.attach(*reactor, logEvents);
+  reactor->run();
+#else
+  while (true) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    logEvents();
   }
+#endif
 
   return 0;
 }
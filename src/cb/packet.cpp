@@ -4,37 +4,6 @@
 
 namespace cb {
 
-int getUnpackLimit(int hardLimit, std::optional<int> limitOffset) {
-  if (limitOffset.has_value() && limitOffset.value() < hardLimit)
-    hardLimit = limitOffset.value();
-  return hardLimit;
-}
-
-void WideString::pack(std::string& value, Buffer& buffer, int& offset) {
-  uint16_t wideChar;
-  for (char& c : value) {
-    wideChar = c;
-    packer.pack(wideChar, buffer, offset);
-  }
-  wideChar = 0;
-  packer.pack(wideChar, buffer, offset);
-}
-
-void WideString::unpack(std::string& value,
-                        const Buffer& buffer,
-                        int& offset,
-                        std::optional<int> limitOffset) {
-  int limit = getUnpackLimit(buffer.size(), limitOffset);
-  uint16_t wideChar;
-  value.clear();
-  while (offset < limit) {
-    packer.unpack(wideChar, buffer, offset, limitOffset);
-    if (wideChar == '\0')
-      break;
-    value.push_back(wideChar);
-  }
-}
-
 void DelimitedString::pack(std::string& value, Buffer& buffer, int& offset) {
   if (value.empty() && !packEmpty)
     return;
@@ -50,6 +19,19 @@ void DelimitedString::pack(std::string& value, Buffer& buffer, int& offset) {
     packer.pack(trimChars[0], buffer, offset);
 }
 
+int DelimitedString::packedSize(std::string& value) {
+  if (value.empty() && !packEmpty)
+    return 0;
+  int size = value.size();
+  if (!start.empty())
+    size += start[0].size();
+  if (!end.empty() && seekEnd)
+    size += end[0].size();
+  if (!trimChars.empty() && packTrim)
+    size++;
+  return size;
+}
+
 void DelimitedString::unpack(std::string& value,
                              const Buffer& buffer,
                              int& offset,
@@ -93,8 +75,18 @@ void DelimitedString::unpack(std::string& value,
   }
 
   while (offset < limit) {
-    packer.unpack(c, buffer, offset, limitOffset);
-    value.push_back(c);
+    // Characters that cannot complete an end string are appended in bulk
+    int next = offset;
+    if (scanEnd)
+      next = endScanner.find(buffer.data() + offset, buffer.data() + limit) -
+             buffer.data();
+    if (next == limit) {
+      value.append(buffer.begin() + offset, buffer.begin() + limit);
+      offset = limit;
+      break;
+    }
+    value.append(buffer.begin() + offset, buffer.begin() + next + 1);
+    offset = next + 1;
 
     for (std::string& e : end) {
       auto valueIt = value.rbegin();
@@ -147,17 +139,23 @@ void NestedPacket::unpack(Packet& value,
   value.unpack(buffer, offset, limitOffset);
 }
 
+int NestedPacket::packedSize(Packet& value) {
+  return value.packedSize();
+}
+
 void Packet::pack(Buffer& buffer, int& offset) {
   int startOffset = offset;
-  for (std::unique_ptr<IField>& field : fields)
-    field->pack(buffer, offset);
+  int lengthOffset = offset;
+  for (int i = 0; i < fields.size(); i++) {
+    if (i == lengthFieldIndex)
+      lengthOffset = offset;
+    fields[i]->pack(buffer, offset);
+  }
 
+  // Patch the length field in place now that the full length is known
   if (_length.isBound()) {
     _length.set(offset - startOffset);
-
-    offset = startOffset;
-    for (std::unique_ptr<IField>& field : fields)
-      field->pack(buffer, offset);
+    fields[lengthFieldIndex]->pack(buffer, lengthOffset);
   }
 };
 
@@ -173,13 +171,27 @@ void Packet::unpack(const Buffer& buffer,
   }
 };
 
+int Packet::packedSize() {
+  int size = 0;
+  for (std::unique_ptr<IField>& field : fields)
+    size += field->packedSize();
+  return size;
+}
+
 Buffer Packet::pack() {
   Buffer buffer;
+  buffer.reserve(packedSize());
   int offset = 0;
   pack(buffer, offset);
   return buffer;
 };
 
+void Packet::packSegments(SegmentBuffer& segments) {
+  int offset = segments.buffer.size();
+  segments.buffer.reserve(offset + packedSize());
+  pack(segments.buffer, offset);
+}
+
 void Packet::unpack(const Buffer& buffer) {
   int offset = 0;
   unpack(buffer, offset);
@@ -1,22 +1,15 @@
 #ifndef CB_CONTROL_PACKET_H
 #define CB_CONTROL_PACKET_H
 
-#include <array>
-#include <concepts>
-#include <cstdint>
+#include <cb/codec.h>
+#include <cb/scan.h>
+
 #include <memory>
-#include <optional>
-#include <string>
-#include <vector>
 
 namespace cb {
 
-typedef std::vector<uint8_t> Buffer;
 class Packet;
 
-// TODO: Move this somewhere else?
-int getUnpackLimit(int hardLimit, std::optional<int> limitOffset);
-
 template <std::unsigned_integral T>
 class ISpecialPropRef {
  public:
@@ -76,6 +69,8 @@ class Packer {
                       const Buffer& buffer,
                       int& offset,
                       std::optional<int> limitOffset) = 0;
+  // Number of bytes pack() will write for `value`
+  virtual int packedSize(T& value) = 0;
 };
 
 class IField {
@@ -83,6 +78,7 @@ class IField {
   virtual ~IField() = default;
 
   virtual void pack(Buffer& buffer, int& offset) = 0;
+  virtual int packedSize() = 0;
 
   virtual void unpack(const Buffer& buffer,
                       int& offset,
@@ -99,6 +95,8 @@ class Field : public IField {
     packer->pack(value, buffer, offset);
   }
 
+  int packedSize() override { return packer->packedSize(value); }
+
   void unpack(const Buffer& buffer,
               int& offset,
               std::optional<int> limitOffset) override {
@@ -114,35 +112,31 @@ template <std::integral T>
 class Primitive : public Packer<T> {
  public:
   void pack(T& value, Buffer& buffer, int& offset) override {
-    for (int i = 0; i < sizeof(T); i++) {
-      uint8_t byte = (value >> i * 8) & 0xFF;
-      if (offset < buffer.size())
-        buffer[offset] = byte;
-      else
-        buffer.push_back(byte);
-      offset++;
-    }
+    Codec<T>::pack(value, buffer, offset);
   }
 
+  int packedSize(T& value) override { return Codec<T>::packedSize(value); }
+
   void unpack(T& value,
               const Buffer& buffer,
               int& offset,
               std::optional<int> limitOffset) override {
-    int limit = getUnpackLimit(buffer.size(), limitOffset);
-    value = 0;
-    for (int i = 0; i < sizeof(T); i++) {
-      // Current behavior will assume byte=0x00 if out of range
-      if (offset >= limit)
-        break;
-      value |= buffer[offset] << i * 8;
-      offset++;
-    }
+    Codec<T>::unpack(value, buffer, offset, limitOffset);
   }
 };
 
+// Without an element packer, integral elements are copied in bulk by the codec
 template <typename T, std::unsigned_integral U = uint32_t>
 class Vector : public Packer<std::vector<T>> {
  public:
+  Vector()
+    requires std::integral<T>
+  {}
+  Vector(U& lengthRef)
+    requires std::integral<T>
+  {
+    _length.bind(lengthRef);
+  }
   Vector(std::unique_ptr<Packer<T>> packer) : packer(std::move(packer)) {}
   Vector(std::unique_ptr<Packer<T>> packer, U& lengthRef)
       : packer(std::move(packer)) {
@@ -150,19 +144,47 @@ class Vector : public Packer<std::vector<T>> {
   }
 
   void pack(std::vector<T>& values, Buffer& buffer, int& offset) override {
-    for (T& value : values)
-      packer->pack(value, buffer, offset);
+    if (!packer) {
+      if constexpr (std::integral<T>)
+        VectorCodec<T>::pack(values, buffer, offset);
+    } else {
+      for (T& value : values)
+        packer->pack(value, buffer, offset);
+    }
 
     _length.set(values.size());
   }
 
+  int packedSize(std::vector<T>& values) override {
+    if (!packer) {
+      if constexpr (std::integral<T>)
+        return VectorCodec<T>::packedSize(values);
+      return 0;
+    }
+
+    int size = 0;
+    for (T& value : values)
+      size += packer->packedSize(value);
+    return size;
+  }
+
   void unpack(std::vector<T>& values,
               const Buffer& buffer,
               int& offset,
               std::optional<int> limitOffset) override {
+    std::optional<uint32_t> count;
+    if (_length.isBound())
+      count = _length.get();
+
+    if (!packer) {
+      if constexpr (std::integral<T>)
+        VectorCodec<T>::unpack(values, buffer, offset, limitOffset, count);
+      return;
+    }
+
     int limit = getUnpackLimit(buffer.size(), limitOffset);
     values.clear();
-    for (int i = 0; offset < limit && (!_length.isBound() || i < _length.get());
+    for (int i = 0; offset < limit && (!count.has_value() || i < count);
          i++) {
       values.push_back(T());
       packer->unpack(values.back(), buffer, offset, limitOffset);
@@ -174,20 +196,49 @@ class Vector : public Packer<std::vector<T>> {
   SpecialProp<U> _length;
 };
 
+// Without an element packer, integral elements are copied in bulk by the codec
 template <typename T, size_t N>
 class Array : public Packer<std::array<T, N>> {
  public:
+  Array()
+    requires std::integral<T>
+  {}
   Array(std::unique_ptr<Packer<T>> packer) : packer(std::move(packer)) {}
 
   void pack(std::array<T, N>& values, Buffer& buffer, int& offset) override {
+    if (!packer) {
+      if constexpr (std::integral<T>)
+        Codec<std::array<T, N>>::pack(values, buffer, offset);
+      return;
+    }
+
     for (T& value : values)
       packer->pack(value, buffer, offset);
   }
 
+  int packedSize(std::array<T, N>& values) override {
+    if (!packer) {
+      if constexpr (std::integral<T>)
+        return Codec<std::array<T, N>>::packedSize(values);
+      return 0;
+    }
+
+    int size = 0;
+    for (T& value : values)
+      size += packer->packedSize(value);
+    return size;
+  }
+
   void unpack(std::array<T, N>& value,
               const Buffer& buffer,
               int& offset,
               std::optional<int> limitOffset) override {
+    if (!packer) {
+      if constexpr (std::integral<T>)
+        Codec<std::array<T, N>>::unpack(value, buffer, offset, limitOffset);
+      return;
+    }
+
     for (int i = 0; i < N; i++)
       packer->unpack(value[i], buffer, offset, limitOffset);
   }
@@ -198,14 +249,20 @@ class Array : public Packer<std::array<T, N>> {
 
 class WideString : public Packer<std::string> {
  public:
-  void pack(std::string& value, Buffer& buffer, int& offset) override;
+  void pack(std::string& value, Buffer& buffer, int& offset) override {
+    Codec<std::string>::pack(value, buffer, offset);
+  }
+
+  int packedSize(std::string& value) override {
+    return Codec<std::string>::packedSize(value);
+  }
+
   void unpack(std::string& value,
               const Buffer& buffer,
               int& offset,
-              std::optional<int> limitOffset) override;
-
- private:
-  Primitive<uint16_t> packer;
+              std::optional<int> limitOffset) override {
+    Codec<std::string>::unpack(value, buffer, offset, limitOffset);
+  }
 };
 
 class DelimitedString : public Packer<std::string> {
@@ -223,13 +280,25 @@ class DelimitedString : public Packer<std::string> {
         packTrim(packTrim),
         packEmpty(packEmpty),
         keepEnd(keepEnd),
-        seekEnd(seekEnd) {}
+        seekEnd(seekEnd) {
+    // An end string can only be completed by its last character, so unpacking
+    // skips ahead to those in bulk (unless an end string is empty)
+    std::string endChars;
+    for (std::string& e : this->end) {
+      if (e.empty())
+        scanEnd = false;
+      else
+        endChars.push_back(e.back());
+    }
+    endScanner = ByteScanner(endChars);
+  }
 
   void pack(std::string& value, Buffer& buffer, int& offset) override;
   void unpack(std::string& value,
               const Buffer& buffer,
               int& offset,
               std::optional<int> limitOffset) override;
+  int packedSize(std::string& value) override;
 
  private:
   std::vector<std::string> start;
@@ -240,6 +309,8 @@ class DelimitedString : public Packer<std::string> {
   bool keepEnd = false;
   bool seekEnd = true;
   Primitive<char> packer;
+  ByteScanner endScanner;
+  bool scanEnd = true;
 };
 
 // TODO: Get rid of this since Packet can be its own field?
@@ -250,49 +321,93 @@ class NestedPacket : public Packer<Packet> {
               const Buffer& buffer,
               int& offset,
               std::optional<int> limitOffset) override;
+  int packedSize(Packet& value) override;
 };
 
+// Raw bytes of a nested packet, bounded by the length read from its header
 template <typename T>
   requires std::derived_from<T, Packet>
-class PacketBuffer : public Packer<Buffer> {
- public:
-  PacketBuffer() : packer(std::make_unique<Primitive<uint8_t>>()) {}
-
-  void pack(Buffer& value, Buffer& buffer, int& offset) override {
-    packer.pack(value, buffer, offset);
+struct PacketBufferCodec {
+  static void pack(Buffer& value, Buffer& buffer, int& offset) {
+    Codec<Buffer>::pack(value, buffer, offset);
   }
 
-  void unpack(Buffer& value,
-              const Buffer& buffer,
-              int& offset,
-              std::optional<int> limitOffset) override {
+  static int packedSize(Buffer& value) { return value.size(); }
+
+  static void unpack(Buffer& value,
+                     const Buffer& buffer,
+                     int& offset,
+                     std::optional<int> limitOffset) {
     int startOffset = offset;
+    T lengthPacket;
     lengthPacket.unpack(buffer, offset, limitOffset);
 
     limitOffset =
         getUnpackLimit(startOffset + lengthPacket.getLength(), limitOffset);
     offset = startOffset;
-    packer.unpack(value, buffer, offset, limitOffset);
+    Codec<Buffer>::unpack(value, buffer, offset, limitOffset);
   }
+};
 
- private:
-  T lengthPacket;
-  Vector<uint8_t> packer;
+template <typename T>
+  requires std::derived_from<T, Packet>
+class PacketBuffer : public Packer<Buffer> {
+ public:
+  void pack(Buffer& value, Buffer& buffer, int& offset) override {
+    PacketBufferCodec<T>::pack(value, buffer, offset);
+  }
+
+  int packedSize(Buffer& value) override {
+    return PacketBufferCodec<T>::packedSize(value);
+  }
+
+  void unpack(Buffer& value,
+              const Buffer& buffer,
+              int& offset,
+              std::optional<int> limitOffset) override {
+    PacketBufferCodec<T>::unpack(value, buffer, offset, limitOffset);
+  }
 };
 
 // TODO: The overloading on field is kind of fun but hurts readability
 class Packet : public IField {
  public:
+  Packet() = default;
   virtual ~Packet() = default;
 
+  // Runtime fields refer to members of the packet that registered them, so a
+  // copy would either lose them or point into the original. Schema packets
+  // are copyable (see SchemaPacket).
+  Packet(const Packet&) = delete;
+  Packet& operator=(const Packet&) = delete;
+
   virtual void pack(Buffer& buffer, int& offset) override;
   virtual void unpack(const Buffer& buffer,
                       int& offset,
                       std::optional<int> limitOffset = std::nullopt) override;
 
+  // Sum of the packed sizes of all fields, so pack() can allocate once
+  virtual int packedSize() override;
+
   Buffer pack();
   void unpack(const Buffer& buffer);
 
+  // Packs onto the end of `segments`. By default this packs contiguously, but
+  // packets may reference large payloads instead of copying them.
+  virtual void packSegments(SegmentBuffer& segments);
+
+  // Resumable unpacking for packets whose bytes arrive in pieces. Each call is
+  // given everything received so far (the same buffer, appended to between
+  // calls) and carries on from where the previous call stopped. Returns the
+  // minimum number of further bytes needed, or 0 once the packet has been
+  // fully unpacked. Packets without framing are complete as given.
+  virtual int unpackSome(const Buffer& buffer) {
+    unpack(buffer);
+    return 0;
+  }
+  // Discards any progress made by unpackSome() so a new packet can be fed
+  virtual void resetUnpack() {}
+
   std::string packString() {
     Buffer buffer = Packet::pack();
     return std::string(buffer.begin(), buffer.end());
@@ -303,31 +418,15 @@ class Packet : public IField {
     unpack(buffer);
   }
 
-  template <typename T>
-    requires(std::derived_from<T, Packet>)
-  std::unique_ptr<T> is() {
-    std::unique_ptr<T> testPacket = std::make_unique<T>();
-    if (_type.get() == testPacket->_type.get())
-      return testPacket;
-    return nullptr;
-  }
-
-  template <typename T, typename U>
-    requires(std::derived_from<T, Packet> && std::derived_from<U, Packet>)
-  static std::unique_ptr<U> unpackAs(const Buffer& buffer) {
-    T testPacket;
-    testPacket.unpack(buffer);
-    if (std::unique_ptr<U> packet = testPacket.template is<U>()) {
-      packet->unpack(buffer);
-      return packet;
-    }
-    return nullptr;
-  }
-
-  uint32_t getLength() { return _length.get(); }
-  uint32_t getType() { return _type.get(); }
+  virtual uint32_t getLength() { return _length.get(); }
+  virtual uint32_t getType() { return _type.get(); }
 
  protected:
+  // Constructs the base of a copied schema packet, which carries no runtime
+  // fields over
+  struct SchemaCopy {};
+  explicit Packet(SchemaCopy) {}
+
   std::vector<std::unique_ptr<IField>> fields;
 
 #define COMMA() ,
@@ -344,22 +443,19 @@ class Packet : public IField {
   // Non-greedy vector (length determined by lengthRef)
   template <std::integral T, std::unsigned_integral U>
   void field(std::vector<T>& values, U& lengthRef) {
-    ADD_FIELD(std::vector<T>, Vector<T COMMA() U>,
-              std::make_unique<Primitive<T>>() COMMA() lengthRef, values);
+    ADD_FIELD(std::vector<T>, Vector<T COMMA() U>, lengthRef, values);
   }
 
   // Greedy vector (consumes until end of packet when unpacking)
   template <std::integral T>
   void field(std::vector<T>& values) {
-    ADD_FIELD(std::vector<T>, Vector<T>, std::make_unique<Primitive<T>>(),
-              values);
+    ADD_FIELD(std::vector<T>, Vector<T>, , values);
   }
 
   // Fixed-length array
   template <std::integral T, size_t N>
   void field(std::array<T, N>& values) {
-    ADD_FIELD(std::array<T COMMA() N>, Array<T COMMA() N>,
-              std::make_unique<Primitive<T>>(), values);
+    ADD_FIELD(std::array<T COMMA() N>, Array<T COMMA() N>, , values);
   }
 
   // Wide string (encoded as 16 bits/char as in PTP)
@@ -407,6 +503,7 @@ class Packet : public IField {
   void lengthField(T& value) {
     field(value);
     _length.bind(value);
+    lengthFieldIndex = fields.size() - 1;
   }
 
   // Special type field which is used when conditionally unpacking
@@ -422,6 +519,7 @@ class Packet : public IField {
  private:
   SpecialProp<uint32_t> _length;
   SpecialProp<uint32_t> _type;
+  int lengthFieldIndex = -1;
 };
 
 }  // namespace cb
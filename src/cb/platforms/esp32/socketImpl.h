@@ -13,9 +13,21 @@ class TCPSocketImpl : public TCPSocket, BufferedSocket {
  public:
   ~TCPSocketImpl() { client.stop(); }
 
+  // WiFiClient only creates its socket when connecting, so options are applied
+  // afterwards
   bool connect(const std::string& ip, int port) override {
-    // TODO: Set socket options
-    return client.connect(ip.c_str(), port);
+    if (!client.connect(ip.c_str(), port, options.connectTimeoutMs))
+      return false;
+    if (!applyOptions()) {
+      client.stop();
+      return false;
+    }
+    return true;
+  }
+
+  bool setOptions(const TCPSocketOptions& options) override {
+    this->options = options;
+    return !client.connected() || applyOptions();
   }
 
   bool close() override {
@@ -49,8 +61,36 @@ class TCPSocketImpl : public TCPSocket, BufferedSocket {
 
  private:
   WiFiClient client;
+  TCPSocketOptions options;
+
+  // lwIP has no low-water mark, busy-poll or quick-ack
+  bool applyOptions() {
+    bool success = setOption(SOL_SOCKET, SO_SNDBUF, options.sendBufferSize);
+    success &= setOption(SOL_SOCKET, SO_RCVBUF, options.receiveBufferSize);
+    success &= setOption(IPPROTO_TCP, TCP_NODELAY, options.noDelay);
+    success &= setOption(SOL_SOCKET, SO_KEEPALIVE, options.keepAlive);
+    success &= setOption(IPPROTO_TCP, TCP_KEEPIDLE, options.keepAliveIdleS);
+    success &=
+        setOption(IPPROTO_TCP, TCP_KEEPINTVL, options.keepAliveIntervalS);
+    success &= setOption(IPPROTO_TCP, TCP_KEEPCNT, options.keepAliveCount);
+    success &= !options.receiveLowWater && !options.busyPollUs &&
+               !options.quickAck;
+    return success;
+  }
+
+  // Sets an integer option, if there is a value to set
+  bool setOption(int level, int name, std::optional<int> value) {
+    if (!value)
+      return true;
+    int optVal = *value;
+    return client.setSocketOption(level, name, &optVal, sizeof(optVal)) == 0;
+  }
 };
 
+inline std::unique_ptr<TCPSocket> createTCPSocket() {
+  return std::make_unique<TCPSocketImpl>();
+}
+
 }  // namespace cb
 
 #endif
\ No newline at end of file
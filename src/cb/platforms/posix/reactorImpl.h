@@ -0,0 +1,189 @@
+#ifndef CB_CONTROL_POSIX_REACTOR_H
+#define CB_CONTROL_POSIX_REACTOR_H
+
+#include <cb/exception.h>
+#include <cb/logger.h>
+#include <cb/reactor.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#if !defined(CB_CONTROL_NO_IO_URING)
+#include "uringReactorImpl.h"
+#define CB_CONTROL_URING_REACTOR_IMPL
+#endif
+#else
+#include <poll.h>
+#endif
+
+#include <array>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+namespace cb {
+
+#if defined(__linux__)
+
+// Waits with epoll, so a pass costs the same however many sockets are watched.
+// wake() signals an eventfd that is watched alongside the sockets.
+class ReactorImpl : public Reactor {
+ public:
+  ReactorImpl() {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd < 0 || wakeFd < 0 || !addHandle(wakeFd, false)) {
+      closeFds();
+      throw Exception(ExceptionContext::Socket, ExceptionType::InitFailure);
+    }
+  }
+
+  ~ReactorImpl() { closeFds(); }
+
+ protected:
+  bool addHandle(SocketHandle handle, bool writable) override {
+    epoll_event event = {};
+    event.events = writable ? EPOLLOUT : EPOLLIN;
+    event.data.fd = handle;
+    return epoll_ctl(epollFd, EPOLL_CTL_ADD, handle, &event) == 0;
+  }
+
+  void removeHandle(SocketHandle handle) override {
+    // Fails harmlessly if the socket was already closed
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, handle, nullptr);
+  }
+
+  void waitReady(int timeoutMs) override {
+    int count;
+    do {
+      count = epoll_wait(epollFd, events.data(), events.size(), timeoutMs);
+    } while (count < 0 && errno == EINTR);
+
+    for (int i = 0; i < count; i++) {
+      if (events[i].data.fd == wakeFd) {
+        uint64_t value;
+        while (::read(wakeFd, &value, sizeof(value)) > 0) {
+        }
+      } else {
+        handleReady(events[i].data.fd);
+      }
+    }
+  }
+
+  void wake() override {
+    uint64_t value = 1;
+    while (::write(wakeFd, &value, sizeof(value)) < 0 && errno == EINTR) {
+    }
+  }
+
+ private:
+  int epollFd = -1;
+  int wakeFd = -1;
+  // Any further ready sockets are reported by the next pass
+  std::array<epoll_event, 64> events;
+
+  void closeFds() {
+    if (epollFd >= 0)
+      ::close(epollFd);
+    if (wakeFd >= 0)
+      ::close(wakeFd);
+  }
+};
+
+#else
+
+// Waits with poll() on a copy of the watched handles, plus a self-pipe which
+// wake() writes to
+class ReactorImpl : public Reactor {
+ public:
+  ReactorImpl() {
+    if (pipe(wakePipe) != 0)
+      throw Exception(ExceptionContext::Socket, ExceptionType::InitFailure);
+    for (int fd : wakePipe) {
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+  }
+
+  ~ReactorImpl() {
+    ::close(wakePipe[0]);
+    ::close(wakePipe[1]);
+  }
+
+ protected:
+  bool addHandle(SocketHandle handle, bool writable) override {
+    std::lock_guard lock(handlesMutex);
+    handles.push_back({(int)handle, writable ? POLLOUT : POLLIN, 0});
+    return true;
+  }
+
+  void removeHandle(SocketHandle handle) override {
+    std::lock_guard lock(handlesMutex);
+    std::erase_if(handles, [&](const pollfd& pfd) { return pfd.fd == handle; });
+  }
+
+  void waitReady(int timeoutMs) override {
+    {
+      std::lock_guard lock(handlesMutex);
+      pollFds.clear();
+      pollFds.push_back({wakePipe[0], POLLIN, 0});
+      pollFds.insert(pollFds.end(), handles.begin(), handles.end());
+    }
+
+    int count;
+    do {
+      count = ::poll(pollFds.data(), pollFds.size(), timeoutMs);
+    } while (count < 0 && errno == EINTR);
+    if (count <= 0)
+      return;
+
+    if (pollFds[0].revents & POLLIN) {
+      char drain[64];
+      while (::read(wakePipe[0], drain, sizeof(drain)) > 0) {
+      }
+    }
+    for (size_t i = 1; i < pollFds.size(); i++) {
+      if (pollFds[i].revents & (pollFds[i].events | POLLHUP | POLLERR))
+        handleReady(pollFds[i].fd);
+    }
+  }
+
+  void wake() override {
+    char value = 1;
+    while (::write(wakePipe[1], &value, 1) < 0 && errno == EINTR) {
+    }
+  }
+
+ private:
+  int wakePipe[2] = {-1, -1};
+  std::mutex handlesMutex;
+  std::vector<pollfd> handles;
+  // Kept between passes to avoid allocating for every wait
+  std::vector<pollfd> pollFds;
+};
+
+#endif
+
+// The io_uring reactor if it is built in and selected with
+// CB_REACTOR_BACKEND=io_uring, and the kernel supports it. ReactorImpl
+// otherwise.
+inline std::shared_ptr<Reactor> createReactor() {
+#if defined(CB_CONTROL_URING_REACTOR_IMPL)
+  const char* backend = std::getenv("CB_REACTOR_BACKEND");
+  if (backend && strcmp(backend, "io_uring") == 0) {
+    try {
+      return std::make_shared<UringReactorImpl>();
+    } catch (const Exception&) {
+      Logger::log("io_uring is unavailable, using epoll instead");
+    }
+  }
+#endif
+  return std::make_shared<ReactorImpl>();
+}
+
+}  // namespace cb
+
+#endif
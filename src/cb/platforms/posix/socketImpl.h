@@ -0,0 +1,498 @@
+#ifndef CB_CONTROL_POSIX_SOCKET_H
+#define CB_CONTROL_POSIX_SOCKET_H
+
+#include <cb/protocols/tcp.h>
+#include <cb/protocols/udp.h>
+#include <cb/scheduler.h>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+
+namespace cb {
+
+// Sockets are non-blocking, so every wait for readiness goes through poll()
+// with the caller's timeout rather than blocking in the kernel indefinitely
+class PosixSocket : public virtual BufferedSocket {
+ public:
+  // Longest a send waits for room in the socket's send buffer
+  static const int SEND_TIMEOUT_MS = 10000;
+
+  // Writes to a peer that has gone away must fail instead of raising SIGPIPE
+#if defined(MSG_NOSIGNAL)
+  static const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+  static const int SEND_FLAGS = 0;
+#endif
+
+  ~PosixSocket() {
+    if (clientSocket >= 0)
+      ::close(clientSocket);
+  }
+
+  SocketHandle getHandle() const override {
+    return clientSocket < 0 ? NO_SOCKET_HANDLE : clientSocket;
+  }
+
+ protected:
+  bool wait(unsigned int timeoutMs) override {
+    return poll(POLLIN, timeoutMs);
+  }
+
+  // Waits for any of `events` on the socket, returning false on failure or
+  // timeout
+  bool poll(short events, unsigned int timeoutMs) {
+    if (clientSocket < 0)
+      return false;
+
+    pollfd pfd = {clientSocket, events, 0};
+    int timeout = timeoutMs > INT_MAX ? INT_MAX : timeoutMs;
+
+    // TODO: More granular error handling
+    int status;
+    do {
+      status = ::poll(&pfd, 1, timeout);
+    } while (status < 0 && errno == EINTR);
+
+    return status > 0 && (pfd.revents & (events | POLLHUP | POLLERR));
+  }
+
+  // Runs a non-blocking socket call, waiting for the socket to be ready for
+  // `events` and retrying whenever it would block
+  template <typename F>
+  int retry(short events, unsigned int timeoutMs, F&& call) {
+    while (true) {
+      ssize_t result = call();
+      if (result >= 0)
+        return result;
+      if (errno == EINTR)
+        continue;
+      if ((errno != EAGAIN && errno != EWOULDBLOCK) ||
+          !poll(events, timeoutMs))
+        return BUFFERED_SOCKET_ERROR;
+    }
+  }
+
+  bool setNonBlocking() {
+    int flags = fcntl(clientSocket, F_GETFL, 0);
+    return flags >= 0 &&
+           fcntl(clientSocket, F_SETFL, flags | O_NONBLOCK) == 0;
+  }
+
+  // Applies the options common to all sockets, returning false if any of them
+  // couldn't be applied
+  bool applySocketOptions(const SocketOptions& options) {
+    bool success = setOption(SOL_SOCKET, SO_SNDBUF, options.sendBufferSize);
+    success &= setOption(SOL_SOCKET, SO_RCVBUF, options.receiveBufferSize);
+    success &= setOption(SOL_SOCKET, SO_RCVLOWAT, options.receiveLowWater);
+#if defined(SO_BUSY_POLL)
+    success &= setOption(SOL_SOCKET, SO_BUSY_POLL, options.busyPollUs);
+#else
+    success &= !options.busyPollUs;
+#endif
+    return success;
+  }
+
+  // Sets an integer option, if there is a value to set
+  bool setOption(int level, int name, std::optional<int> value) {
+    if (!value)
+      return true;
+    int optVal = *value;
+    return setsockopt(clientSocket, level, name, &optVal, sizeof(optVal)) == 0;
+  }
+
+  bool closeSocket() {
+    discardReadAhead();
+    if (clientSocket < 0)
+      return false;
+    bool failure = ::close(clientSocket) != 0;
+    clientSocket = -1;
+    return failure;
+  }
+
+  int clientSocket = -1;
+};
+
+// TODO: Figure out error logging
+class TCPSocketImpl : public TCPSocket, PosixSocket {
+ public:
+  // Reads go straight into the destination buffer, so large ones cost nothing
+  // extra and keep bulk transfers to few syscalls. Smaller reads are served
+  // from a read-ahead buffer of the same size.
+  TCPSocketImpl() : BufferedSocket(64 * 1024, true) {}
+
+  bool connect(const std::string& ip, int port) override {
+    return startConnect(ip, port) &&
+           finishConnect(poll(POLLOUT, options.connectTimeoutMs));
+  }
+
+  Task<bool> connectAsync(Scheduler& scheduler,
+                          const std::string& ip,
+                          int port) override {
+    if (!startConnect(ip, port))
+      co_return false;
+    bool isWritable =
+        co_await scheduler.writable(*this, options.connectTimeoutMs);
+    co_return finishConnect(isWritable);
+  }
+
+  bool close() override {
+    // Reads still pending in an io_uring hold on to the socket until they
+    // finish, which this makes them do now
+    if (clientSocket >= 0)
+      ::shutdown(clientSocket, SHUT_RDWR);
+    return closeSocket();
+  }
+
+  bool isConnected() override { return clientSocket >= 0; }
+
+  bool setOptions(const TCPSocketOptions& options) override {
+    this->options = options;
+    return clientSocket < 0 || applyOptions();
+  }
+
+ protected:
+  TCPSocketOptions options;
+
+  int send(const char* buff, int length) override {
+    return retry(POLLOUT, SEND_TIMEOUT_MS, [&] {
+      return ::send(clientSocket, buff, length, SEND_FLAGS);
+    });
+  }
+
+  int sendSome(std::span<const BufferView> segments) override {
+    iovecs.clear();
+    for (const BufferView& segment : segments) {
+      if (iovecs.size() == IOV_MAX)
+        break;
+      iovecs.push_back({(void*)segment.data(), segment.size()});
+    }
+
+    msghdr message = {};
+    message.msg_iov = iovecs.data();
+    message.msg_iovlen = iovecs.size();
+    return retry(POLLOUT, SEND_TIMEOUT_MS, [&] {
+      return sendmsg(clientSocket, &message, SEND_FLAGS);
+    });
+  }
+
+  // Quick ACKs are re-armed after every read, which reads done elsewhere
+  // would skip
+  bool canTransfer() const override {
+    return BufferedSocket::canTransfer() && !options.quickAck;
+  }
+
+  int recv(char* buff, int length) override {
+    // wait() has already seen the socket readable
+    int result = retry(POLLIN, 0, [&] {
+      return ::recv(clientSocket, buff, length, 0);
+    });
+    rearmQuickAck();
+    return result;
+  }
+
+  // Starts a non-blocking connect, returning false if it failed right away
+  bool startConnect(const std::string& ip, int port) {
+    close();  // TODO: is this needed?
+
+    clientSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (clientSocket < 0)
+      return false;
+
+    // Before connecting, so the buffer sizes count towards the window scale
+    if (!setNonBlocking() || !applyOptions()) {
+      close();
+      return false;
+    }
+
+#if defined(SO_NOSIGPIPE)
+    setOption(SOL_SOCKET, SO_NOSIGPIPE, 1);
+#endif
+
+    sockaddr_in serverAddress = {};
+    serverAddress.sin_family = AF_INET;
+    serverAddress.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip.c_str(), &serverAddress.sin_addr) != 1) {
+      close();
+      return false;
+    }
+
+    // An interrupted connect carries on in the background like a pending one
+    if (::connect(clientSocket, (sockaddr*)&serverAddress,
+                  sizeof(serverAddress)) != 0 &&
+        errno != EINPROGRESS && errno != EINTR) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  // Checks the outcome of a connect once the socket is writable, closing it if
+  // the connect failed or `isWritable` is false because the deadline passed
+  bool finishConnect(bool isWritable) {
+    int error = 0;
+    socklen_t errorSize = sizeof(error);
+    if (!isWritable ||
+        getsockopt(clientSocket, SOL_SOCKET, SO_ERROR, &error, &errorSize) !=
+            0 ||
+        error != 0) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  void rearmQuickAck() {
+#if defined(TCP_QUICKACK)
+    if (options.quickAck)
+      setOption(IPPROTO_TCP, TCP_QUICKACK, 1);
+#endif
+  }
+
+ private:
+  // Kept between sends to avoid allocating for every vectored write
+  std::vector<iovec> iovecs;
+
+  bool applyOptions() {
+    bool success = applySocketOptions(options);
+    success &= setOption(IPPROTO_TCP, TCP_NODELAY, options.noDelay);
+    success &= setOption(SOL_SOCKET, SO_KEEPALIVE, options.keepAlive);
+#if defined(TCP_KEEPIDLE)
+    success &= setOption(IPPROTO_TCP, TCP_KEEPIDLE, options.keepAliveIdleS);
+#elif defined(TCP_KEEPALIVE)
+    success &= setOption(IPPROTO_TCP, TCP_KEEPALIVE, options.keepAliveIdleS);
+#else
+    success &= !options.keepAliveIdleS;
+#endif
+#if defined(TCP_KEEPINTVL) && defined(TCP_KEEPCNT)
+    success &=
+        setOption(IPPROTO_TCP, TCP_KEEPINTVL, options.keepAliveIntervalS);
+    success &= setOption(IPPROTO_TCP, TCP_KEEPCNT, options.keepAliveCount);
+#else
+    success &= !options.keepAliveIntervalS && !options.keepAliveCount;
+#endif
+#if defined(TCP_QUICKACK)
+    success &= setOption(IPPROTO_TCP, TCP_QUICKACK, options.quickAck);
+#else
+    success &= !options.quickAck;
+#endif
+    return success;
+  }
+};
+
+// A multi-homed control point uses one socket per interface (see
+// getInterfaceAddresses())
+class UDPMulticastSocketImpl : public UDPMulticastSocket, PosixSocket {
+ public:
+  // Largest datagram received in a batch; anything past it is truncated
+  static const int MAX_DATAGRAM_SIZE = 1460;
+
+  UDPMulticastSocketImpl() : BufferedSocket(MAX_DATAGRAM_SIZE) {}
+
+  bool begin(const std::string& ip,
+             int port,
+             const std::string& interfaceIp = "") override {
+    remoteIp = ip;
+    remotePort = port;
+
+    in_addr interfaceAddress = {htonl(INADDR_ANY)};
+    if (!interfaceIp.empty() &&
+        inet_pton(AF_INET, interfaceIp.c_str(), &interfaceAddress) != 1)
+      return false;
+
+    close();  // TODO: is this needed?
+
+    clientSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (clientSocket < 0)
+      return false;
+
+    // Other SSDP control points on the host are likely bound to the same port
+    int optVal = 1;
+    if (setsockopt(clientSocket, SOL_SOCKET, SO_REUSEADDR, &optVal,
+                   sizeof(optVal)) != 0) {
+      close();
+      return false;
+    }
+
+    sockaddr_in serverAddress = {};
+    serverAddress.sin_family = AF_INET;
+    serverAddress.sin_addr.s_addr = htonl(INADDR_ANY);
+    serverAddress.sin_port = htons(remotePort);
+
+    if (!applySocketOptions(options) ||
+        bind(clientSocket, (sockaddr*)&serverAddress, sizeof(serverAddress)) !=
+            0) {
+      close();
+      return false;
+    }
+
+    ip_mreq imr = {};
+    imr.imr_interface = interfaceAddress;
+    if (inet_pton(AF_INET, remoteIp.c_str(), &imr.imr_multiaddr) != 1 ||
+        setsockopt(clientSocket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &imr,
+                   sizeof(imr)) != 0 ||
+        !setNonBlocking()) {
+      close();
+      return false;
+    }
+
+    if (!interfaceIp.empty()) {
+      // All sockets are bound to the same port, so each would otherwise also
+      // receive the group on the interfaces the others joined
+#if defined(IP_MULTICAST_ALL)
+      setOption(IPPROTO_IP, IP_MULTICAST_ALL, 0);
+#endif
+      if (setsockopt(clientSocket, IPPROTO_IP, IP_MULTICAST_IF,
+                     &interfaceAddress, sizeof(interfaceAddress)) != 0) {
+        close();
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  // Membership is dropped by the kernel when the socket is closed
+  bool close() override { return closeSocket(); }
+
+  bool setOptions(const SocketOptions& options) override {
+    this->options = options;
+    return clientSocket < 0 || applySocketOptions(options);
+  }
+
+  std::string getRemoteIp() const override { return remoteIp; }
+
+  int getRemotePort() const override { return remotePort; }
+
+#if defined(__linux__)
+  // Drains up to a batch of datagrams with a single recvmmsg() call
+  int recvBatch(std::span<Datagram> datagrams) override {
+    if (clientSocket < 0 || datagrams.empty())
+      return 0;
+
+    messages.resize(datagrams.size());
+    iovecs.resize(datagrams.size());
+    addresses.resize(datagrams.size());
+    for (size_t i = 0; i < datagrams.size(); i++) {
+      datagrams[i].data.resize(MAX_DATAGRAM_SIZE);
+      iovecs[i] = {datagrams[i].data.data(), datagrams[i].data.size()};
+      messages[i] = {};
+      messages[i].msg_hdr.msg_iov = &iovecs[i];
+      messages[i].msg_hdr.msg_iovlen = 1;
+      messages[i].msg_hdr.msg_name = &addresses[i];
+      messages[i].msg_hdr.msg_namelen = sizeof(addresses[i]);
+    }
+
+    int count;
+    do {
+      count = recvmmsg(clientSocket, messages.data(), messages.size(),
+                       MSG_DONTWAIT, nullptr);
+    } while (count < 0 && errno == EINTR);
+    if (count <= 0)
+      return 0;
+    // Counted as a read per datagram, so the read sizes stay meaningful
+    for (int i = 0; i < count; i++)
+      countRecv(messages[i].msg_len);
+
+    char ipString[INET_ADDRSTRLEN];
+    for (int i = 0; i < count; i++) {
+      datagrams[i].data.resize(messages[i].msg_len);
+      inet_ntop(AF_INET, &addresses[i].sin_addr, ipString, sizeof(ipString));
+      datagrams[i].remoteIp = ipString;
+      datagrams[i].remotePort = ntohs(addresses[i].sin_port);
+    }
+    // As after recv(), the remote is whoever sent last
+    remoteIp = datagrams[count - 1].remoteIp;
+    remotePort = datagrams[count - 1].remotePort;
+    return count;
+  }
+#endif
+
+ protected:
+  int send(const char* buff, int length) override {
+    if (remoteIp.empty() || remotePort == 0)
+      return BUFFERED_SOCKET_ERROR;
+
+    sockaddr_in recvAddress = {};
+    recvAddress.sin_family = AF_INET;
+    recvAddress.sin_port = htons(remotePort);
+    if (inet_pton(AF_INET, remoteIp.c_str(), &recvAddress.sin_addr) != 1)
+      return BUFFERED_SOCKET_ERROR;
+
+    return retry(POLLOUT, SEND_TIMEOUT_MS, [&] {
+      return sendto(clientSocket, buff, length, SEND_FLAGS,
+                    (sockaddr*)&recvAddress, sizeof(recvAddress));
+    });
+  }
+
+  int recv(char* buff, int length) override {
+    sockaddr_in sendAddress = {};
+    socklen_t sendAddressSize = sizeof(sendAddress);
+
+    int result = retry(POLLIN, 0, [&] {
+      return recvfrom(clientSocket, buff, length, 0, (sockaddr*)&sendAddress,
+                      &sendAddressSize);
+    });
+    if (result == BUFFERED_SOCKET_ERROR)
+      return BUFFERED_SOCKET_ERROR;
+
+    char ipString[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &sendAddress.sin_addr, ipString, sizeof(ipString));
+    remoteIp = ipString;
+    remotePort = ntohs(sendAddress.sin_port);
+    return result;
+  }
+
+ private:
+  std::string remoteIp;
+  int remotePort = 0;
+  SocketOptions options;
+
+#if defined(__linux__)
+  // Kept between batches to avoid allocating for every receive
+  std::vector<mmsghdr> messages;
+  std::vector<iovec> iovecs;
+  std::vector<sockaddr_in> addresses;
+#endif
+};
+
+// Addresses of the IPv4 interfaces that are up and can multicast, other than
+// loopback
+inline std::vector<std::string> getInterfaceAddresses() {
+  std::vector<std::string> addresses;
+  ifaddrs* interfaces;
+  if (getifaddrs(&interfaces) != 0)
+    return addresses;
+
+  char ipString[INET_ADDRSTRLEN];
+  for (ifaddrs* it = interfaces; it; it = it->ifa_next) {
+    if (!it->ifa_addr || it->ifa_addr->sa_family != AF_INET ||
+        !(it->ifa_flags & IFF_UP) || !(it->ifa_flags & IFF_MULTICAST) ||
+        (it->ifa_flags & IFF_LOOPBACK))
+      continue;
+    inet_ntop(AF_INET, &((sockaddr_in*)it->ifa_addr)->sin_addr, ipString,
+              sizeof(ipString));
+    addresses.push_back(ipString);
+  }
+
+  freeifaddrs(interfaces);
+  return addresses;
+}
+
+inline std::unique_ptr<TCPSocket> createTCPSocket() {
+  return std::make_unique<TCPSocketImpl>();
+}
+
+}  // namespace cb
+
+#endif
\ No newline at end of file
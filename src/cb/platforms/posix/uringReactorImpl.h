@@ -0,0 +1,568 @@
+#ifndef CB_CONTROL_POSIX_URING_REACTOR_H
+#define CB_CONTROL_POSIX_URING_REACTOR_H
+
+#include <cb/exception.h>
+#include <cb/reactor.h>
+
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace cb {
+
+// Reactor on an io_uring (Linux 5.19 or later), driven through raw syscalls so
+// nothing beyond the kernel headers is needed. Besides reporting readiness, it
+// does socket reads and writes itself (see Reactor::submitRecv()), each bounded
+// by a linked timeout, so a wait and the transfer after it are one request.
+//
+// Requests from any thread queue up in the ring's shared memory and go to the
+// kernel together the next time the loop waits, and that same syscall reaps
+// every completion that has arrived, so a pass costs one syscall however many
+// cameras are busy. Reads land in buffers provided to the kernel up front,
+// which it only takes once data arrives, so idle sockets hold no memory and
+// each buffer is handed back as soon as its bytes have been taken. Readiness
+// watches are one-shot polls, re-armed every pass while watched.
+class UringReactorImpl : public Reactor {
+ public:
+  // Throws if the kernel lacks anything used here, so the caller can fall back
+  // to ReactorImpl
+  UringReactorImpl() {
+    try {
+      setUpRing();
+      setUpBuffers();
+      // Blocking, so the ring's read of it waits for wake() rather than
+      // failing right away
+      wakeFd = eventfd(0, EFD_CLOEXEC);
+      if (wakeFd < 0)
+        throw Exception(ExceptionContext::Socket, ExceptionType::InitFailure);
+      queueWakeRead();
+    } catch (...) {
+      release();
+      throw;
+    }
+  }
+
+  ~UringReactorImpl() { release(); }
+
+  bool canTransfer() const override { return true; }
+
+  bool submitRecv(SocketHandle handle,
+                  int length,
+                  unsigned int timeoutMs,
+                  TransferCallback onDone) override {
+    return submitTransfer(handle, BufferView(), length, timeoutMs,
+                          std::move(onDone));
+  }
+
+  bool submitSend(SocketHandle handle,
+                  BufferView data,
+                  unsigned int timeoutMs,
+                  TransferCallback onDone) override {
+    return submitTransfer(handle, data, data.size(), timeoutMs,
+                          std::move(onDone));
+  }
+
+  void cancelTransfers(SocketHandle handle) override {
+    std::unique_lock lock(ringMutex);
+    io_uring_sqe* sqe = reserve(1);
+    if (!sqe)
+      return;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = handle;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    publish();
+    kick(lock);
+  }
+
+ protected:
+  bool addHandle(SocketHandle handle, bool writable) override {
+    std::lock_guard lock(ringMutex);
+    if (watches.count(handle))
+      return false;
+    Watch& watch = watches[handle];
+    watch.generation = nextGeneration++ & GENERATION_MASK;
+    watch.writable = writable;
+    watch.isArmed = false;
+    // The reactor wakes the loop to submit it
+    if (!arm(handle, watch)) {
+      watches.erase(handle);
+      return false;
+    }
+    return true;
+  }
+
+  void removeHandle(SocketHandle handle) override {
+    std::unique_lock lock(ringMutex);
+    auto it = watches.find(handle);
+    if (it == watches.end())
+      return;
+    uint64_t pollData = pollUserData(handle, it->second.generation);
+    bool isArmed = it->second.isArmed;
+    watches.erase(it);
+    if (!isArmed)
+      return;
+    // The poll holds on to the socket until it is removed
+    io_uring_sqe* sqe = reserve(1);
+    if (!sqe)
+      return;
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->addr = pollData;
+    publish();
+    kick(lock);
+  }
+
+  void waitReady(int timeoutMs) override {
+    bool isSleeping;
+    unsigned int queued;
+    {
+      std::lock_guard lock(ringMutex);
+      for (SocketHandle handle : unarmed) {
+        auto it = watches.find(handle);
+        if (it != watches.end() && !it->second.isArmed)
+          arm(handle, it->second);
+      }
+      unarmed.clear();
+
+      isSleeping = timeoutMs != 0 && !isWakeRequested;
+      isWakeRequested = false;
+      isWaiting = isSleeping;
+      isWoken = false;
+      queued = sqQueued -
+               std::atomic_ref(*sqHead).load(std::memory_order_acquire);
+    }
+    if (!isSleeping && queued == 0) {
+      reap();
+      return;
+    }
+
+    // Submits whatever has been queued and waits in one syscall. The count
+    // must be exact, as the kernel skips the wait if it submits fewer.
+    __kernel_timespec timeout = {timeoutMs / 1000,
+                                 (timeoutMs % 1000) * 1000000LL};
+    io_uring_getevents_arg arg = {};
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = timeoutMs >= 0 ? (uint64_t)&timeout : 0;
+    enter(queued, isSleeping ? 1 : 0,
+          isSleeping ? IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG : 0,
+          isSleeping ? &arg : nullptr, sizeof(arg));
+
+    {
+      std::lock_guard lock(ringMutex);
+      isWaiting = false;
+    }
+    reap();
+  }
+
+  void wake() override {
+    std::unique_lock lock(ringMutex);
+    // Keeps the loop from sleeping in its next wait, if it isn't in one yet
+    if (!isWaiting)
+      isWakeRequested = true;
+    kick(lock);
+  }
+
+ private:
+  static const unsigned int RING_ENTRIES = 512;
+  // Provided to the kernel for reads. A buffer is only out of the ring
+  // between a read's completion and the end of its callback, so the count
+  // bounds the completions handled per pass rather than the sockets open.
+  static const unsigned int BUFFER_COUNT = 64;
+  static const unsigned int BUFFER_SIZE = 64 * 1024;
+  static const uint16_t BUFFER_GROUP = 0;
+
+  // The top byte of a request's user data says what it is for. Linked
+  // timeouts, poll removals and cancellations complete with 0, and are
+  // ignored.
+  static const uint64_t KIND_MASK = 0xffULL << 56;
+  static const uint64_t POLL = 1ULL << 56;
+  static const uint64_t TRANSFER = 2ULL << 56;
+  static const uint64_t WAKE = 3ULL << 56;
+  // Polls carry the handle and the generation of its watch, so completions
+  // of a poll from an earlier watch of the same handle are ignored
+  static const uint32_t GENERATION_MASK = 0xffffff;
+
+  typedef std::chrono::steady_clock Clock;
+
+  struct Watch {
+    uint32_t generation = 0;
+    bool writable = false;
+    bool isArmed = false;
+  };
+
+  struct Transfer {
+    SocketHandle handle;
+    // Empty for a read
+    BufferView sending;
+    // Bytes the reader expects at least
+    int length;
+    // Clock::time_point::max() for none
+    Clock::time_point deadline;
+    // Only read by the kernel when the request is submitted, so it is kept
+    // until then
+    __kernel_timespec timeout;
+    TransferCallback onDone;
+  };
+
+  int ringFd = -1;
+  void* ringMemory = MAP_FAILED;
+  size_t ringSize = 0;
+  io_uring_sqe* sqes = (io_uring_sqe*)MAP_FAILED;
+  size_t sqesSize = 0;
+  unsigned* sqHead = nullptr;
+  unsigned* sqTail = nullptr;
+  unsigned sqMask = 0;
+  unsigned sqEntries = 0;
+  unsigned* cqHead = nullptr;
+  unsigned* cqTail = nullptr;
+  unsigned cqMask = 0;
+  io_uring_cqe* cqes = nullptr;
+  // Tail of the requests queued so far, published to the kernel by publish()
+  unsigned sqQueued = 0;
+
+  // Entries of the ring the buffers are provided through. Its tail shares
+  // the first entry's `resv` (io_uring_buf_ring lays it out that way, but
+  // its flexible array doesn't come out right in C++).
+  io_uring_buf* bufferRing = (io_uring_buf*)MAP_FAILED;
+  uint8_t* buffers = (uint8_t*)MAP_FAILED;
+  // Only touched on the loop thread, which is where buffers are handed back
+  uint16_t bufferTail = 0;
+
+  int wakeFd = -1;
+  uint64_t wakeValue = 0;
+
+  // Guards the submission queue and everything below
+  std::mutex ringMutex;
+  // Whether the loop is in, or about to go into, a wait which only a
+  // completion ends, and whether wake() has already ended it
+  bool isWaiting = false;
+  bool isWoken = false;
+  bool isWakeRequested = false;
+  uint32_t nextGeneration = 0;
+  uint64_t nextId = 1;
+  std::unordered_map<SocketHandle, Watch> watches;
+  // Watched handles whose polls fired, re-armed at the start of the next pass
+  std::vector<SocketHandle> unarmed;
+  std::unordered_map<uint64_t, Transfer> transfers;
+
+  // Copied out of the completion queue each pass, so it can be handed back
+  // to the kernel before the callbacks run
+  std::vector<io_uring_cqe> completions;
+
+  // Ends the loop's wait, if it is in one, so it submits what has been queued.
+  // Otherwise that goes in with its next wait.
+  void kick(std::unique_lock<std::mutex>& lock) {
+    if (!isWaiting || isWoken)
+      return;
+    isWoken = true;
+    lock.unlock();
+    uint64_t value = 1;
+    while (::write(wakeFd, &value, sizeof(value)) < 0 && errno == EINTR) {
+    }
+  }
+
+  int enter(unsigned int toSubmit,
+            unsigned int minComplete,
+            unsigned int flags,
+            io_uring_getevents_arg* arg,
+            size_t argSize) {
+    int result;
+    do {
+      result = syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete,
+                       flags, arg, argSize);
+    } while (result < 0 && errno == EINTR && minComplete == 0);
+    return result;
+  }
+
+  void setUpRing() {
+    io_uring_params params = {};
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = RING_ENTRIES * 4;
+    ringFd = syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+    unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP |
+                        IORING_FEAT_EXT_ARG;
+    if (ringFd < 0 || (params.features & required) != required)
+      throw Exception(ExceptionContext::Socket, ExceptionType::InitFailure);
+
+    ringSize =
+        std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                 params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    ringMemory = mmap(nullptr, ringSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = (io_uring_sqe*)mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, ringFd,
+                               IORING_OFF_SQES);
+    if (ringMemory == MAP_FAILED || sqes == MAP_FAILED)
+      throw Exception(ExceptionContext::Socket, ExceptionType::InitFailure);
+
+    char* ring = (char*)ringMemory;
+    sqHead = (unsigned*)(ring + params.sq_off.head);
+    sqTail = (unsigned*)(ring + params.sq_off.tail);
+    sqMask = *(unsigned*)(ring + params.sq_off.ring_mask);
+    sqEntries = params.sq_entries;
+    cqHead = (unsigned*)(ring + params.cq_off.head);
+    cqTail = (unsigned*)(ring + params.cq_off.tail);
+    cqMask = *(unsigned*)(ring + params.cq_off.ring_mask);
+    cqes = (io_uring_cqe*)(ring + params.cq_off.cqes);
+    sqQueued = *sqTail;
+
+    // Slots are used in order, so each one always holds the request of the
+    // same index
+    unsigned* sqArray = (unsigned*)(ring + params.sq_off.array);
+    for (unsigned i = 0; i < sqEntries; i++)
+      sqArray[i] = i;
+  }
+
+  void setUpBuffers() {
+    bufferRing = (io_uring_buf*)mmap(
+        nullptr, BUFFER_COUNT * sizeof(io_uring_buf), PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    buffers = (uint8_t*)mmap(nullptr, BUFFER_COUNT * BUFFER_SIZE,
+                             PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (bufferRing == MAP_FAILED || buffers == MAP_FAILED)
+      throw Exception(ExceptionContext::Socket, ExceptionType::InitFailure);
+
+    io_uring_buf_reg registration = {};
+    registration.ring_addr = (uint64_t)bufferRing;
+    registration.ring_entries = BUFFER_COUNT;
+    registration.bgid = BUFFER_GROUP;
+    if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PBUF_RING,
+                &registration, 1) != 0)
+      throw Exception(ExceptionContext::Socket, ExceptionType::InitFailure);
+
+    for (unsigned i = 0; i < BUFFER_COUNT; i++)
+      provideBuffer(i);
+  }
+
+  void release() {
+    // Closing the ring cancels whatever is still pending
+    if (ringFd >= 0)
+      ::close(ringFd);
+    if (ringMemory != MAP_FAILED)
+      munmap(ringMemory, ringSize);
+    if (sqes != MAP_FAILED)
+      munmap(sqes, sqesSize);
+    if (bufferRing != MAP_FAILED)
+      munmap(bufferRing, BUFFER_COUNT * sizeof(io_uring_buf));
+    if (buffers != MAP_FAILED)
+      munmap(buffers, BUFFER_COUNT * BUFFER_SIZE);
+    if (wakeFd >= 0)
+      ::close(wakeFd);
+  }
+
+  // Returns the next of `count` free request slots, submitting those queued
+  // so far to make room if needed, or null if there still isn't any.
+  // Requests linked to the one returned take the slots after it.
+  io_uring_sqe* reserve(unsigned int count) {
+    auto queued = [&]() {
+      return sqQueued -
+             std::atomic_ref(*sqHead).load(std::memory_order_acquire);
+    };
+    if (queued() + count > sqEntries) {
+      enter(queued(), 0, 0, nullptr, 0);
+      if (queued() + count > sqEntries)
+        return nullptr;
+    }
+    return nextSqe();
+  }
+
+  io_uring_sqe* nextSqe() {
+    io_uring_sqe* sqe = &sqes[sqQueued++ & sqMask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+  }
+
+  // Makes the requests queued so far visible to the kernel
+  void publish() {
+    std::atomic_ref(*sqTail).store(sqQueued, std::memory_order_release);
+  }
+
+  static uint64_t pollUserData(SocketHandle handle, uint32_t generation) {
+    return POLL | (uint64_t)generation << 32 | (uint32_t)handle;
+  }
+
+  bool arm(SocketHandle handle, Watch& watch) {
+    io_uring_sqe* sqe = reserve(1);
+    if (!sqe)
+      return false;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = handle;
+    sqe->poll32_events = watch.writable ? POLLOUT : POLLIN;
+    sqe->user_data = pollUserData(handle, watch.generation);
+    publish();
+    watch.isArmed = true;
+    return true;
+  }
+
+  void queueWakeRead() {
+    io_uring_sqe* sqe = reserve(1);
+    if (!sqe)
+      return;
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wakeFd;
+    sqe->addr = (uint64_t)&wakeValue;
+    sqe->len = sizeof(wakeValue);
+    sqe->user_data = WAKE;
+    publish();
+  }
+
+  bool submitTransfer(SocketHandle handle,
+                      BufferView sending,
+                      int length,
+                      unsigned int timeoutMs,
+                      TransferCallback onDone) {
+    std::unique_lock lock(ringMutex);
+    uint64_t id = nextId++;
+    Transfer& transfer = transfers[id];
+    transfer.handle = handle;
+    transfer.sending = sending;
+    transfer.length = length;
+    transfer.deadline =
+        timeoutMs >= INT_MAX
+            ? Clock::time_point::max()
+            : Clock::now() + std::chrono::milliseconds(timeoutMs);
+    transfer.onDone = std::move(onDone);
+    if (!queueTransfer(id, transfer)) {
+      transfers.erase(id);
+      return false;
+    }
+    kick(lock);
+    return true;
+  }
+
+  bool queueTransfer(uint64_t id, Transfer& transfer) {
+    bool hasTimeout = transfer.deadline != Clock::time_point::max();
+    if (hasTimeout) {
+      auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          transfer.deadline - Clock::now());
+      long long remainingNs = std::max<long long>(remaining.count(), 0);
+      transfer.timeout = {remainingNs / 1000000000, remainingNs % 1000000000};
+    }
+
+    io_uring_sqe* sqe = reserve(hasTimeout ? 2 : 1);
+    if (!sqe)
+      return false;
+    sqe->fd = transfer.handle;
+    sqe->user_data = TRANSFER | id;
+    if (transfer.sending.empty()) {
+      sqe->opcode = IORING_OP_RECV;
+      sqe->len = BUFFER_SIZE;
+      sqe->flags = IOSQE_BUFFER_SELECT;
+      sqe->buf_group = BUFFER_GROUP;
+      // A data phase streams in a segment at a time, so a read which will
+      // fill a whole buffer anyway completes once, when it has
+      if (transfer.length >= BUFFER_SIZE)
+        sqe->msg_flags = MSG_WAITALL;
+    } else {
+      sqe->opcode = IORING_OP_SEND;
+      sqe->addr = (uint64_t)transfer.sending.data();
+      sqe->len = transfer.sending.size();
+      sqe->msg_flags = MSG_NOSIGNAL;
+    }
+
+    if (hasTimeout) {
+      sqe->flags |= IOSQE_IO_LINK;
+      io_uring_sqe* timeoutSqe = nextSqe();
+      timeoutSqe->opcode = IORING_OP_LINK_TIMEOUT;
+      timeoutSqe->fd = -1;
+      timeoutSqe->addr = (uint64_t)&transfer.timeout;
+      timeoutSqe->len = 1;
+    }
+    publish();
+    return true;
+  }
+
+  // Hands buffer `id` back to the kernel for further reads
+  void provideBuffer(uint16_t id) {
+    io_uring_buf& buffer = bufferRing[bufferTail & (BUFFER_COUNT - 1)];
+    buffer.addr = (uint64_t)(buffers + (size_t)id * BUFFER_SIZE);
+    buffer.len = BUFFER_SIZE;
+    buffer.bid = id;
+    bufferTail++;
+    std::atomic_ref(bufferRing[0].resv)
+        .store(bufferTail, std::memory_order_release);
+  }
+
+  void reap() {
+    completions.clear();
+    unsigned head = *cqHead;
+    unsigned tail = std::atomic_ref(*cqTail).load(std::memory_order_acquire);
+    for (; head != tail; head++)
+      completions.push_back(cqes[head & cqMask]);
+    std::atomic_ref(*cqHead).store(head, std::memory_order_release);
+
+    for (const io_uring_cqe& cqe : completions) {
+      switch (cqe.user_data & KIND_MASK) {
+        case POLL:
+          finishPoll(cqe);
+          break;
+        case TRANSFER:
+          finishTransfer(cqe);
+          break;
+        case WAKE: {
+          std::lock_guard lock(ringMutex);
+          queueWakeRead();
+          break;
+        }
+      }
+    }
+  }
+
+  void finishPoll(const io_uring_cqe& cqe) {
+    SocketHandle handle = (uint32_t)cqe.user_data;
+    uint32_t generation = (cqe.user_data >> 32) & GENERATION_MASK;
+    {
+      std::lock_guard lock(ringMutex);
+      auto it = watches.find(handle);
+      if (it == watches.end() || it->second.generation != generation)
+        return;
+      it->second.isArmed = false;
+      unarmed.push_back(handle);
+    }
+    handleReady(handle);
+  }
+
+  void finishTransfer(const io_uring_cqe& cqe) {
+    uint64_t id = cqe.user_data & ~KIND_MASK;
+    TransferCallback onDone;
+    {
+      std::lock_guard lock(ringMutex);
+      auto it = transfers.find(id);
+      if (it == transfers.end())
+        return;
+      // Every buffer was out, but they are all back by the next pass
+      if (cqe.res == -ENOBUFS && Clock::now() < it->second.deadline &&
+          queueTransfer(id, it->second))
+        return;
+      onDone = std::move(it->second.onDone);
+      transfers.erase(it);
+    }
+
+    if (!(cqe.flags & IORING_CQE_F_BUFFER)) {
+      onDone(cqe.res, BufferView());
+      return;
+    }
+    uint16_t bufferId = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+    onDone(cqe.res, BufferView(buffers + (size_t)bufferId * BUFFER_SIZE,
+                               cqe.res > 0 ? cqe.res : 0));
+    provideBuffer(bufferId);
+  }
+};
+
+}  // namespace cb
+
+#endif
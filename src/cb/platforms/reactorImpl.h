@@ -0,0 +1,10 @@
+// CB_CONTROL_REACTOR_IMPL is defined when this platform has a reactor
+// implementation, which createReactor() returns. On Linux,
+// CB_CONTROL_URING_REACTOR_IMPL is also defined unless built with IO_URING=0.
+#if defined(_WIN32)
+#include "windows/reactorImpl.h"
+#define CB_CONTROL_REACTOR_IMPL
+#elif defined(__unix__) || defined(__APPLE__)
+#include "posix/reactorImpl.h"
+#define CB_CONTROL_REACTOR_IMPL
+#endif
@@ -1,7 +1,14 @@
+// CB_CONTROL_SOCKET_IMPL is defined when this platform has socket
+// implementations
 #if defined(_WIN32)
 #include "windows/socketImpl.h"
+#define CB_CONTROL_SOCKET_IMPL
 #elif defined(ESP32)
 #include "esp32/socketImpl.h"
+#define CB_CONTROL_SOCKET_IMPL
+#elif defined(__unix__) || defined(__APPLE__)
+#include "posix/socketImpl.h"
+#define CB_CONTROL_SOCKET_IMPL
 #endif
 
 // TODO: This should really be done with separate implementation files instead
@@ -0,0 +1,107 @@
+#ifndef CB_CONTROL_WINDOWS_REACTOR_H
+#define CB_CONTROL_WINDOWS_REACTOR_H
+
+#include <cb/exception.h>
+#include <cb/reactor.h>
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+namespace cb {
+
+// Waits with WSAPoll() on a copy of the watched handles. Windows can't poll a
+// pipe, so wake() sends a datagram to a loopback socket watched alongside them.
+class ReactorImpl : public Reactor {
+ public:
+  ReactorImpl() {
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+      throw Exception(ExceptionContext::Socket, ExceptionType::InitFailure);
+
+    wakeSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+    SOCKADDR_IN address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    int addressSize = sizeof(address);
+
+    u_long nonBlocking = 1;
+    if (wakeSocket == INVALID_SOCKET ||
+        bind(wakeSocket, (SOCKADDR*)&address, sizeof(address)) ==
+            SOCKET_ERROR ||
+        getsockname(wakeSocket, (SOCKADDR*)&address, &addressSize) ==
+            SOCKET_ERROR ||
+        ::connect(wakeSocket, (SOCKADDR*)&address, sizeof(address)) ==
+            SOCKET_ERROR ||
+        ioctlsocket(wakeSocket, FIONBIO, &nonBlocking) == SOCKET_ERROR) {
+      closesocket(wakeSocket);
+      WSACleanup();
+      throw Exception(ExceptionContext::Socket, ExceptionType::InitFailure);
+    }
+  }
+
+  ~ReactorImpl() {
+    closesocket(wakeSocket);
+    WSACleanup();
+  }
+
+ protected:
+  bool addHandle(SocketHandle handle, bool writable) override {
+    std::lock_guard lock(handlesMutex);
+    handles.push_back(
+        {(SOCKET)handle, (SHORT)(writable ? POLLWRNORM : POLLRDNORM), 0});
+    return true;
+  }
+
+  void removeHandle(SocketHandle handle) override {
+    std::lock_guard lock(handlesMutex);
+    std::erase_if(handles, [&](const WSAPOLLFD& pfd) {
+      return pfd.fd == (SOCKET)handle;
+    });
+  }
+
+  void waitReady(int timeoutMs) override {
+    {
+      std::lock_guard lock(handlesMutex);
+      pollFds.clear();
+      pollFds.push_back({wakeSocket, POLLRDNORM, 0});
+      pollFds.insert(pollFds.end(), handles.begin(), handles.end());
+    }
+
+    // TODO: More granular error handling
+    int count = WSAPoll(pollFds.data(), pollFds.size(), timeoutMs);
+    if (count == SOCKET_ERROR || count == 0)
+      return;
+
+    if (pollFds[0].revents & POLLRDNORM) {
+      char drain[64];
+      while (::recv(wakeSocket, drain, sizeof(drain), 0) > 0) {
+      }
+    }
+    for (size_t i = 1; i < pollFds.size(); i++) {
+      if (pollFds[i].revents & (pollFds[i].events | POLLHUP | POLLERR))
+        handleReady((SocketHandle)pollFds[i].fd);
+    }
+  }
+
+  void wake() override {
+    char value = 1;
+    ::send(wakeSocket, &value, 1, 0);
+  }
+
+ private:
+  SOCKET wakeSocket = INVALID_SOCKET;
+  std::mutex handlesMutex;
+  std::vector<WSAPOLLFD> handles;
+  // Kept between passes to avoid allocating for every wait
+  std::vector<WSAPOLLFD> pollFds;
+};
+
+inline std::shared_ptr<Reactor> createReactor() {
+  return std::make_shared<ReactorImpl>();
+}
+
+}  // namespace cb
+
+#endif
@@ -4,8 +4,10 @@
 #include <cb/exception.h>
 #include <cb/protocols/tcp.h>
 #include <cb/protocols/udp.h>
+#include <cb/scheduler.h>
 
 #include <winsock2.h>
+#include <iphlpapi.h>
 #include <ws2tcpip.h>
 
 namespace cb {
@@ -23,6 +25,11 @@ class WindowsSocket : public virtual BufferedSocket {
     WSACleanup();
   }
 
+  SocketHandle getHandle() const override {
+    return clientSocket == INVALID_SOCKET ? NO_SOCKET_HANDLE
+                                          : (SocketHandle)clientSocket;
+  }
+
  protected:
   bool wait(unsigned int timeoutMs) override {
     timeval timeout;
@@ -41,6 +48,24 @@ class WindowsSocket : public virtual BufferedSocket {
     return true;
   }
 
+  // Applies the options common to all sockets, returning false if any of them
+  // couldn't be applied. Winsock has no receive low-water mark or busy-poll.
+  bool applySocketOptions(const SocketOptions& options) {
+    bool success = setOption(SOL_SOCKET, SO_SNDBUF, options.sendBufferSize);
+    success &= setOption(SOL_SOCKET, SO_RCVBUF, options.receiveBufferSize);
+    success &= !options.receiveLowWater && !options.busyPollUs;
+    return success;
+  }
+
+  // Sets an integer option, if there is a value to set
+  bool setOption(int level, int name, std::optional<int> value) {
+    if (!value)
+      return true;
+    int optVal = *value;
+    return setsockopt(clientSocket, level, name, (const char*)&optVal,
+                      sizeof(optVal)) != SOCKET_ERROR;
+  }
+
   SOCKET clientSocket = INVALID_SOCKET;
   fd_set readfds;
 };
@@ -48,50 +73,54 @@ class WindowsSocket : public virtual BufferedSocket {
 // TODO: Figure out error logging
 class TCPSocketImpl : public TCPSocket, WindowsSocket {
  public:
-  bool connect(const std::string& ip, int port) override {
-    close();  // TODO: is this needed?
-
-    clientSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-    if (clientSocket == INVALID_SOCKET)
-      return false;
-
-    BOOL bOptVal = TRUE;
-    int bOptLen = sizeof(BOOL);
-
-    if (setsockopt(clientSocket, SOL_SOCKET, SO_KEEPALIVE,
-                   (const char*)&bOptVal, sizeof(bOptLen)) == SOCKET_ERROR) {
-      close();
-      return false;
-    }
+  // Reads go straight into the destination buffer, so large ones cost nothing
+  // extra and keep bulk transfers to few syscalls. Smaller reads are served
+  // from a read-ahead buffer of the same size.
+  TCPSocketImpl() : BufferedSocket(64 * 1024, true) {}
 
-    if (setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY,
-                   (const char*)&bOptVal, sizeof(bOptLen)) == SOCKET_ERROR) {
-      close();
+  bool connect(const std::string& ip, int port) override {
+    if (!startConnect(ip, port))
       return false;
-    }
-
-    SOCKADDR_IN serverAddress;
-    serverAddress.sin_family = AF_INET;
-    serverAddress.sin_addr.s_addr = inet_addr(ip.c_str());
-    serverAddress.sin_port = htons(port);
 
-    if (::connect(clientSocket, (SOCKADDR*)&serverAddress,
-                  sizeof(serverAddress)) == SOCKET_ERROR) {
-      close();
-      return false;
-    }
+    timeval timeout;
+    timeout.tv_sec = options.connectTimeoutMs / 1000;
+    timeout.tv_usec = (options.connectTimeoutMs % 1000) * 1000;
+
+    // A failed connect is reported through the exception set
+    fd_set writefds, exceptfds;
+    FD_ZERO(&writefds);
+    FD_SET(clientSocket, &writefds);
+    FD_ZERO(&exceptfds);
+    FD_SET(clientSocket, &exceptfds);
+    return finishConnect(
+        select(0, NULL, &writefds, &exceptfds, &timeout) > 0 &&
+        FD_ISSET(clientSocket, &writefds));
+  }
 
-    return true;
+  Task<bool> connectAsync(Scheduler& scheduler,
+                          const std::string& ip,
+                          int port) override {
+    if (!startConnect(ip, port))
+      co_return false;
+    bool isWritable =
+        co_await scheduler.writable(*this, options.connectTimeoutMs);
+    co_return finishConnect(isWritable);
   }
 
   bool close() override {
     bool failure = closesocket(clientSocket) == SOCKET_ERROR;
     clientSocket = INVALID_SOCKET;
+    discardReadAhead();
     return failure;
   }
 
   bool isConnected() override { return clientSocket != INVALID_SOCKET; }
 
+  bool setOptions(const TCPSocketOptions& options) override {
+    this->options = options;
+    return clientSocket == INVALID_SOCKET || applyOptions();
+  }
+
  protected:
   int send(const char* buff, int length) override {
     int result = ::send(clientSocket, buff, length, 0);
@@ -100,46 +129,152 @@ class TCPSocketImpl : public TCPSocket, WindowsSocket {
     return result;
   }
 
+  int sendSome(std::span<const BufferView> segments) override {
+    wsaBuffers.clear();
+    for (const BufferView& segment : segments)
+      wsaBuffers.push_back({static_cast<ULONG>(segment.size()),
+                            (CHAR*)(segment.data())});
+
+    DWORD sentBytes = 0;
+    if (WSASend(clientSocket, wsaBuffers.data(), wsaBuffers.size(), &sentBytes,
+                0, NULL, NULL) == SOCKET_ERROR)
+      return BUFFERED_SOCKET_ERROR;
+    return sentBytes;
+  }
+
   int recv(char* buff, int length) override {
     int result = ::recv(clientSocket, buff, length, 0);
     if (result == SOCKET_ERROR)
       return BUFFERED_SOCKET_ERROR;
     return result;
   }
+
+ private:
+  // Kept between sends to avoid allocating for every vectored write
+  std::vector<WSABUF> wsaBuffers;
+  TCPSocketOptions options;
+
+  // Starts a non-blocking connect, returning false if it failed right away
+  bool startConnect(const std::string& ip, int port) {
+    close();  // TODO: is this needed?
+
+    clientSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (clientSocket == INVALID_SOCKET)
+      return false;
+
+    // Before connecting, so the buffer sizes count towards the window scale
+    u_long nonBlocking = 1;
+    if (!applyOptions() ||
+        ioctlsocket(clientSocket, FIONBIO, &nonBlocking) == SOCKET_ERROR) {
+      close();
+      return false;
+    }
+
+    SOCKADDR_IN serverAddress;
+    serverAddress.sin_family = AF_INET;
+    serverAddress.sin_addr.s_addr = inet_addr(ip.c_str());
+    serverAddress.sin_port = htons(port);
+
+    if (::connect(clientSocket, (SOCKADDR*)&serverAddress,
+                  sizeof(serverAddress)) == SOCKET_ERROR &&
+        WSAGetLastError() != WSAEWOULDBLOCK) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  // Checks the outcome of a connect once the socket is writable, then makes it
+  // blocking again. Closes it if the connect failed or `isWritable` is false
+  // because the deadline passed.
+  bool finishConnect(bool isWritable) {
+    int error = 0;
+    int errorSize = sizeof(error);
+    u_long nonBlocking = 0;
+    if (!isWritable ||
+        getsockopt(clientSocket, SOL_SOCKET, SO_ERROR, (char*)&error,
+                   &errorSize) == SOCKET_ERROR ||
+        error != 0 ||
+        ioctlsocket(clientSocket, FIONBIO, &nonBlocking) == SOCKET_ERROR) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  // Keepalive timing options need Windows 10 1709 or later
+  bool applyOptions() {
+    bool success = applySocketOptions(options);
+    success &= setOption(IPPROTO_TCP, TCP_NODELAY, options.noDelay);
+    success &= setOption(SOL_SOCKET, SO_KEEPALIVE, options.keepAlive);
+#if defined(TCP_KEEPIDLE) && defined(TCP_KEEPINTVL) && defined(TCP_KEEPCNT)
+    success &= setOption(IPPROTO_TCP, TCP_KEEPIDLE, options.keepAliveIdleS);
+    success &=
+        setOption(IPPROTO_TCP, TCP_KEEPINTVL, options.keepAliveIntervalS);
+    success &= setOption(IPPROTO_TCP, TCP_KEEPCNT, options.keepAliveCount);
+#else
+    success &= !options.keepAliveIdleS && !options.keepAliveIntervalS &&
+               !options.keepAliveCount;
+#endif
+    success &= !options.quickAck;
+    return success;
+  }
 };
 
-// TODO: Send/listen on all available interfaces ("multi-homed" control point)
+// A multi-homed control point uses one socket per interface (see
+// getInterfaceAddresses())
 class UDPMulticastSocketImpl : public UDPMulticastSocket, WindowsSocket {
  public:
   UDPMulticastSocketImpl() : BufferedSocket(1460) {}
 
-  bool begin(const std::string& ip, int port) override {
+  bool begin(const std::string& ip,
+             int port,
+             const std::string& interfaceIp = "") override {
     remoteIp = ip;
     remotePort = port;
 
     close();  // TODO: is this needed?
 
+    membership.imr_multiaddr.s_addr = inet_addr(remoteIp.c_str());
+    membership.imr_interface.s_addr =
+        interfaceIp.empty() ? htonl(INADDR_ANY) : inet_addr(interfaceIp.c_str());
+
     clientSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
     if (clientSocket == INVALID_SOCKET)
       return false;
 
+    // Sockets for other interfaces are bound to the same port
+    BOOL reuseAddress = TRUE;
+    if (setsockopt(clientSocket, SOL_SOCKET, SO_REUSEADDR,
+                   (const char*)&reuseAddress,
+                   sizeof(reuseAddress)) == SOCKET_ERROR) {
+      close();
+      return false;
+    }
+
     SOCKADDR_IN serverAddress;
     serverAddress.sin_family = AF_INET;
     serverAddress.sin_addr.s_addr = htonl(INADDR_ANY);
     serverAddress.sin_port = htons(remotePort);
 
-    if (bind(clientSocket, (SOCKADDR*)&serverAddress, sizeof(serverAddress)) ==
-        SOCKET_ERROR) {
+    if (!applySocketOptions(options) ||
+        bind(clientSocket, (SOCKADDR*)&serverAddress, sizeof(serverAddress)) ==
+            SOCKET_ERROR) {
       close();
       return false;
     }
 
-    IP_MREQ imr;
-    imr.imr_multiaddr.s_addr = inet_addr(remoteIp.c_str());
-    imr.imr_interface.s_addr = htonl(INADDR_ANY);
-
     if (setsockopt(clientSocket, IPPROTO_IP, IP_ADD_MEMBERSHIP,
-                   (const char*)&imr, sizeof(imr)) == SOCKET_ERROR) {
+                   (const char*)&membership,
+                   sizeof(membership)) == SOCKET_ERROR) {
+      close();
+      return false;
+    }
+
+    if (!interfaceIp.empty() &&
+        setsockopt(clientSocket, IPPROTO_IP, IP_MULTICAST_IF,
+                   (const char*)&membership.imr_interface,
+                   sizeof(membership.imr_interface)) == SOCKET_ERROR) {
       close();
       return false;
     }
@@ -148,18 +283,21 @@ class UDPMulticastSocketImpl : public UDPMulticastSocket, WindowsSocket {
   }
 
   bool close() override {
-    IP_MREQ imr;
-    imr.imr_multiaddr.s_addr = inet_addr(remoteIp.c_str());
-    imr.imr_interface.s_addr = htonl(INADDR_ANY);
-
-    bool failure = setsockopt(clientSocket, IPPROTO_IP, IP_DROP_MEMBERSHIP,
-                              (const char*)&imr, sizeof(imr)) == SOCKET_ERROR;
+    bool failure =
+        setsockopt(clientSocket, IPPROTO_IP, IP_DROP_MEMBERSHIP,
+                   (const char*)&membership,
+                   sizeof(membership)) == SOCKET_ERROR;
 
     failure |= closesocket(clientSocket) == SOCKET_ERROR;
     clientSocket = INVALID_SOCKET;
     return failure;
   }
 
+  bool setOptions(const SocketOptions& options) override {
+    this->options = options;
+    return clientSocket == INVALID_SOCKET || applySocketOptions(options);
+  }
+
   std::string getRemoteIp() const override { return remoteIp; }
 
   int getRemotePort() const override { return remotePort; }
@@ -202,8 +340,50 @@ class UDPMulticastSocketImpl : public UDPMulticastSocket, WindowsSocket {
  private:
   std::string remoteIp;
   int remotePort = 0;
+  SocketOptions options;
+  // The group and interface joined, as remoteIp changes with every receive
+  IP_MREQ membership = {};
 };
 
+// Addresses of the IPv4 interfaces that are up and can multicast, other than
+// loopback
+inline std::vector<std::string> getInterfaceAddresses() {
+  std::vector<std::string> addresses;
+  ULONG flags = GAA_FLAG_SKIP_ANYCAST | GAA_FLAG_SKIP_MULTICAST |
+                GAA_FLAG_SKIP_DNS_SERVER;
+  ULONG size = 16 * 1024;
+  std::vector<char> buffer(size);
+  ULONG result = GetAdaptersAddresses(
+      AF_INET, flags, NULL, (IP_ADAPTER_ADDRESSES*)buffer.data(), &size);
+  if (result == ERROR_BUFFER_OVERFLOW) {
+    buffer.resize(size);
+    result = GetAdaptersAddresses(
+        AF_INET, flags, NULL, (IP_ADAPTER_ADDRESSES*)buffer.data(), &size);
+  }
+  if (result != NO_ERROR)
+    return addresses;
+
+  char ipString[INET_ADDRSTRLEN];
+  for (IP_ADAPTER_ADDRESSES* adapter = (IP_ADAPTER_ADDRESSES*)buffer.data();
+       adapter; adapter = adapter->Next) {
+    if (adapter->OperStatus != IfOperStatusUp ||
+        adapter->IfType == IF_TYPE_SOFTWARE_LOOPBACK ||
+        (adapter->Flags & IP_ADAPTER_NO_MULTICAST))
+      continue;
+    for (IP_ADAPTER_UNICAST_ADDRESS* unicast = adapter->FirstUnicastAddress;
+         unicast; unicast = unicast->Next) {
+      inet_ntop(AF_INET, &((SOCKADDR_IN*)unicast->Address.lpSockaddr)->sin_addr,
+                ipString, sizeof(ipString));
+      addresses.push_back(ipString);
+    }
+  }
+  return addresses;
+}
+
+inline std::unique_ptr<TCPSocket> createTCPSocket() {
+  return std::make_unique<TCPSocketImpl>();
+}
+
 }  // namespace cb
 
 #endif
\ No newline at end of file
@@ -0,0 +1,86 @@
+#ifndef CB_CONTROL_POOL_H
+#define CB_CONTROL_POOL_H
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+
+namespace cb {
+
+// Free list of storage for packets of type `T`. Blocks are kept when a packet
+// is destroyed and handed back out for the next one, so packets that are
+// created and destroyed at a steady rate (events, transaction packets) stop
+// going through the heap once the pool has warmed up. Packets may be freed on
+// a different thread than the one that created them.
+template <typename T>
+class PacketPool {
+ public:
+  // Blocks beyond this many free ones are returned to the heap
+  static const int MAX_FREE = 32;
+
+  static void* allocate(size_t size) {
+    // Classes deriving from T inherit its operator new, but not its size
+    if (size == sizeof(T)) {
+      State& state = getState();
+      std::lock_guard lock(state.mutex);
+      if (FreeBlock* block = state.freeList) {
+        state.freeList = block->next;
+        state.numFree--;
+        return block;
+      }
+    }
+    return ::operator new(size);
+  }
+
+  static void deallocate(void* p, size_t size) {
+    if (size == sizeof(T)) {
+      State& state = getState();
+      std::lock_guard lock(state.mutex);
+      if (state.numFree < MAX_FREE) {
+        state.freeList = new (p) FreeBlock{state.freeList};
+        state.numFree++;
+        return;
+      }
+    }
+    ::operator delete(p);
+  }
+
+ private:
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  static_assert(sizeof(T) >= sizeof(FreeBlock));
+
+  struct State {
+    std::mutex mutex;
+    FreeBlock* freeList = nullptr;
+    int numFree = 0;
+  };
+
+  // Never destroyed, since packets may still be freed during static
+  // destruction
+  static State& getState() {
+    static State* state = new State();
+    return *state;
+  }
+};
+
+// Mixin which allocates `T` from PacketPool<T>. Since the packet destructors
+// are virtual, packets are returned to the right pool even when they are
+// destroyed through a pointer to their base.
+template <typename T>
+class Pooled {
+ public:
+  static void* operator new(size_t size) {
+    return PacketPool<T>::allocate(size);
+  }
+
+  static void operator delete(void* p, size_t size) {
+    PacketPool<T>::deallocate(p, size);
+  }
+};
+
+}  // namespace cb
+
+#endif
\ No newline at end of file
@@ -2,9 +2,18 @@
 #include <cb/protocols/http.h>
 
 #include <algorithm>
+#include <cctype>
 
 namespace cb {
 
+bool HeaderNameLess::operator()(const std::string& a,
+                                const std::string& b) const {
+  return std::lexicographical_compare(
+      a.begin(), a.end(), b.begin(), b.end(), [](char x, char y) {
+        return std::tolower((unsigned char)x) < std::tolower((unsigned char)y);
+      });
+}
+
 // TODO: Implement chunked encoding and automatically use it when header present
 void HTTPMessage::pack(Buffer& buffer, int& offset) {
   Packet::pack(buffer, offset);
@@ -26,9 +35,42 @@ void HTTPMessage::pack(Buffer& buffer, int& offset) {
     bodyField.pack(buffer, offset);
 }
 
+int HTTPMessage::packedSize() {
+  int size = Packet::packedSize();
+
+  // pack() sets Content-Length from the body, so count that value instead
+  std::string temp;
+  for (auto& [name, value] : headers) {
+    if (!body.empty() && name == "Content-Length")
+      continue;
+    temp = name;  // TODO: Remove this when I fix const correctness
+    size += headerNamePacker.packedSize(temp);
+    size += headerValuePacker.packedSize(value);
+  }
+  if (!body.empty()) {
+    temp = "Content-Length";
+    size += headerNamePacker.packedSize(temp);
+    temp = std::to_string(body.size());
+    size += headerValuePacker.packedSize(temp);
+  }
+  temp = "";
+  size += headerValuePacker.packedSize(temp);
+
+  if (!body.empty())
+    size += body.size();
+  return size;
+}
+
 void HTTPMessage::unpack(const Buffer& buffer,
                          int& offset,
                          std::optional<int> limitOffset) {
+  unpackHeaders(buffer, offset, limitOffset);
+  unpackBody(buffer, offset, limitOffset);
+}
+
+void HTTPMessage::unpackHeaders(const Buffer& buffer,
+                                int& offset,
+                                std::optional<int> limitOffset) {
   Packet::unpack(buffer, offset, limitOffset);
 
   int limit = getUnpackLimit(buffer.size(), limitOffset);
@@ -43,11 +85,54 @@ void HTTPMessage::unpack(const Buffer& buffer,
   }
 
   contentLength = 0;
-  body.clear();
-  if (headers.contains("Content-Length")) {
+  if (headers.contains("Content-Length"))
     contentLength = std::stoul(headers["Content-Length"]);
+}
+
+void HTTPMessage::unpackBody(const Buffer& buffer,
+                             int& offset,
+                             std::optional<int> limitOffset) {
+  body.clear();
+  if (headers.contains("Content-Length"))
     bodyField.unpack(buffer, offset, limitOffset);
+}
+
+int HTTPMessage::unpackSome(const Buffer& buffer) {
+  static const Buffer headerDelim = {'\r', '\n', '\r', '\n'};
+
+  if (bodyOffset < 0) {
+    // Resume a few bytes back in case the delimiter straddles two reads
+    int start = scanOffset - (int)headerDelim.size() + 1;
+    if (start < 0)
+      start = 0;
+    auto end = std::search(buffer.begin() + start, buffer.end(),
+                           headerDelim.begin(), headerDelim.end());
+    scanOffset = buffer.size();
+
+    if (end == buffer.end()) {
+      // Only ask for as many bytes as could complete a partial delimiter, so
+      // that nothing past the header block is read
+      for (int matched = headerDelim.size() - 1; matched > 0; matched--) {
+        if ((int)buffer.size() >= matched &&
+            std::equal(buffer.end() - matched, buffer.end(),
+                       headerDelim.begin()))
+          return headerDelim.size() - matched;
+      }
+      return headerDelim.size();
+    }
+
+    int headerEnd = end - buffer.begin() + headerDelim.size();
+    bodyOffset = 0;
+    unpackHeaders(buffer, bodyOffset, headerEnd);
   }
+
+  int needed = bodyOffset + (int)contentLength - (int)buffer.size();
+  if (needed > 0)
+    return needed;
+
+  int offset = bodyOffset;
+  unpackBody(buffer, offset, std::nullopt);
+  return 0;
 }
 
 int HTTPMessage::send(TCPSocket& socket) {
@@ -58,29 +143,7 @@ int HTTPMessage::send(TCPSocket& socket) {
 int HTTPMessage::recv(TCPSocket& socket,
                       Buffer& buffer,
                       unsigned int timeoutMs) {
-  buffer.clear();
-
-  const Buffer headerDelim = {'\r', '\n', '\r', '\n'};
-
-  socket.recvAttempt(buffer, timeoutMs, headerDelim.size());
-  if (buffer.size() < headerDelim.size()) {
-    buffer.clear();
-    return 0;
-  }
-
-  // Receive one byte at a time until end of header block
-  while (!std::equal(buffer.end() - headerDelim.size(), buffer.end(),
-                     headerDelim.begin())) {
-    socket.recvAttempt(buffer, timeoutMs, 1);
-  }
-  unpack(buffer);
-
-  if (contentLength > 0) {
-    socket.recvAttempt(buffer, timeoutMs, contentLength);
-    unpack(buffer);
-  }
-
-  return buffer.size();
+  return socket.recvAttempt(*this, buffer, timeoutMs);
 }
 
 int HTTPMessage::send(UDPMulticastSocket& socket) {
@@ -98,18 +161,9 @@ int HTTPMessage::recv(UDPMulticastSocket& socket,
 }
 
 std::unique_ptr<HTTPResponse> URL::request(std::unique_ptr<TCPSocket>& socket) {
-  int portNumber = 80;
-  std::string portString = "";
-  if (!port.empty()) {
-    portNumber = std::stoi(port);
-    portString = ":" + port;
-  }
-
-  socket->connect(hostname, portNumber);
-  HTTPRequest request("GET", path.empty() ? "/" : path);
-  request.headers["Host"] = hostname + portString;
-  request.headers["Connection"] = "close";
-  request.send(*socket);
+  if (!socket->connect(hostname, getPortNumber()))
+    throw Exception(ExceptionContext::Socket, ExceptionType::ConnectFailure);
+  sendRequest(*socket);
 
   auto response = std::make_unique<HTTPResponse>();
   response->recv(*socket);
@@ -119,4 +173,33 @@ std::unique_ptr<HTTPResponse> URL::request(std::unique_ptr<TCPSocket>& socket) {
   return response;
 }
 
+Task<std::unique_ptr<HTTPResponse>> URL::requestAsync(
+    Scheduler& scheduler,
+    std::unique_ptr<TCPSocket>& socket) {
+  bool isConnected =
+      co_await socket->connectAsync(scheduler, hostname, getPortNumber());
+  if (!isConnected)
+    throw Exception(ExceptionContext::Socket, ExceptionType::ConnectFailure);
+  sendRequest(*socket);
+
+  auto response = std::make_unique<HTTPResponse>();
+  Buffer buffer;
+  co_await socket->recvAttemptAsync(scheduler, *response, buffer, 10000);
+
+  socket->close();
+
+  co_return response;
+}
+
+int URL::getPortNumber() const {
+  return port.empty() ? 80 : std::stoi(port);
+}
+
+void URL::sendRequest(TCPSocket& socket) {
+  HTTPRequest request("GET", path.empty() ? "/" : path);
+  request.headers["Host"] = port.empty() ? hostname : hostname + ":" + port;
+  request.headers["Connection"] = "close";
+  request.send(socket);
+}
+
 }
\ No newline at end of file
@@ -8,20 +8,23 @@
 
 namespace cb {
 
+// Orders header names ignoring case, as HTTP does when comparing them
+struct HeaderNameLess {
+  bool operator()(const std::string& a, const std::string& b) const;
+};
+
 class HTTPMessage : public Packet,
                     public Sendable<TCPSocket>,
                     public Sendable<UDPMulticastSocket> {
  public:
   std::string httpVersion = "HTTP/1.1";
-  std::map<std::string, std::string> headers;
+  std::map<std::string, std::string, HeaderNameLess> headers;
   Buffer body;
 
   HTTPMessage()
       : headerNamePacker({}, {":", "\r\n"}, " \t", true),
         headerValuePacker({}, {"\r\n"}, " \t"),
-        bodyField(std::make_unique<Vector<uint8_t, uint32_t>>(
-                      std::make_unique<Primitive<uint8_t>>(),
-                      contentLength),
+        bodyField(std::make_unique<Vector<uint8_t, uint32_t>>(contentLength),
                   body) {}
 
   using Packet::pack;
@@ -31,6 +34,15 @@ class HTTPMessage : public Packet,
   void unpack(const Buffer& buffer,
               int& offset,
               std::optional<int> limitOffset) override;
+  int packedSize() override;
+
+  // Scans for the end of the header block from where the previous call left
+  // off, parses the headers once it arrives, then waits for the body
+  int unpackSome(const Buffer& buffer) override;
+  void resetUnpack() override {
+    scanOffset = 0;
+    bodyOffset = -1;
+  }
 
   int send(TCPSocket& socket) override;
   int recv(TCPSocket& socket,
@@ -54,6 +66,17 @@ class HTTPMessage : public Packet,
   uint32_t contentLength = 0;
   uint32_t chunkSize = 8192;
 
+  // Progress of unpackSome()
+  int scanOffset = 0;
+  int bodyOffset = -1;
+
+  void unpackHeaders(const Buffer& buffer,
+                     int& offset,
+                     std::optional<int> limitOffset);
+  void unpackBody(const Buffer& buffer,
+                  int& offset,
+                  std::optional<int> limitOffset);
+
   DelimitedString headerNamePacker;
   DelimitedString headerValuePacker;
   Field<Buffer> bodyField;
@@ -108,7 +131,22 @@ class URL : public Packet {
 
   URL(std::string s) : URL() { unpackString(s); }
 
+  // The fields refer to this URL's members (see Packet)
+  URL(const URL&) = delete;
+  URL& operator=(const URL&) = delete;
+
   std::unique_ptr<HTTPResponse> request(std::unique_ptr<TCPSocket>& socket);
+  // Like request(), but suspending on `scheduler` instead of blocking while
+  // waiting for the response
+  Task<std::unique_ptr<HTTPResponse>> requestAsync(
+      Scheduler& scheduler,
+      std::unique_ptr<TCPSocket>& socket);
+
+ private:
+  // The URL's port, or HTTP's if it has none
+  int getPortNumber() const;
+  // Sends a GET request for this URL on the connected `socket`
+  void sendRequest(TCPSocket& socket);
 };
 
 }  // namespace cb
@@ -3,12 +3,109 @@
 #include <cb/protocols/xml.h>
 #include <cb/proxy.h>
 
+#include <string_view>
+
 namespace cb {
 
+namespace {
+
+// Trimmed the same way as when the headers are parsed
+std::string_view trimHeader(std::string_view s) {
+  size_t first = s.find_first_not_of(" \t");
+  if (first == std::string_view::npos)
+    return {};
+  return s.substr(first, s.find_last_not_of(" \t") - first + 1);
+}
+
+bool isNT(std::string_view name) {
+  return name.size() == 2 && (name[0] == 'N' || name[0] == 'n') &&
+         (name[1] == 'T' || name[1] == 't');
+}
+
+}  // namespace
+
+bool isNotifyFor(const Buffer& datagram,
+                 const std::set<std::string>& searchTargets) {
+  std::string_view message((const char*)datagram.data(), datagram.size());
+  if (!message.starts_with("NOTIFY "))
+    return false;
+
+  // Header names are matched as the parser does: ignoring case and the
+  // whitespace around them
+  size_t lineStart = message.find("\r\n");
+  while (lineStart != std::string_view::npos) {
+    lineStart += 2;
+    size_t lineEnd = message.find("\r\n", lineStart);
+    // The headers end at an empty line
+    if (lineEnd == std::string_view::npos || lineEnd == lineStart)
+      return false;
+
+    std::string_view line = message.substr(lineStart, lineEnd - lineStart);
+    size_t colon = line.find(':');
+    if (colon != std::string_view::npos &&
+        isNT(trimHeader(line.substr(0, colon)))) {
+      std::string_view value = trimHeader(line.substr(colon + 1));
+      for (const std::string& searchTarget : searchTargets) {
+        if (value == searchTarget)
+          return true;
+      }
+      return false;
+    }
+    lineStart = lineEnd;
+  }
+  return false;
+}
+
+SSDPDiscovery::SSDPDiscovery(
+    std::map<std::string, std::unique_ptr<CameraProxy>>& cameras,
+    std::map<std::string, std::unique_ptr<UDPMulticastSocket>> udpSockets,
+    std::unique_ptr<TCPSocket> tcpSocket,
+    std::set<std::string> searchTargets,
+    std::array<uint8_t, 16> clientGuid,
+    std::string clientName)
+    : DiscoveryService(cameras, DiscoveryMethod::SSDP),
+      udpSockets(std::move(udpSockets)),
+      tcpSocket(std::move(tcpSocket)),
+      searchTargets(std::move(searchTargets)),
+      clientGuid(clientGuid),
+      clientName(std::move(clientName)) {
+  // TODO: Fix port binding and listen for UDP unicast responses
+  for (auto it = this->udpSockets.begin(); it != this->udpSockets.end();) {
+    const std::string& interfaceIp = it->first;
+    UDPMulticastSocket& udpSocket = *it->second;
+    if (!udpSocket.begin("239.255.255.250", 1900, interfaceIp)) {
+      Logger::log("SSDP: Couldn't listen on interface %s",
+                  interfaceIp.empty() ? "(default)" : interfaceIp.c_str());
+      it = this->udpSockets.erase(it);
+      continue;
+    }
+    for (const std::string& searchTarget : this->searchTargets) {
+      SSDPSearchMessage(searchTarget).send(udpSocket);
+    }
+    ++it;
+  }
+}
+
+SSDPDiscovery::~SSDPDiscovery() {
+  detach();
+  std::unique_lock lock(fetchMutex);
+  fetchDone.wait(lock, [this]() { return fetchesInFlight == 0; });
+  for (auto& [interfaceIp, udpSocket] : udpSockets) {
+    udpSocket->close();
+  }
+}
+
+std::map<std::string, std::unique_ptr<UDPMulticastSocket>>
+SSDPDiscovery::defaultInterface(std::unique_ptr<UDPMulticastSocket> udpSocket) {
+  std::map<std::string, std::unique_ptr<UDPMulticastSocket>> udpSockets;
+  udpSockets[""] = std::move(udpSocket);
+  return udpSockets;
+}
+
 std::unique_ptr<CameraProxy> SSDPDiscovery::createCamera(
-    std::unique_ptr<DiscoveryAddEvent> addEvent) {
-  return std::make_unique<CameraWrapper>(clientGuid, clientName,
-                                         addEvent->connectionAddress);
+    const DiscoveryAddEvent& addEvent) {
+  return std::make_unique<CameraWrapper>(
+      clientGuid, clientName, addEvent.connectionAddress, 15740, cameraOptions);
 }
 
 std::unique_ptr<EventContainer> SSDPDiscovery::popEvent() {
@@ -16,62 +113,87 @@ std::unique_ptr<EventContainer> SSDPDiscovery::popEvent() {
   return EventProxy<EventContainer>::popEvent();
 }
 
-void SSDPDiscovery::getEvents() {
-  HTTPRequest request;
-  while (request.recv(*udpSocket, 0)) {
-    if (request.method != "NOTIFY")
-      continue;
-
-    std::string ip = udpSocket->getRemoteIp();
-    std::string serviceName = request.headers["NT"];
-    if (!searchTargets.contains(serviceName))
-      continue;
+bool SSDPDiscovery::attach(Reactor& reactor, Reactor::Callback onEvents) {
+  detach();
 
-    // Remove camera on ssdp:byebye
-    if (request.headers["NTS"] == "ssdp:byebye") {
-      pushAndReceive(createId(ip), std::make_unique<DiscoveryRemoveEvent>());
-      advertisements.erase(serviceName);
-      continue;
-    } else if (request.headers["NTS"] != "ssdp:alive") {
-      continue;
+  auto handleEvents = [this, onEvents]() {
+    getEvents();
+    if (onEvents)
+      onEvents();
+  };
+  for (auto it = udpSockets.begin(); it != udpSockets.end(); ++it) {
+    if (!reactor.watch(*it->second, handleEvents)) {
+      for (auto watched = udpSockets.begin(); watched != it; ++watched) {
+        reactor.unwatch(*watched->second);
+      }
+      return false;
     }
+  }
+  // Advertisements also expire while nothing is received
+  expiryTimer = reactor.addTimer(std::chrono::seconds(1), handleEvents);
+  this->reactor = &reactor;
 
-    if (!advertisements.contains(serviceName)) {
-      // New advertisement; request/parse DeviceDesc
-      auto xmlResponse = URL(request.headers["Location"]).request(tcpSocket);
-      XMLDoc deviceDesc;
-      deviceDesc.unpack(xmlResponse->body);
-      const XMLElement& device = deviceDesc["device"];
-
-      // Push DiscoveryAddEvent
-      auto addEvent = std::make_unique<DiscoveryAddEvent>(
-          static_cast<int>(DiscoveryMethod::SSDP), ip, device["serialNumber"],
-          device["manufacturer"], device["modelName"], device["friendlyName"]);
-      pushAndReceive(createId(ip), std::move(addEvent));
-    }
+  std::lock_guard lock(fetchMutex);
+  attachment = std::make_shared<Attachment>(reactor, handleEvents);
+  return true;
+}
 
-    // Keep track of time and IP of advertisement
-    advertisements[serviceName] = {std::chrono::steady_clock::now(), ip};
+void SSDPDiscovery::detach() {
+  if (!reactor)
+    return;
+  for (auto& [interfaceIp, udpSocket] : udpSockets) {
+    reactor->unwatch(*udpSocket);
+  }
+  reactor->removeTimer(expiryTimer);
+  reactor = nullptr;
 
-    // Hacky way to get Cache-Control seconds value
-    std::string durationStr = "";
-    size_t durationStart = request.headers["Cache-Control"].find("=");
-    if (durationStart != std::string::npos)
-      durationStr = request.headers["Cache-Control"].substr(durationStart + 1);
+  std::shared_ptr<Attachment> detached;
+  {
+    std::lock_guard lock(fetchMutex);
+    detached.swap(attachment);
+  }
+  // Waits for a posted task that is running on the loop thread
+  std::lock_guard lock(detached->mutex);
+  detached->isAttached = false;
+}
 
-    // Add max seconds value to expiration time
-    if (!durationStr.empty()) {
-      advertisements[serviceName].expirationTime +=
-          std::chrono::seconds(std::stoi(durationStr));
-    }
+void SSDPDiscovery::getEvents() {
+  std::vector<std::pair<std::string, std::unique_ptr<DiscoveryAddEvent>>>
+      devices;
+  {
+    std::lock_guard lock(fetchMutex);
+    devices.swap(fetched);
+  }
+  for (auto& [ip, addEvent] : devices)
+    addCamera(ip, std::move(addEvent));
+
+  HTTPRequest request;
+  for (auto& [interfaceIp, udpSocket] : udpSockets) {
+    int count;
+    do {
+      count = udpSocket->recvBatch(datagrams);
+      for (int i = 0; i < count; i++) {
+        if (!isNotifyFor(datagrams[i].data, searchTargets))
+          continue;
+        // One malformed advertisement mustn't stop the others
+        try {
+          request.unpack(datagrams[i].data);
+          handleNotify(request, datagrams[i].remoteIp);
+        } catch (const std::exception& e) {
+          Logger::log("SSDP: Bad advertisement from %s: %s",
+                      datagrams[i].remoteIp.c_str(), e.what());
+        }
+      }
+    } while (count == datagrams.size());
   }
 
   // Remove expired advertisements
   auto now = std::chrono::steady_clock::now();
   for (auto it = advertisements.begin(); it != advertisements.end();) {
     if (it->second.expirationTime < now) {
-      pushAndReceive(createId(it->second.ip),
-                     std::make_unique<DiscoveryRemoveEvent>());
+      if (it->second.isAdded)
+        pushAndReceive(createId(it->second.ip),
+                       std::make_unique<DiscoveryRemoveEvent>());
       it = advertisements.erase(it);
     } else {
       ++it;
@@ -79,4 +201,151 @@ void SSDPDiscovery::getEvents() {
   }
 }
 
+void SSDPDiscovery::handleNotify(HTTPRequest& request, const std::string& ip) {
+  if (request.method != "NOTIFY")
+    return;
+
+  std::string serviceName = request.headers["NT"];
+  if (!searchTargets.contains(serviceName))
+    return;
+
+  // Remove camera on ssdp:byebye
+  if (request.headers["NTS"] == "ssdp:byebye") {
+    auto it = advertisements.find(ip);
+    if (it != advertisements.end()) {
+      bool wasAdded = it->second.isAdded;
+      advertisements.erase(it);
+      if (wasAdded)
+        pushAndReceive(createId(ip), std::make_unique<DiscoveryRemoveEvent>());
+    }
+    return;
+  } else if (request.headers["NTS"] != "ssdp:alive") {
+    return;
+  }
+
+  // Keep track of time and IP of advertisement
+  bool isNew = !advertisements.contains(ip);
+  SSDPAdvertisementData& advertisement = advertisements[ip];
+  advertisement.expirationTime = std::chrono::steady_clock::now();
+  advertisement.ip = ip;
+
+  // Hacky way to get Cache-Control seconds value
+  std::string durationStr = "";
+  size_t durationStart = request.headers["Cache-Control"].find("=");
+  if (durationStart != std::string::npos)
+    durationStr = request.headers["Cache-Control"].substr(durationStart + 1);
+
+  // Add max seconds value to expiration time
+  if (!durationStr.empty()) {
+    advertisement.expirationTime +=
+        std::chrono::seconds(std::stoi(durationStr));
+  }
+
+  if (!isNew)
+    return;
+
+  // New advertisement; request/parse DeviceDesc
+  std::string location = request.headers["Location"];
+  if (std::shared_ptr<Scheduler> scheduler = Scheduler::getActive()) {
+    {
+      std::lock_guard lock(fetchMutex);
+      fetchesInFlight++;
+    }
+    scheduler->spawn(fetchDevice(*scheduler, location, ip));
+    return;
+  }
+
+  std::unique_ptr<DiscoveryAddEvent> addEvent;
+  try {
+    std::unique_ptr<HTTPResponse> response = URL(location).request(tcpSocket);
+    addEvent = getDevice(*response, ip);
+  } catch (const std::exception& e) {
+    Logger::log("SSDP: Couldn't get the device description of %s: %s",
+                ip.c_str(), e.what());
+  }
+  addCamera(ip, std::move(addEvent));
+}
+
+Task<void> SSDPDiscovery::fetchDevice(Scheduler& scheduler,
+                                      std::string location,
+                                      std::string ip) {
+  // Counts down even if the scheduler destroys this task, so the destructor
+  // doesn't wait forever. Notifies before unlocking, as the destructor may
+  // return (destroying fetchDone) as soon as it sees the count reach zero.
+  struct FetchGuard {
+    SSDPDiscovery& ssdp;
+    ~FetchGuard() {
+      std::lock_guard lock(ssdp.fetchMutex);
+      ssdp.fetchesInFlight--;
+      ssdp.fetchDone.notify_all();
+    }
+  } fetchGuard{*this};
+
+  std::unique_ptr<DiscoveryAddEvent> addEvent;
+  try {
+    AsyncMutex::Lock tcpLock = co_await tcpMutex.lock(scheduler);
+    URL url(location);
+    std::unique_ptr<HTTPResponse> response =
+        co_await url.requestAsync(scheduler, tcpSocket);
+    addEvent = getDevice(*response, ip);
+  } catch (const std::exception& e) {
+    Logger::log("SSDP: Couldn't get the device description of %s: %s",
+                ip.c_str(), e.what());
+  }
+
+  {
+    std::lock_guard lock(fetchMutex);
+    fetched.emplace_back(ip, std::move(addEvent));
+  }
+  wakeReactor();
+}
+
+void SSDPDiscovery::wakeReactor() {
+  std::shared_ptr<Attachment> attached;
+  {
+    std::lock_guard lock(fetchMutex);
+    attached = attachment;
+  }
+  if (!attached)
+    return;
+
+  // Posting under the lock keeps the reactor from being posted to after
+  // detach(), when it may already be gone
+  std::lock_guard lock(attached->mutex);
+  if (!attached->isAttached)
+    return;
+  attached->reactor.post([attached]() {
+    std::lock_guard lock(attached->mutex);
+    if (attached->isAttached)
+      attached->handleEvents();
+  });
+}
+
+std::unique_ptr<DiscoveryAddEvent> SSDPDiscovery::getDevice(
+    const HTTPResponse& response,
+    const std::string& ip) {
+  XMLDoc deviceDesc;
+  deviceDesc.unpack(response.body);
+  const XMLElement& device = deviceDesc["device"];
+
+  return std::make_unique<DiscoveryAddEvent>(
+      static_cast<int>(DiscoveryMethod::SSDP), ip, device["serialNumber"],
+      device["manufacturer"], device["modelName"], device["friendlyName"]);
+}
+
+void SSDPDiscovery::addCamera(const std::string& ip,
+                              std::unique_ptr<DiscoveryAddEvent> addEvent) {
+  // It may have said byebye or expired in the meantime
+  auto it = advertisements.find(ip);
+  if (it == advertisements.end() || it->second.isAdded)
+    return;
+
+  if (!addEvent) {
+    advertisements.erase(it);
+    return;
+  }
+  it->second.isAdded = true;
+  pushAndReceive(createId(ip), std::move(addEvent));
+}
+
 }  // namespace cb
\ No newline at end of file
@@ -4,8 +4,11 @@
 #include <cb/discovery.h>
 #include <cb/logger.h>
 #include <cb/protocols/http.h>
+#include <cb/scheduler.h>
 
 #include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <set>
 
 namespace cb {
@@ -21,49 +24,128 @@ class SSDPSearchMessage : public HTTPRequest {
   }
 };
 
+// Checks whether a datagram is a NOTIFY whose NT header is one of
+// `searchTargets` without parsing it, so the flood of advertisements from
+// unrelated UPnP devices can be dropped cheaply
+bool isNotifyFor(const Buffer& datagram,
+                 const std::set<std::string>& searchTargets);
+
 struct SSDPAdvertisementData {
   std::chrono::steady_clock::time_point expirationTime;
   std::string ip;
+  // Set once the device description has been fetched and the camera added
+  bool isAdded = false;
 };
 
+// Device descriptions of new cameras are fetched on the active Scheduler if
+// there is one, so a slow camera doesn't hold up the reactor, or else right
+// away on the thread handling the advertisement
 class SSDPDiscovery : public DiscoveryService {
  public:
+  // Most datagrams received with one call
+  static const int BATCH_SIZE = 32;
+
+  // Listens and searches on each interface in `udpSockets`, keyed by the
+  // interface's IP address (see getInterfaceAddresses()). The key "" uses the
+  // default interface. Sockets that fail to join the group are dropped.
+  SSDPDiscovery(
+      std::map<std::string, std::unique_ptr<CameraProxy>>& cameras,
+      std::map<std::string, std::unique_ptr<UDPMulticastSocket>> udpSockets,
+      std::unique_ptr<TCPSocket> tcpSocket,
+      std::set<std::string> searchTargets,
+      std::array<uint8_t, 16> clientGuid,
+      std::string clientName);
+
+  // Listens and searches on the default interface only
   SSDPDiscovery(std::map<std::string, std::unique_ptr<CameraProxy>>& cameras,
                 std::unique_ptr<UDPMulticastSocket> udpSocket,
                 std::unique_ptr<TCPSocket> tcpSocket,
                 std::set<std::string> searchTargets,
                 std::array<uint8_t, 16> clientGuid,
                 std::string clientName)
-      : DiscoveryService(cameras, DiscoveryMethod::SSDP),
-        udpSocket(std::move(udpSocket)),
-        tcpSocket(std::move(tcpSocket)),
-        searchTargets(searchTargets),
-        clientGuid(clientGuid),
-        clientName(clientName) {
-    // TODO: Fix port binding and listen for UDP unicast responses
-    this->udpSocket->begin("239.255.255.250", 1900);
-    for (const std::string& searchTarget : searchTargets) {
-      SSDPSearchMessage(searchTarget).send(*this->udpSocket);
-    }
-  }
+      : SSDPDiscovery(cameras,
+                      defaultInterface(std::move(udpSocket)),
+                      std::move(tcpSocket),
+                      std::move(searchTargets),
+                      clientGuid,
+                      std::move(clientName)) {}
 
-  ~SSDPDiscovery() { udpSocket->close(); }
+  // Waits for device descriptions still being fetched
+  ~SSDPDiscovery();
+
+  // Options for the connections of cameras created from now on. The
+  // discovery sockets themselves are tuned before being passed in.
+  void setCameraOptions(const PTPIPOptions& options) {
+    cameraOptions = options;
+  }
 
   std::unique_ptr<CameraProxy> createCamera(
-      std::unique_ptr<DiscoveryAddEvent> addEvent) override;
+      const DiscoveryAddEvent& addEvent) override;
 
   std::unique_ptr<EventContainer> popEvent() override;
 
+  bool attach(Reactor& reactor, Reactor::Callback onEvents) override;
+  void detach() override;
+
  protected:
   void getEvents() override;
 
  private:
-  std::unique_ptr<UDPMulticastSocket> udpSocket;
+  static std::map<std::string, std::unique_ptr<UDPMulticastSocket>>
+  defaultInterface(std::unique_ptr<UDPMulticastSocket> udpSocket);
+
+  void handleNotify(HTTPRequest& request, const std::string& ip);
+  // Fetches the device description at `location` without blocking and hands
+  // the result to getEvents()
+  Task<void> fetchDevice(Scheduler& scheduler,
+                         std::string location,
+                         std::string ip);
+  std::unique_ptr<DiscoveryAddEvent> getDevice(const HTTPResponse& response,
+                                               const std::string& ip);
+  // Adds the camera at `ip` if it is still advertised. Without `addEvent`,
+  // as when its device description couldn't be fetched, the advertisement is
+  // dropped so that the next one tries again.
+  void addCamera(const std::string& ip,
+                 std::unique_ptr<DiscoveryAddEvent> addEvent);
+  // Has the reactor pick up finished fetches now rather than on the next
+  // expiry check
+  void wakeReactor();
+
+  std::map<std::string, std::unique_ptr<UDPMulticastSocket>> udpSockets;
   std::unique_ptr<TCPSocket> tcpSocket;
+  std::vector<Datagram> datagrams = std::vector<Datagram>(BATCH_SIZE);
   std::set<std::string> searchTargets;
   std::array<uint8_t, 16> clientGuid;
   std::string clientName;
+  PTPIPOptions cameraOptions;
+  // By the camera's IP address, which is also what its ID is made from, so
+  // every camera is tracked however many search targets it advertises
   std::map<std::string, SSDPAdvertisementData> advertisements;
+
+  Reactor* reactor = nullptr;
+  int expiryTimer = 0;
+
+  // What tasks posted by wakeReactor() call, shared with them as they may run
+  // after detach(). Recursive, since the callback may itself detach.
+  struct Attachment {
+    Attachment(Reactor& reactor, Reactor::Callback handleEvents)
+        : reactor(reactor), handleEvents(std::move(handleEvents)) {}
+
+    Reactor& reactor;
+    Reactor::Callback handleEvents;
+    std::recursive_mutex mutex;
+    bool isAttached = true;
+  };
+  std::shared_ptr<Attachment> attachment;
+
+  // Fetches take turns on tcpSocket
+  AsyncMutex tcpMutex;
+  // Guards `attachment` and what follows
+  std::mutex fetchMutex;
+  std::condition_variable fetchDone;
+  int fetchesInFlight = 0;
+  std::vector<std::pair<std::string, std::unique_ptr<DiscoveryAddEvent>>>
+      fetched;
 };
 
 }  // namespace cb
@@ -1,22 +1,43 @@
 #include <cb/protocols/tcp.h>
+#include <cb/scheduler.h>
 
 namespace cb {
 
+Task<bool> TCPSocket::connectAsync(Scheduler& scheduler,
+                                   const std::string& ip,
+                                   int port) {
+  co_await scheduler.schedule();
+  co_return connect(ip, port);
+}
+
 int TCPPacket::send(TCPSocket& socket) {
-  Buffer buffer = pack();
-  return socket.sendAttempt(buffer);
+  // Reused between sends so packing does not allocate once warmed up, except
+  // after unusually large packets, whose buffers are not worth holding on to
+  thread_local SegmentBuffer segments;
+  segments.clear();
+  packSegments(segments);
+  int result = socket.sendAttempt(segments);
+  if (segments.buffer.capacity() > MAX_RETAINED_BYTES)
+    segments = SegmentBuffer();
+  return result;
 }
 
 int TCPPacket::recv(TCPSocket& socket, Buffer& buffer, unsigned int timeoutMs) {
-  buffer.clear();
+  return socket.recvAttempt(*this, buffer, timeoutMs);
+}
 
-  socket.recvAttempt(buffer, timeoutMs, sizeof(uint32_t));
-  unpack(buffer);
+int TCPPacket::unpackSome(const Buffer& buffer) {
+  if (buffer.size() < sizeof(uint32_t))
+    return sizeof(uint32_t) - buffer.size();
 
-  socket.recvAttempt(buffer, timeoutMs, getLength() - sizeof(uint32_t));
-  unpack(buffer);
+  uint32_t length = 0;
+  int offset = 0;
+  Codec<uint32_t>::unpack(length, buffer, offset, std::nullopt);
+  if (buffer.size() < length)
+    return length - buffer.size();
 
-  return buffer.size();
+  unpack(buffer);
+  return 0;
 }
 
 }
\ No newline at end of file
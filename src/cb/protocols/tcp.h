@@ -5,20 +5,57 @@
 
 namespace cb {
 
-// TODO: Interface for setting options like KEEPALIVE and NODELAY
+struct TCPSocketOptions : SocketOptions {
+  // Longest a connect waits for the peer before giving up, so unreachable
+  // hosts fail quickly instead of after the OS's much longer default
+  unsigned int connectTimeoutMs = 10000;
+  // Sends small packets right away instead of coalescing them (Nagle)
+  bool noDelay = true;
+  // Acknowledges received data right away instead of delaying the ACK (Linux
+  // only). The kernel drops out of this mode on its own, so it is re-armed
+  // after every read.
+  bool quickAck = false;
+  bool keepAlive = true;
+  // Seconds idle before the first keepalive probe, seconds between probes, and
+  // unanswered probes before the connection is dropped
+  std::optional<int> keepAliveIdleS;
+  std::optional<int> keepAliveIntervalS;
+  std::optional<int> keepAliveCount;
+};
+
 class TCPSocket : public virtual Socket {
  public:
   virtual bool connect(const std::string& ip,
                        int port) = 0;  // Should not throw exceptions
   virtual bool isConnected() = 0;      // Should not throw exceptions
+  // Like connect(), but suspending on `scheduler` instead of blocking while
+  // the connection is set up. By default this holds a worker for the whole
+  // connect; sockets that can connect without blocking should override it.
+  virtual Task<bool> connectAsync(Scheduler& scheduler,
+                                  const std::string& ip,
+                                  int port);
+
+  // Options are applied on every connect, and right away if already
+  // connected. Returns false if any of them couldn't be applied or isn't
+  // supported on this platform.
+  virtual bool setOptions(
+      const TCPSocketOptions& options) = 0;  // Should not throw exceptions
 };
 
 class TCPPacket : public Packet, public Sendable<TCPSocket> {
  public:
+  using Packet::Packet;
+
+  // Largest packing buffer kept between sends
+  static const int MAX_RETAINED_BYTES = 64 * 1024;
+
   virtual int send(TCPSocket& socket) override;
   virtual int recv(TCPSocket& socket,
                    Buffer& buffer,
                    unsigned int timeoutMs = 10000) override;
+
+  // Waits for the length prefix, then unpacks once the whole packet is in
+  int unpackSome(const Buffer& buffer) override;
 };
 
 }  // namespace cb
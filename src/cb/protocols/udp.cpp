@@ -0,0 +1,18 @@
+#include <cb/protocols/udp.h>
+
+namespace cb {
+
+int UDPMulticastSocket::recvBatch(std::span<Datagram> datagrams) {
+  int count = 0;
+  for (Datagram& datagram : datagrams) {
+    datagram.data.clear();
+    if (recv(datagram.data, 0) <= 0)
+      break;
+    datagram.remoteIp = getRemoteIp();
+    datagram.remotePort = getRemotePort();
+    count++;
+  }
+  return count;
+}
+
+}  // namespace cb
@@ -5,14 +5,37 @@
 
 namespace cb {
 
+// A datagram received by UDPMulticastSocket::recvBatch()
+struct Datagram {
+  Buffer data;
+  std::string remoteIp;
+  int remotePort = 0;
+};
+
 class UDPMulticastSocket : public virtual Socket {
  public:
+  // Joins the multicast group `ip` and sends to it, on the interface with the
+  // address `interfaceIp`, or on the default one if it is empty
   virtual bool begin(const std::string& ip,
-                     int port) = 0;  // Should not throw exceptions
+                     int port,
+                     const std::string& interfaceIp =
+                         "") = 0;  // Should not throw exceptions
+  // Options are applied on every begin, and right away if already begun.
+  // Returns false if any of them couldn't be applied or isn't supported on
+  // this platform.
+  virtual bool setOptions(
+      const SocketOptions& options) = 0;  // Should not throw exceptions
   virtual std::string getRemoteIp() const = 0;
   virtual int getRemotePort() const = 0;
+
+  // Receives the datagrams already queued, up to `datagrams.size()` of them,
+  // without waiting. Their buffers are reused, so receiving doesn't allocate
+  // once warmed up. Returns how many were received. By default this receives
+  // them one at a time.
+  virtual int recvBatch(
+      std::span<Datagram> datagrams);  // Should not throw exceptions
 };
 
 }  // namespace cb
 
-#endif
\ No newline at end of file
+#endif
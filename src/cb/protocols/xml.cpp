@@ -11,13 +11,18 @@ void XMLText::pack(Buffer& buffer, int& offset) {
 void XMLText::unpack(const Buffer& buffer,
                      int& offset,
                      std::optional<int> limitOffset) {
+  static const ByteScanner tagScanner("<");
+
   int limit = getUnpackLimit(buffer.size(), limitOffset);
-  char c;
-  text.clear();
-  while (offset < limit && buffer[offset] != '<') {
-    packer.unpack(c, buffer, offset, limitOffset);
-    text.push_back(c);
+  if (offset >= limit) {
+    text.clear();
+    return;
   }
+  int next =
+      tagScanner.find(buffer.data() + offset, buffer.data() + limit) -
+      buffer.data();
+  text.assign(buffer.begin() + offset, buffer.begin() + next);
+  offset = next;
 }
 
 const XMLElement XMLElement::notFound;
@@ -41,6 +46,25 @@ void XMLElement::pack(Buffer& buffer, int& offset) {
   endPacker.pack(name, buffer, offset);
 }
 
+int XMLElement::packedSize() {
+  int size = namePacker.packedSize(name);
+
+  for (auto& [name, value] : attributes) {
+    std::string temp = name;  // TODO: Remove this when I fix const correctness
+    size += attributeNamePacker.packedSize(temp);
+    size += attributeValuePacker.packedSize(value);
+  }
+
+  std::string close = "";
+  size += closePacker.packedSize(close);
+
+  for (auto& child : children) {
+    size += child->packedSize();
+  }
+
+  return size + endPacker.packedSize(name);
+}
+
 void XMLElement::unpack(const Buffer& buffer,
                         int& offset,
                         std::optional<int> limitOffset) {
@@ -123,6 +147,13 @@ void XMLDoc::pack(Buffer& buffer, int& offset) {
   XMLElement::pack(buffer, offset);
 }
 
+int XMLDoc::packedSize() {
+  int size = XMLElement::packedSize();
+  if (!declaration.empty())
+    size += Packet::packedSize();
+  return size;
+}
+
 void XMLDoc::unpack(const Buffer& buffer,
                     int& offset,
                     std::optional<int> limitOffset) {
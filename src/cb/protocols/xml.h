@@ -15,6 +15,7 @@ class XMLNode : public Packet {
   virtual void unpack(const Buffer& buffer,
                       int& offset,
                       std::optional<int> limitOffset) override = 0;
+  virtual int packedSize() override = 0;
 };
 
 class XMLText : public XMLNode {
@@ -25,6 +26,7 @@ class XMLText : public XMLNode {
   void unpack(const Buffer& buffer,
               int& offset,
               std::optional<int> limitOffset) override;
+  int packedSize() override { return text.size(); }
 
  private:
   Primitive<char> packer;
@@ -38,22 +40,11 @@ class XMLElement : public XMLNode {
 
   static const XMLElement notFound;
 
-  XMLElement()
-      : namePacker({"<"},
-                   {" ", "\r", "\n", "\t", ">", "/>"},
-                   XML_WHITESPACE,
-                   false,
-                   true,
-                   true),
-        attributeNamePacker({}, {"="}, XML_WHITESPACE),
-        attributeValuePacker({"\"", "'"}, {"\"", "'"}, XML_WHITESPACE, true),
-        closePacker({}, {">"}, XML_WHITESPACE),
-        endPacker({"</"}, {">"}, XML_WHITESPACE) {}
-
   virtual void pack(Buffer& buffer, int& offset) override;
   virtual void unpack(const Buffer& buffer,
                       int& offset,
                       std::optional<int> limitOffset) override;
+  virtual int packedSize() override;
 
   operator std::string() const;
 
@@ -64,12 +55,21 @@ class XMLElement : public XMLNode {
   }
 
  private:
-  Primitive<char> charPacker;
-  DelimitedString namePacker;
-  DelimitedString attributeNamePacker;
-  DelimitedString attributeValuePacker;
-  DelimitedString closePacker;
-  DelimitedString endPacker;
+  // The packers hold no per-element state, so they are shared rather than
+  // constructed for every element of a document
+  static inline DelimitedString namePacker{{"<"},
+                                           {" ", "\r", "\n", "\t", ">", "/>"},
+                                           XML_WHITESPACE,
+                                           false,
+                                           true,
+                                           true};
+  static inline DelimitedString attributeNamePacker{{}, {"="}, XML_WHITESPACE};
+  static inline DelimitedString attributeValuePacker{{"\"", "'"},
+                                                     {"\"", "'"},
+                                                     XML_WHITESPACE,
+                                                     true};
+  static inline DelimitedString closePacker{{}, {">"}, XML_WHITESPACE};
+  static inline DelimitedString endPacker{{"</"}, {">"}, XML_WHITESPACE};
 };
 
 class XMLDoc : public XMLElement {
@@ -81,10 +81,15 @@ class XMLDoc : public XMLElement {
 
   XMLDoc() { field(this->declaration, {"<?xml"}, {"?>"}, XML_WHITESPACE); }
 
+  // The declaration field refers to this document's member (see Packet)
+  XMLDoc(const XMLDoc&) = delete;
+  XMLDoc& operator=(const XMLDoc&) = delete;
+
   void pack(Buffer& buffer, int& offset) override;
   void unpack(const Buffer& buffer,
               int& offset,
               std::optional<int> limitOffset) override;
+  int packedSize() override;
 };
 
 }  // namespace cb
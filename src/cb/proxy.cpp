@@ -1,5 +1,8 @@
 #include <cb/proxy.h>
 
+#include <cb/dispatch.h>
+#include <cb/logger.h>
+
 namespace cb {
 
 void CameraProxy::sendEvent(std::unique_ptr<EventPacket> event) {
@@ -25,6 +28,7 @@ void CameraProxy::setProp(CameraProp prop, CameraPropValue value) {
 }
 
 void CameraWrapper::getEvents() {
+  finishCreation();
   if (!camera)
     return;
   while (std::unique_ptr<EventPacket> event = camera->popEvent()) {
@@ -33,9 +37,13 @@ void CameraWrapper::getEvents() {
 }
 
 void CameraWrapper::pushCameraEvent(std::unique_ptr<EventPacket> event) {
-  const Buffer eventBuffer = event->pack();
+  using PropDispatch = PacketDispatch<EventPacket, SetPropEvent>;
+
+  Buffer eventBuffer = event->pack();
 
-  if (auto setPropEvent = EventPacket::unpackAs<SetPropEvent>(eventBuffer)) {
+  PropDispatch::Result packet;
+  PropDispatch::unpack(eventBuffer, packet);
+  if (auto setPropEvent = std::get_if<SetPropEvent>(&packet)) {
     const CameraProp prop = static_cast<CameraProp>(setPropEvent->propCode);
     const CameraPropValue value(setPropEvent->valueNumerator,
                                 setPropEvent->valueDenominator);
@@ -58,17 +66,34 @@ std::unique_ptr<EventContainer> CameraWrapper::popEvent() {
 }
 
 void CameraWrapper::handleEvent(const Buffer& event) {
+  using ActionDispatch =
+      PacketDispatch<EventPacket, ConnectEvent, CaptureEvent, SetPropEvent>;
+
   getEvents();
+
+  ActionDispatch::Result packet;
+  ActionDispatch::unpack(event, packet);
+
   // TODO: Check state to see if action is needed
-  if (auto connectEvent = EventPacket::unpackAs<ConnectEvent>(event)) {
+  if (auto connectEvent = std::get_if<ConnectEvent>(&packet)) {
     if (connectEvent->isConnected) {
-      // Attempt to connect camera
-      if (!camera)
+      // Attempt to connect camera, which finishes in getEvents() if it is
+      // created on the scheduler
+      if (camera) {
+        camera->connect();
+      } else if (creation) {
+        return;
+      } else if (std::shared_ptr<Scheduler> scheduler =
+                     Scheduler::getActive()) {
+        creation = std::make_shared<Creation>();
+        scheduler->spawn(createCamera(*scheduler, cameraFactory, creation));
+      } else {
         camera = cameraFactory->create();
-      if (camera)
         camera->connect();
+      }
     } else {
-      // Attempt to disconnect camera
+      // Attempt to disconnect camera, dropping one still being created
+      creation = nullptr;
       if (camera)
         camera->disconnect();
       else
@@ -77,9 +102,9 @@ void CameraWrapper::handleEvent(const Buffer& event) {
   } else if (!camera) {
     // Camera is required for other actions; push disconnect event if nullptr
     pushCameraEvent<ConnectEvent>(false);
-  } else if (EventPacket::unpackAs<CaptureEvent>(event)) {
+  } else if (std::holds_alternative<CaptureEvent>(packet)) {
     camera->capture();
-  } else if (auto setPropEvent = EventPacket::unpackAs<SetPropEvent>(event)) {
+  } else if (auto setPropEvent = std::get_if<SetPropEvent>(&packet)) {
     const CameraProp prop = static_cast<CameraProp>(setPropEvent->propCode);
     const CameraPropValue value(setPropEvent->valueNumerator,
                                 setPropEvent->valueDenominator);
@@ -90,6 +115,51 @@ void CameraWrapper::handleEvent(const Buffer& event) {
   }
 }
 
+Task<void> CameraWrapper::createCamera(
+    Scheduler& scheduler,
+    std::shared_ptr<PTPCameraFactory> factory,
+    std::shared_ptr<Creation> creation) {
+  std::unique_ptr<EventCamera> camera;
+  std::optional<Exception> exception;
+  try {
+    camera = co_await factory->createAsync(scheduler);
+  } catch (const Exception& e) {
+    exception.emplace(e);
+  } catch (const std::exception& e) {
+    Logger::log("Camera bring-up failed: %s", e.what());
+    exception.emplace(ExceptionContext::CameraConnect,
+                      ExceptionType::ConnectFailure);
+  }
+
+  std::lock_guard lock(creation->mutex);
+  creation->camera = std::move(camera);
+  if (exception)
+    creation->exception.emplace(*exception);
+  creation->isDone = true;
+}
+
+void CameraWrapper::finishCreation() {
+  if (!creation)
+    return;
+  {
+    std::lock_guard lock(creation->mutex);
+    if (!creation->isDone)
+      return;
+  }
+  std::shared_ptr<Creation> created = std::move(creation);
+  if (created->exception) {
+    pushCameraEvent(std::make_unique<ExceptionEvent>(*created->exception));
+    return;
+  }
+
+  camera = std::move(created->camera);
+  try {
+    camera->connect();
+  } catch (Exception& e) {
+    pushCameraEvent(std::make_unique<ExceptionEvent>(e));
+  }
+}
+
 void CameraWrapper::receiveEvent(std::unique_ptr<EventContainer> container) {
   if (container->id != id)
     return;
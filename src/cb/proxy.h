@@ -6,6 +6,8 @@
 #include <cb/factory.h>
 
 #include <map>
+#include <mutex>
+#include <optional>
 
 namespace cb {
 
@@ -23,15 +25,23 @@ class CameraProxy : public Camera, public EventProxy<EventContainer> {
   void sendEvent(std::unique_ptr<EventPacket> event);
 };
 
+// Connecting creates the camera on the active Scheduler if there is one, so
+// an unreachable camera doesn't hold up the thread handling events until its
+// connect deadline. The camera is then connected and its events start flowing
+// from the next popEvent().
 class CameraWrapper : public CameraProxy {
  public:
   CameraWrapper(std::array<uint8_t, 16> clientGuid,
                 std::string clientName,
                 std::string ip,
-                int port = 15740)
-      : cameraFactory(std::make_unique<PTPCameraFactory>(
-            std::make_unique<PTPIPFactory>(clientGuid, clientName, ip, port))) {
-  }
+                int port = 15740,
+                PTPIPOptions options = {})
+      : cameraFactory(std::make_shared<PTPCameraFactory>(
+            std::make_unique<PTPIPFactory>(clientGuid,
+                                           clientName,
+                                           ip,
+                                           port,
+                                           options))) {}
 
   std::unique_ptr<EventContainer> popEvent() override;
   void receiveEvent(std::unique_ptr<EventContainer> event) override;
@@ -40,8 +50,19 @@ class CameraWrapper : public CameraProxy {
   void getEvents() override;
 
  private:
-  std::unique_ptr<Factory<EventCamera>> cameraFactory;
+  // Where a camera created on the scheduler is left for getEvents(). Shared
+  // with the task creating it, which may outlive the wrapper.
+  struct Creation {
+    std::mutex mutex;
+    bool isDone = false;
+    std::unique_ptr<EventCamera> camera;
+    std::optional<Exception> exception;
+  };
+
+  std::shared_ptr<PTPCameraFactory> cameraFactory;
   std::unique_ptr<EventCamera> camera;
+  // Set while a camera is being created on the scheduler
+  std::shared_ptr<Creation> creation;
 
   std::unique_ptr<EventContainer> eventContainer;
 
@@ -57,6 +78,12 @@ class CameraWrapper : public CameraProxy {
   }
 
   void handleEvent(const Buffer& event);
+
+  static Task<void> createCamera(Scheduler& scheduler,
+                                 std::shared_ptr<PTPCameraFactory> factory,
+                                 std::shared_ptr<Creation> creation);
+  // Connects the camera once its creation has finished
+  void finishCreation();
 };
 
 }  // namespace cb
@@ -1,57 +1,150 @@
 #include <cb/ptp/ip.h>
 #include <cb/ptp/ipData.h>
 
+#include <cb/dispatch.h>
 #include <cb/logger.h>
 
+#include <algorithm>
+
 namespace cb {
 
 // TODO: Formal logging
 
+namespace {
+
+// Most payload reserved before it has arrived, so that a bogus length from the
+// camera can't force a huge allocation. Longer payloads grow as they arrive.
+constexpr uint64_t MAX_PAYLOAD_RESERVE = 8 << 20;
+
+template <typename T>
+using InitAckDispatch = PacketDispatch<IPPacket, T, InitFail>;
+
+// Unpacks the acknowledgement of an init request into `packet`, throwing if
+// the camera refused or sent something else
+template <typename T>
+T& unpackInitAck(const Buffer& response,
+                 typename InitAckDispatch<T>::Result& packet) {
+  InitAckDispatch<T>::unpack(response, packet);
+  if (std::holds_alternative<InitFail>(packet))
+    throw Exception(ExceptionContext::PTPIPConnect, ExceptionType::InitFailure);
+  if (!std::holds_alternative<T>(packet))
+    throw Exception(ExceptionContext::PTPIPConnect,
+                    ExceptionType::UnexpectedPacket);
+  return std::get<T>(packet);
+}
+
+void checkConnected(bool isConnected) {
+  if (!isConnected)
+    throw Exception(ExceptionContext::PTPIPConnect,
+                    ExceptionType::ConnectFailure);
+}
+
+}  // namespace
+
 void PTPIP::open() {
   if (isOpen())
     return;
 
-  if (!commandSocket->connect(ip, port))
-    throw Exception(ExceptionContext::PTPIPConnect,
-                    ExceptionType::ConnectFailure);
+  checkConnected(commandSocket->connect(ip, port));
 
   Buffer response;
 
   InitCommandRequest(clientGuid, clientName).send(*commandSocket);
   IPPacket().recv(*commandSocket, response, 60000);
-  auto initCmdAck = IPPacket::unpackAs<InitCommandAck>(response);
+  InitAckDispatch<InitCommandAck>::Result initCmdPacket;
+  InitCommandAck& initCmdAck =
+      unpackInitAck<InitCommandAck>(response, initCmdPacket);
 
-  if (!initCmdAck) {
-    // TODO: Move to helper function to avoid duplication?
-    if (auto initFail = IPPacket::unpackAs<InitFail>(response))
-      throw Exception(ExceptionContext::PTPIPConnect,
-                      ExceptionType::InitFailure);
-    throw Exception(ExceptionContext::PTPIPConnect,
-                    ExceptionType::UnexpectedPacket);
-  }
+  guid = initCmdAck.guid;
+  name = initCmdAck.name;
 
-  guid = initCmdAck->guid;
-  name = initCmdAck->name;
+  checkConnected(eventSocket->connect(ip, port));
 
-  if (!eventSocket->connect(ip, port))
-    throw Exception(ExceptionContext::PTPIPConnect,
-                    ExceptionType::ConnectFailure);
-
-  InitEventRequest(initCmdAck->connectionNum).send(*eventSocket);
+  InitEventRequest(initCmdAck.connectionNum).send(*eventSocket);
   IPPacket().recv(*eventSocket, response);
-  auto initEvtAck = IPPacket::unpackAs<InitEventAck>(response);
+  InitAckDispatch<InitEventAck>::Result initEventPacket;
+  unpackInitAck<InitEventAck>(response, initEventPacket);
+}
 
-  if (!initEvtAck) {
-    // TODO: Move to helper function to avoid duplication?
-    if (auto initFail = IPPacket::unpackAs<InitFail>(response))
-      throw Exception(ExceptionContext::PTPIPConnect,
-                      ExceptionType::InitFailure);
-    throw Exception(ExceptionContext::PTPIPConnect,
-                    ExceptionType::UnexpectedPacket);
-  }
+Task<void> PTPIP::openAsync(Scheduler& scheduler) {
+  if (isOpen())
+    co_return;
+
+  bool isConnected = co_await commandSocket->connectAsync(scheduler, ip, port);
+  checkConnected(isConnected);
+
+  Buffer response;
+  IPPacket packet;
+
+  InitCommandRequest(clientGuid, clientName).send(*commandSocket);
+  co_await commandSocket->recvAttemptAsync(scheduler, packet, response, 60000);
+  InitAckDispatch<InitCommandAck>::Result initCmdPacket;
+  InitCommandAck& initCmdAck =
+      unpackInitAck<InitCommandAck>(response, initCmdPacket);
+
+  guid = initCmdAck.guid;
+  name = initCmdAck.name;
+
+  isConnected = co_await eventSocket->connectAsync(scheduler, ip, port);
+  checkConnected(isConnected);
+
+  InitEventRequest(initCmdAck.connectionNum).send(*eventSocket);
+  co_await eventSocket->recvAttemptAsync(scheduler, packet, response, 10000);
+  InitAckDispatch<InitEventAck>::Result initEventPacket;
+  unpackInitAck<InitEventAck>(response, initEventPacket);
 }
 
 OperationResponseData PTPIP::transaction(const OperationRequestData& request) {
+  sendRequest(request);
+
+  Buffer payload;
+  uint64_t totalDataLength = 0;
+  ResponseDispatch::Result packet;
+  while (true) {
+    recvResponse(responseBuffer, payload);
+    if (handleResponse(packet, payload, totalDataLength)) {
+      auto& opRes = std::get<OperationResponse>(packet);
+      return OperationResponseData(opRes.responseCode, opRes.params,
+                                   std::move(payload));
+    }
+  }
+}
+
+Task<OperationResponseData> PTPIP::transactionAsync(
+    Scheduler& scheduler,
+    const OperationRequestData& request) {
+  co_await sendRequestAsync(scheduler, request);
+
+  Buffer payload;
+  uint64_t totalDataLength = 0;
+  ResponseDispatch::Result packet;
+  while (true) {
+    co_await recvResponseAsync(scheduler, responseBuffer, payload);
+    if (handleResponse(packet, payload, totalDataLength)) {
+      auto& opRes = std::get<OperationResponse>(packet);
+      co_return OperationResponseData(opRes.responseCode, opRes.params,
+                                      std::move(payload));
+    }
+  }
+}
+
+void PTPIP::sendRequest(const OperationRequestData& request) {
+  bool isSending = prepareRequest(request);
+  operationRequest.send(*commandSocket);
+  if (isSending)
+    sendData(request);
+}
+
+Task<void> PTPIP::sendRequestAsync(Scheduler& scheduler,
+                                   const OperationRequestData& request) {
+  bool isSending = prepareRequest(request);
+  co_await operationRequest.sendAsync(scheduler, *commandSocket);
+  // Outgoing data phases are only property changes, so they are sent here
+  if (isSending)
+    sendData(request);
+}
+
+bool PTPIP::prepareRequest(const OperationRequestData& request) {
   Logger::log(
       "PTPIP Operation Request (operationCode=0x%04x, transactionId=%d, "
       "param1=0x%04x, dataPhase=%d, sending=%d)",
@@ -61,46 +154,111 @@ OperationResponseData PTPIP::transaction(const OperationRequestData& request) {
   DataPhaseInfo dataPhaseInfo = (request.dataPhase && request.sending)
                                     ? DataPhaseInfo::DataOut
                                     : DataPhaseInfo::DataIn;
-  OperationRequest(static_cast<uint32_t>(dataPhaseInfo), request.operationCode,
-                   request.transactionId, request.params)
-      .send(*commandSocket);
+  operationRequest.set<&OperationRequest::dataPhase>(
+      static_cast<uint32_t>(dataPhaseInfo));
+  operationRequest.set<&OperationRequest::operationCode>(request.operationCode);
+  operationRequest.set<&OperationRequest::transactionId>(request.transactionId);
+  operationRequest.set<&OperationRequest::params>(request.params);
+  return dataPhaseInfo == DataPhaseInfo::DataOut;
+}
 
-  if (dataPhaseInfo == DataPhaseInfo::DataOut) {
-    StartData(request.transactionId, request.data.size()).send(*commandSocket);
+void PTPIP::sendData(const OperationRequestData& request) {
+  StartData(request.transactionId, request.data.size()).send(*commandSocket);
+  EndDataView(request.transactionId, request.data).send(*commandSocket);
+}
 
-    // TODO: Avoid copying request.data?
-    EndData(request.transactionId, request.data).send(*commandSocket);
-  }
+bool PTPIP::handleResponse(ResponseDispatch::Result& packet,
+                           Buffer& payload,
+                           uint64_t& totalDataLength) {
+  ResponseDispatch::unpack(responseBuffer, packet);
 
-  Buffer payload;
-  uint64_t totalDataLength = 0;
-  while (true) {
-    Buffer response;
-    IPPacket().recv(*commandSocket, response);
-
-    // TODO: Validate transactionId?
-    if (auto opRes = IPPacket::unpackAs<OperationResponse>(response)) {
-      Logger::log("> Operation Response (responseCode=0x%04x)",
-                  opRes->responseCode);
-      if (payload.size() != totalDataLength)
-        throw Exception(ExceptionContext::PTPIPTransaction,
-                        ExceptionType::WrongDataLength);
-      return OperationResponseData(opRes->responseCode, opRes->params, payload);
-    } else if (auto startData = IPPacket::unpackAs<StartData>(response)) {
-      Logger::log("> Start Data (totalDataLength=%d)",
-                  startData->totalDataLength);
-      totalDataLength = startData->totalDataLength;
-    } else if (auto data = IPPacket::unpackAs<Data>(response)) {
-      Logger::log("> Data (payload.size()=%d)", data->payload.size());
-      payload.insert(payload.end(), data->payload.begin(), data->payload.end());
-    } else if (auto endData = IPPacket::unpackAs<EndData>(response)) {
-      Logger::log("> End Data (payload.size()=%d)", endData->payload.size());
-      payload.insert(payload.end(), endData->payload.begin(),
-                     endData->payload.end());
-    } else {
+  // TODO: Validate transactionId?
+  if (auto opRes = std::get_if<OperationResponse>(&packet)) {
+    Logger::log("> Operation Response (responseCode=0x%04x)",
+                opRes->responseCode);
+    if (payload.size() != totalDataLength)
       throw Exception(ExceptionContext::PTPIPTransaction,
-                      ExceptionType::UnexpectedPacket);
+                      ExceptionType::WrongDataLength);
+    return true;
+  } else if (auto startData = std::get_if<StartData>(&packet)) {
+    Logger::log("> Start Data (totalDataLength=%d)",
+                startData->totalDataLength);
+    totalDataLength = startData->totalDataLength;
+    // Unknown lengths are sent as all ones, so those are not reserved
+    if (totalDataLength < UINT32_MAX)
+      payload.reserve(std::min(totalDataLength, MAX_PAYLOAD_RESERVE));
+  } else if (auto data = std::get_if<DataView>(&packet)) {
+    Logger::log("> Data (payload.size()=%d)",
+                data->length - responseBuffer.size());
+  } else if (auto endData = std::get_if<EndDataView>(&packet)) {
+    Logger::log("> End Data (payload.size()=%d)",
+                endData->length - responseBuffer.size());
+  } else {
+    throw Exception(ExceptionContext::PTPIPTransaction,
+                    ExceptionType::UnexpectedPacket);
+  }
+  return false;
+}
+
+// Receives the next packet on the command socket into `response`. The payload
+// of Data and EndData packets is received straight onto the end of `payload`
+// rather than into `response`, so it is never copied out of a packet buffer.
+void PTPIP::recvResponse(Buffer& response, Buffer& payload) {
+  response.clear();
+  commandSocket->recvAttempt(response, 10000, IPPacket::HEADER_SIZE);
+
+  IPPacket header;
+  header.unpack(response);
+  if (header.length < IPPacket::HEADER_SIZE)
+    throw Exception(ExceptionContext::PTPIPTransaction,
+                    ExceptionType::UnexpectedPacket);
+
+  int remaining = header.length - IPPacket::HEADER_SIZE;
+  bool isData = header.packetType == DataView().packetType ||
+                header.packetType == EndDataView().packetType;
+  if (isData && remaining >= sizeof(uint32_t)) {
+    // Only the transaction ID goes into the response; the payload view of the
+    // unpacked packet is then empty
+    commandSocket->recvAttempt(response, 10000, sizeof(uint32_t));
+    remaining -= sizeof(uint32_t);
+    // recv() reserves what it is asked for, so the payload is asked for in
+    // pieces no larger than may be reserved
+    while (remaining > 0) {
+      int length = std::min<int>(remaining, MAX_PAYLOAD_RESERVE);
+      commandSocket->recvAttempt(payload, 10000, length);
+      remaining -= length;
     }
+  } else if (remaining > 0) {
+    commandSocket->recvAttempt(response, 10000, remaining);
+  }
+}
+
+Task<void> PTPIP::recvResponseAsync(Scheduler& scheduler,
+                                    Buffer& response,
+                                    Buffer& payload) {
+  response.clear();
+  co_await commandSocket->recvAttemptAsync(scheduler, response, 10000,
+                                           IPPacket::HEADER_SIZE);
+
+  IPPacket header;
+  header.unpack(response);
+  if (header.length < IPPacket::HEADER_SIZE)
+    throw Exception(ExceptionContext::PTPIPTransaction,
+                    ExceptionType::UnexpectedPacket);
+
+  int remaining = header.length - IPPacket::HEADER_SIZE;
+  bool isData = header.packetType == DataView().packetType ||
+                header.packetType == EndDataView().packetType;
+  if (isData && remaining >= sizeof(uint32_t)) {
+    co_await commandSocket->recvAttemptAsync(scheduler, response, 10000,
+                                             sizeof(uint32_t));
+    remaining -= sizeof(uint32_t);
+    if (remaining > 0)
+      co_await commandSocket->recvAttemptAsync(scheduler, payload, 10000,
+                                               remaining);
+  } else if (remaining > 0) {
+    co_await commandSocket->recvAttemptAsync(scheduler, response, 10000,
+                                             remaining);
   }
 }
 
@@ -1,11 +1,23 @@
 #ifndef CB_CONTROL_PTP_IP_H
 #define CB_CONTROL_PTP_IP_H
 
+#include <cb/dispatch.h>
 #include <cb/protocols/tcp.h>
+#include <cb/ptp/ipData.h>
 #include <cb/ptp/ptp.h>
+#include <cb/template.h>
 
 namespace cb {
 
+// Socket options for the two connections of a PTP/IP session. The command
+// connection carries data phases such as image downloads, so it may want large
+// buffers, while the event connection only carries small, latency-sensitive
+// packets.
+struct PTPIPOptions {
+  TCPSocketOptions command;
+  TCPSocketOptions event;
+};
+
 // TODO: Figure out where to catch and deal with exceptions
 class PTPIP : public PTPTransport {
  public:
@@ -28,6 +40,9 @@ class PTPIP : public PTPTransport {
   virtual ~PTPIP() { close(); }
 
   void open() override;
+  // Connects and initializes both connections without holding a thread, so
+  // many cameras can be brought up at once
+  Task<void> openAsync(Scheduler& scheduler) override;
 
   void close() override {
     commandSocket->close();
@@ -40,8 +55,38 @@ class PTPIP : public PTPTransport {
 
   OperationResponseData transaction(
       const OperationRequestData& request) override;
+  Task<OperationResponseData> transactionAsync(
+      Scheduler& scheduler,
+      const OperationRequestData& request) override;
+
+  // What each connection has done so far, e.g. to see whether a slow transfer
+  // is spent waiting on the camera
+  SocketMetrics getCommandMetrics() const {
+    return commandSocket->getMetrics();
+  }
+  SocketMetrics getEventMetrics() const { return eventSocket->getMetrics(); }
 
  private:
+  using ResponseDispatch = PacketDispatch<IPPacket, OperationResponse,
+                                          StartData, DataView, EndDataView>;
+
+  void sendRequest(const OperationRequestData& request);
+  Task<void> sendRequestAsync(Scheduler& scheduler,
+                              const OperationRequestData& request);
+  // Patches `request` into `operationRequest`, returning whether it has a
+  // data phase to send
+  bool prepareRequest(const OperationRequestData& request);
+  void sendData(const OperationRequestData& request);
+  void recvResponse(Buffer& response, Buffer& payload);
+  Task<void> recvResponseAsync(Scheduler& scheduler,
+                               Buffer& response,
+                               Buffer& payload);
+  // Handles the packet in `responseBuffer`, returning true once it is the
+  // OperationResponse that ends the transaction
+  bool handleResponse(ResponseDispatch::Result& packet,
+                      Buffer& payload,
+                      uint64_t& totalDataLength);
+
   std::unique_ptr<TCPSocket> commandSocket;
   std::unique_ptr<TCPSocket> eventSocket;
   const std::array<uint8_t, 16> clientGuid;
@@ -51,6 +96,11 @@ class PTPIP : public PTPTransport {
 
   std::array<uint8_t, 16> guid;
   std::string name;
+
+  // Kept between transactions so receiving responses does not allocate
+  Buffer responseBuffer;
+  // Every operation is requested with the same packet, only patched
+  PacketTemplate<OperationRequest> operationRequest;
 };
 
 }  // namespace cb
@@ -2,6 +2,8 @@
 #define CB_CONTROL_PTP_IPDATA_H
 
 #include <cb/protocols/tcp.h>
+#include <cb/pool.h>
+#include <cb/schema.h>
 
 namespace cb {
 
@@ -13,62 +15,61 @@ enum class DataPhaseInfo : uint32_t {
 
 /* PTP/IP Packets */
 
-class IPPacket : public TCPPacket {
+class IPPacket : public SchemaPacket<IPPacket, TCPPacket> {
  public:
+  static const int HEADER_SIZE = 8;
+
   uint32_t length = 0;
   uint32_t packetType = 0;
 
-  IPPacket(uint32_t packetType) : packetType(packetType) {
-    lengthField(this->length);
-    typeField(this->packetType);
-  }
-  IPPacket() : IPPacket(0) {}
+  using Schema = PacketSchema<LengthMember<&IPPacket::length>,
+                              TypeMember<&IPPacket::packetType>>;
 
-  template <typename T>
-    requires(std::derived_from<T, IPPacket>)
-  static std::unique_ptr<T> unpackAs(const Buffer& buffer) {
-    return Packet::unpackAs<IPPacket, T>(buffer);
-  }
+  IPPacket(uint32_t packetType) : packetType(packetType) {}
+  IPPacket() : IPPacket(0) {}
 };
 
-class InitCommandRequest : public IPPacket {
+class InitCommandRequest : public SchemaPacket<InitCommandRequest, IPPacket> {
  public:
   std::array<uint8_t, 16> guid = {};
   std::string name;
   uint32_t ptpVersion = 0x10000;
 
+  using Schema = IPPacket::Schema::Append<
+      Member<&InitCommandRequest::guid>,
+      Member<&InitCommandRequest::name>,
+      Member<&InitCommandRequest::ptpVersion>>;
+
   InitCommandRequest(std::array<uint8_t, 16> guid, std::string name)
-      : IPPacket(0x01), guid(guid), name(name) {
-    field(this->guid);
-    field(this->name);
-    field(this->ptpVersion);
-  }
+      : SchemaPacket(0x01), guid(guid), name(name) {}
   InitCommandRequest() : InitCommandRequest({}, "") {}
 };
 
-class InitCommandAck : public IPPacket {
+class InitCommandAck : public SchemaPacket<InitCommandAck, IPPacket> {
  public:
   uint32_t connectionNum = 0;
   std::array<uint8_t, 16> guid = {};
   std::string name;
   uint32_t ptpVersion = 0x10000;
 
-  InitCommandAck() : IPPacket(0x02) {
-    field(this->connectionNum);
-    field(this->guid);
-    field(this->name);
-    field(this->ptpVersion);
-  }
+  using Schema = IPPacket::Schema::Append<
+      Member<&InitCommandAck::connectionNum>,
+      Member<&InitCommandAck::guid>,
+      Member<&InitCommandAck::name>,
+      Member<&InitCommandAck::ptpVersion>>;
+
+  InitCommandAck() : SchemaPacket(0x02) {}
 };
 
-class InitEventRequest : public IPPacket {
+class InitEventRequest : public SchemaPacket<InitEventRequest, IPPacket> {
  public:
   uint32_t connectionNum = 0;
 
+  using Schema = IPPacket::Schema::Append<
+      Member<&InitEventRequest::connectionNum>>;
+
   InitEventRequest(uint32_t connectionNum)
-      : IPPacket(0x03), connectionNum(connectionNum) {
-    field(this->connectionNum);
-  }
+      : SchemaPacket(0x03), connectionNum(connectionNum) {}
   InitEventRequest() : InitEventRequest(0) {}
 };
 
@@ -77,110 +78,148 @@ class InitEventAck : public IPPacket {
   InitEventAck() : IPPacket(0x04) {}
 };
 
-class InitFail : public IPPacket {
+class InitFail : public SchemaPacket<InitFail, IPPacket> {
  public:
   uint32_t reason = 0;
 
-  InitFail() : IPPacket(0x05) { field(this->reason); }
+  using Schema = IPPacket::Schema::Append<Member<&InitFail::reason>>;
+
+  InitFail() : SchemaPacket(0x05) {}
 };
 
-class OperationRequest : public IPPacket {
+class OperationRequest : public SchemaPacket<OperationRequest, IPPacket>,
+                         public Pooled<OperationRequest> {
  public:
   uint32_t dataPhase = 0;
   uint16_t operationCode = 0;
   uint32_t transactionId = 0;
   std::array<uint32_t, 5> params = {};
 
+  using Schema = IPPacket::Schema::Append<
+      Member<&OperationRequest::dataPhase>,
+      Member<&OperationRequest::operationCode>,
+      Member<&OperationRequest::transactionId>,
+      Member<&OperationRequest::params>>;
+
   OperationRequest(uint32_t dataPhase,
                    uint16_t operationCode,
                    uint32_t transactionId,
                    std::array<uint32_t, 5> params)
-      : IPPacket(0x06),
+      : SchemaPacket(0x06),
         dataPhase(dataPhase),
         operationCode(operationCode),
         transactionId(transactionId),
-        params(params) {
-    field(this->dataPhase);
-    field(this->operationCode);
-    field(this->transactionId);
-    field(this->params);
-  }
+        params(params) {}
   OperationRequest() : OperationRequest(0, 0, 0, {}) {}
 };
 
-class OperationResponse : public IPPacket {
+class OperationResponse : public SchemaPacket<OperationResponse, IPPacket>,
+                          public Pooled<OperationResponse> {
  public:
   uint16_t responseCode = 0;
   uint32_t transactionId = 0;
   std::array<uint32_t, 5> params = {};
 
-  OperationResponse() : IPPacket(0x07) {
-    field(this->responseCode);
-    field(this->transactionId);
-    field(this->params);
-  }
+  using Schema = IPPacket::Schema::Append<
+      Member<&OperationResponse::responseCode>,
+      Member<&OperationResponse::transactionId>,
+      Member<&OperationResponse::params>>;
+
+  OperationResponse() : SchemaPacket(0x07) {}
 };
 
-class Event : public IPPacket {
+class Event : public SchemaPacket<Event, IPPacket> {
  public:
   uint16_t eventCode = 0;
   uint32_t transactionId = 0;
   std::array<uint32_t, 3> params = {};
 
-  Event() : IPPacket(0x08) {
-    field(this->eventCode);
-    field(this->transactionId);
-    field(this->params);
-  }
+  using Schema = IPPacket::Schema::Append<Member<&Event::eventCode>,
+                                          Member<&Event::transactionId>,
+                                          Member<&Event::params>>;
+
+  Event() : SchemaPacket(0x08) {}
 };
 
-class StartData : public IPPacket {
+class StartData : public SchemaPacket<StartData, IPPacket>,
+                  public Pooled<StartData> {
  public:
   uint32_t transactionId = 0;
   uint64_t totalDataLength = 0;
 
+  using Schema = IPPacket::Schema::Append<Member<&StartData::transactionId>,
+                                          Member<&StartData::totalDataLength>>;
+
   StartData(uint32_t transactionId, uint64_t totalDataLength)
-      : IPPacket(0x09),
+      : SchemaPacket(0x09),
         transactionId(transactionId),
-        totalDataLength(totalDataLength) {
-    field(this->transactionId);
-    field(this->totalDataLength);
-  }
+        totalDataLength(totalDataLength) {}
   StartData() : StartData(0, 0) {}
 };
 
-class Data : public IPPacket {
+class Data : public SchemaPacket<Data, IPPacket>, public Pooled<Data> {
  public:
   uint32_t transactionId = 0;
   Buffer payload;
 
-  Data() : IPPacket(0x0a) {
-    field(this->transactionId);
-    field(this->payload);
-  }
+  using Schema = IPPacket::Schema::Append<Member<&Data::transactionId>,
+                                          Member<&Data::payload>>;
+
+  Data() : SchemaPacket(0x0a) {}
 };
 
-class Cancel : public IPPacket {
+class Cancel : public SchemaPacket<Cancel, IPPacket> {
  public:
   uint32_t transactionId = 0;
 
-  Cancel() : IPPacket(0x0b) { field(this->transactionId); }
+  using Schema = IPPacket::Schema::Append<Member<&Cancel::transactionId>>;
+
+  Cancel() : SchemaPacket(0x0b) {}
 };
 
-class EndData : public IPPacket {
+class EndData : public SchemaPacket<EndData, IPPacket>, public Pooled<EndData> {
  public:
   uint32_t transactionId = 0;
   Buffer payload;
 
-  // TODO: Use move semantics for payload
+  using Schema = IPPacket::Schema::Append<Member<&EndData::transactionId>,
+                                          Member<&EndData::payload>>;
+
   EndData(uint32_t transactionId, Buffer payload)
-      : IPPacket(0x0c), transactionId(transactionId), payload(payload) {
-    field(this->transactionId);
-    field(this->payload);
-  }
+      : SchemaPacket(0x0c),
+        transactionId(transactionId),
+        payload(std::move(payload)) {}
   EndData() : EndData(0, {}) {}
 };
 
+// Data and EndData packets whose payload refers to an external buffer instead
+// of owning a copy. When unpacked, the payload points into the source buffer.
+class DataView : public SchemaPacket<DataView, IPPacket> {
+ public:
+  uint32_t transactionId = 0;
+  BufferView payload;
+
+  using Schema = IPPacket::Schema::Append<Member<&DataView::transactionId>,
+                                          Member<&DataView::payload>>;
+
+  DataView(uint32_t transactionId, BufferView payload)
+      : SchemaPacket(0x0a), transactionId(transactionId), payload(payload) {}
+  DataView() : DataView(0, {}) {}
+};
+
+class EndDataView : public SchemaPacket<EndDataView, IPPacket> {
+ public:
+  uint32_t transactionId = 0;
+  BufferView payload;
+
+  using Schema = IPPacket::Schema::Append<Member<&EndDataView::transactionId>,
+                                          Member<&EndDataView::payload>>;
+
+  EndDataView(uint32_t transactionId, BufferView payload)
+      : SchemaPacket(0x0c), transactionId(transactionId), payload(payload) {}
+  EndDataView() : EndDataView(0, {}) {}
+};
+
 class Ping : public IPPacket {
  public:
   Ping() : IPPacket(0x0d) {}
@@ -1,3 +1,4 @@
+#include <cb/logger.h>
 #include <cb/ptp/ptp.h>
 
 #if defined(ESP32)
@@ -6,12 +7,30 @@
 
 namespace cb {
 
+Task<void> PTPTransport::openAsync(Scheduler& scheduler) {
+  co_await scheduler.schedule();
+  open();
+}
+
+Task<OperationResponseData> PTPTransport::transactionAsync(
+    Scheduler& scheduler,
+    const OperationRequestData& request) {
+  co_await scheduler.schedule();
+  co_return transaction(request);
+}
+
 void PTP::openTransport() {
   if (!transport)
     throw Exception(ExceptionContext::PTPTransport, ExceptionType::IsNull);
   transport->open();
 }
 
+Task<void> PTP::openTransportAsync(Scheduler& scheduler) {
+  if (!transport)
+    throw Exception(ExceptionContext::PTPTransport, ExceptionType::IsNull);
+  co_await transport->openAsync(scheduler);
+}
+
 void PTP::closeTransport() {
   if (!transport)
     throw Exception(ExceptionContext::PTPTransport, ExceptionType::IsNull);
@@ -52,12 +71,21 @@ std::unique_ptr<DeviceInfo> PTP::getDeviceInfo() {
   return deviceInfo;
 }
 
+Task<std::unique_ptr<DeviceInfo>> PTP::getDeviceInfoAsync(
+    Scheduler& scheduler) {
+  OperationResponseData response =
+      co_await recvAsync(scheduler, OperationCode::GetDeviceInfo);
+  std::unique_ptr<DeviceInfo> deviceInfo = std::make_unique<DeviceInfo>();
+  deviceInfo->unpack(response.data);
+  co_return deviceInfo;
+}
+
 OperationResponseData PTP::transaction(bool dataPhase,
                                        bool sending,
                                        uint16_t operationCode,
                                        std::array<uint32_t, 5> params,
                                        std::vector<uint8_t> data) {
-  std::lock_guard lock(transactionMutex);
+  AsyncMutex::Lock lock = transactionMutex.lockBlocking();
 
   if (!transport)
     throw Exception(ExceptionContext::PTPTransport, ExceptionType::IsNull);
@@ -68,7 +96,7 @@ OperationResponseData PTP::transaction(bool dataPhase,
 
   OperationRequestData request(dataPhase, sending, operationCode,
                                getSessionId(), getTransactionId(), params,
-                               data);
+                               std::move(data));
 
   OperationResponseData response = transport->transaction(request);
   if (response.responseCode != ResponseCode::OK)
@@ -78,11 +106,39 @@ OperationResponseData PTP::transaction(bool dataPhase,
   return response;
 }
 
-// TODO: Avoid copying `data`?
+Task<OperationResponseData> PTP::transactionAsync(
+    Scheduler& scheduler,
+    bool dataPhase,
+    bool sending,
+    uint16_t operationCode,
+    std::array<uint32_t, 5> params,
+    std::vector<uint8_t> data) {
+  AsyncMutex::Lock lock = co_await transactionMutex.lock(scheduler);
+
+  if (!transport)
+    throw Exception(ExceptionContext::PTPTransport, ExceptionType::IsNull);
+
+  if (!isTransportOpen())
+    throw Exception(ExceptionContext::PTPTransport,
+                    ExceptionType::NotConnected);
+
+  OperationRequestData request(dataPhase, sending, operationCode,
+                               getSessionId(), getTransactionId(), params,
+                               std::move(data));
+
+  OperationResponseData response =
+      co_await transport->transactionAsync(scheduler, request);
+  if (response.responseCode != ResponseCode::OK)
+    throw Exception(ExceptionContext::PTPIPTransaction,
+                    ExceptionType::OperationFailure);
+
+  co_return std::move(response);
+}
+
 OperationResponseData PTP::send(uint16_t operationCode,
                                 std::array<uint32_t, 5> params,
                                 std::vector<uint8_t> data) {
-  return transaction(true, true, operationCode, params, data);
+  return transaction(true, true, operationCode, params, std::move(data));
 };
 
 OperationResponseData PTP::recv(uint16_t operationCode,
@@ -95,6 +151,26 @@ OperationResponseData PTP::mesg(uint16_t operationCode,
   return transaction(false, false, operationCode, params);
 };
 
+Task<OperationResponseData> PTP::sendAsync(Scheduler& scheduler,
+                                           uint16_t operationCode,
+                                           std::array<uint32_t, 5> params,
+                                           std::vector<uint8_t> data) {
+  return transactionAsync(scheduler, true, true, operationCode, params,
+                          std::move(data));
+}
+
+Task<OperationResponseData> PTP::recvAsync(Scheduler& scheduler,
+                                           uint16_t operationCode,
+                                           std::array<uint32_t, 5> params) {
+  return transactionAsync(scheduler, true, false, operationCode, params, {});
+}
+
+Task<OperationResponseData> PTP::mesgAsync(Scheduler& scheduler,
+                                           uint16_t operationCode,
+                                           std::array<uint32_t, 5> params) {
+  return transactionAsync(scheduler, false, false, operationCode, params, {});
+}
+
 void PTPCamera::connect() {
   openSession();
   pushEvent<ConnectEvent>(true);
@@ -106,38 +182,89 @@ void PTPCamera::disconnect() {
   pushEvent<ConnectEvent>(false);
 }
 
-void PTPCamera::startEventThread() {
+void PTPCamera::startEventPolling() {
+  isPollingStopped = false;
+
+  if (std::shared_ptr<Scheduler> scheduler = Scheduler::getActive()) {
+    isPollTaskRunning = true;
+    scheduler->spawn(pollEvents(*scheduler));
+    return;
+  }
+
+  // Returns false once polling should stop
+  auto poll = [this]() {
+    try {
+      if (!isTransportOpen()) {
+        pushEvent<ConnectEvent>(false);
+        return false;
+      }
+      getEvents();
+    } catch (const std::exception& e) {
+      reportPollFailure(e);
+    }
+    return true;
+  };
+
 #if defined(ESP32)
   esp_pthread_cfg_t cfg = esp_pthread_get_default_config();
   cfg.stack_size = (4096);
   esp_pthread_set_cfg(&cfg);
 #endif
 
-  eventThread = std::jthread([this](std::stop_token stoken) {
-    while (!stoken.stop_requested()) {
-      try {
-        if (!isTransportOpen()) {
-          pushEvent<ConnectEvent>(false);
-          break;
-        }
-        getEvents();
-      } catch (Exception& e) {
-        pushEvent(std::make_unique<ExceptionEvent>(e));
-      }
-
-      // TODO: Make this adjustable
-      std::this_thread::sleep_for(std::chrono::milliseconds(200));
-    }
+  eventThread = std::jthread([poll](std::stop_token stoken) {
+    while (!stoken.stop_requested() && poll())
+      std::this_thread::sleep_for(POLL_INTERVAL);
   });
 }
 
-void PTPCamera::stopEventThread() {
+void PTPCamera::stopEventPolling() {
+  isPollingStopped = true;
+  if (isPollTaskRunning) {
+    pollTaskDone.acquire();
+    isPollTaskRunning = false;
+  }
   if (eventThread.joinable()) {
     eventThread.request_stop();
     eventThread.join();
   }
 }
 
+void PTPCamera::reportPollFailure(const std::exception& e) {
+  if (auto exception = dynamic_cast<const Exception*>(&e))
+    pushEvent(std::make_unique<ExceptionEvent>(*exception));
+  else
+    Logger::log("Event poll failed: %s", e.what());
+}
+
+Task<void> PTPCamera::pollEvents(Scheduler& scheduler) {
+  struct DoneGuard {
+    std::binary_semaphore& done;
+    ~DoneGuard() { done.release(); }
+  } doneGuard{pollTaskDone};
+
+  // Polls are due at a fixed rate, however long each one takes, but ones
+  // that were missed entirely are skipped rather than run back to back
+  auto due = std::chrono::steady_clock::now();
+  while (!isPollingStopped) {
+    try {
+      if (!isTransportOpen()) {
+        pushEvent<ConnectEvent>(false);
+        co_return;
+      }
+      co_await getEventsAsync(scheduler);
+    } catch (const std::exception& e) {
+      reportPollFailure(e);
+    }
+
+    due += POLL_INTERVAL;
+    auto now = std::chrono::steady_clock::now();
+    if (due < now)
+      due = now;
+    co_await scheduler.sleepFor(
+        std::chrono::duration_cast<std::chrono::milliseconds>(due - now));
+  }
+}
+
 std::shared_ptr<DeviceInfo> PTPCamera::getCachedDI() {
   if (!cachedDI)
     cachedDI = getDeviceInfo();
@@ -3,8 +3,12 @@
 
 #include <cb/camera.h>
 #include <cb/ptp/ptpData.h>
+#include <cb/reactor.h>
+#include <cb/scheduler.h>
 
+#include <atomic>
 #include <mutex>
+#include <semaphore>
 #include <thread>
 #include <utility>
 
@@ -17,11 +21,21 @@ class PTPTransport {
   // TODO: Deal with events (event queue, pollEvents(), etc.)
 
   virtual void open() = 0;
+  // Opens the transport on `scheduler`. By default this holds a worker until
+  // it is open; transports that can wait for the camera without a thread
+  // should override it.
+  virtual Task<void> openAsync(Scheduler& scheduler);
   virtual void close() = 0;
   virtual bool isOpen() = 0;
 
   virtual OperationResponseData transaction(
       const OperationRequestData& request) = 0;
+  // Runs the transaction on `scheduler`. By default this holds a worker for
+  // the whole transaction; transports that can wait for the camera without a
+  // thread should override it.
+  virtual Task<OperationResponseData> transactionAsync(
+      Scheduler& scheduler,
+      const OperationRequestData& request);
 };
 
 class PTP {
@@ -43,6 +57,7 @@ class PTP {
   }
 
   void openTransport();
+  Task<void> openTransportAsync(Scheduler& scheduler);
   void closeTransport();
   bool isTransportOpen();
 
@@ -50,16 +65,20 @@ class PTP {
   virtual void closeSession();
 
   virtual std::unique_ptr<DeviceInfo> getDeviceInfo();
+  // Gets the standard DeviceInfo (without vendor additions), suspending on
+  // `scheduler` instead of blocking while waiting for the camera
+  Task<std::unique_ptr<DeviceInfo>> getDeviceInfoAsync(Scheduler& scheduler);
 
   template <typename T>
   std::unique_ptr<DevicePropDesc<T>> getDevicePropDesc(
       uint32_t devicePropCode) {
     Buffer data = recv(OperationCode::GetDevicePropDesc, {devicePropCode}).data;
-    if (auto devicePropDesc =
-            Packet::unpackAs<DevicePropDesc<T>, DevicePropDesc<T>>(data))
-      return devicePropDesc;
-    throw Exception(ExceptionContext::PTPDevicePropDesc,
-                    ExceptionType::WrongType);
+    auto devicePropDesc = std::make_unique<DevicePropDesc<T>>();
+    if (DevicePropDescHeader::peekType(data) != devicePropDesc->dataType)
+      throw Exception(ExceptionContext::PTPDevicePropDesc,
+                      ExceptionType::WrongType);
+    devicePropDesc->unpack(data);
+    return devicePropDesc;
   }
 
  protected:
@@ -74,10 +93,25 @@ class PTP {
   OperationResponseData mesg(uint16_t operationCode,
                              std::array<uint32_t, 5> params = {});
 
+  // Like send(), recv() and mesg(), but suspending on `scheduler` instead of
+  // blocking. Blocking and async transactions take turns on the transport.
+  Task<OperationResponseData> sendAsync(Scheduler& scheduler,
+                                        uint16_t operationCode,
+                                        std::array<uint32_t, 5> params = {},
+                                        std::vector<uint8_t> data = {});
+  Task<OperationResponseData> recvAsync(Scheduler& scheduler,
+                                        uint16_t operationCode,
+                                        std::array<uint32_t, 5> params = {});
+  Task<OperationResponseData> mesgAsync(Scheduler& scheduler,
+                                        uint16_t operationCode,
+                                        std::array<uint32_t, 5> params = {});
+
  private:
   uint32_t sessionId = 0;
   uint32_t transactionId = 0;
-  std::mutex transactionMutex;
+  // Held for the whole of a transaction, blocking or async, as they share the
+  // transport's request and response state
+  AsyncMutex transactionMutex;
   std::mutex sessionMutex;
 
   uint32_t getSessionId() { return isSessionOpen ? sessionId : 0; }
@@ -87,12 +121,19 @@ class PTP {
                                     uint16_t operationCode,
                                     std::array<uint32_t, 5> params = {},
                                     std::vector<uint8_t> data = {});
+  Task<OperationResponseData> transactionAsync(Scheduler& scheduler,
+                                               bool dataPhase,
+                                               bool sending,
+                                               uint16_t operationCode,
+                                               std::array<uint32_t, 5> params,
+                                               std::vector<uint8_t> data);
 };
 
 class PTPCamera : protected PTP, public EventCamera {
  public:
   PTPCamera(PTP&& ptp, VendorExtensionId vendorExtensionId)
       : PTP(std::move(ptp)), vendorExtensionId(vendorExtensionId) {}
+  ~PTPCamera() { stopEventPolling(); }
 
   void connect() override;
   void disconnect() override;
@@ -100,8 +141,16 @@ class PTPCamera : protected PTP, public EventCamera {
  protected:
   const VendorExtensionId vendorExtensionId;
 
-  void startEventThread();
-  void stopEventThread();
+  // Polls for events at a fixed rate with getEventsAsync() on the active
+  // scheduler, or with getEvents() on a thread of its own if there is none.
+  // Stopping waits for a poll in progress, and may take up to one interval.
+  void startEventPolling();
+  void stopEventPolling();
+
+  // Like getEvents(), but suspending on `scheduler` while waiting for the
+  // camera. Must not block, e.g. by calling the blocking transactions, as
+  // that would hold a worker the other cameras' polls need.
+  virtual Task<void> getEventsAsync(Scheduler& scheduler) = 0;
 
   std::shared_ptr<DeviceInfo> getCachedDI();
   void invalidateCachedDI();
@@ -109,8 +158,21 @@ class PTPCamera : protected PTP, public EventCamera {
   bool isPropSupported(uint16_t propertyCode);
 
  private:
+  // TODO: Make this adjustable
+  static constexpr std::chrono::milliseconds POLL_INTERVAL{200};
+
+  // Set while a polling task is running on a scheduler
+  bool isPollTaskRunning = false;
+  std::atomic<bool> isPollingStopped = false;
+  // Released when the polling task ends, including when its scheduler
+  // destroys it
+  std::binary_semaphore pollTaskDone{0};
   std::jthread eventThread;
   std::shared_ptr<DeviceInfo> cachedDI;
+
+  // Exceptions are passed on as events, and polling carries on
+  void reportPollFailure(const std::exception& e);
+  Task<void> pollEvents(Scheduler& scheduler);
 };
 
 }  // namespace cb
@@ -1,29 +1,63 @@
 #include <cb/ptp/ptpData.h>
+#include <cb/utf16.h>
 
 #include <algorithm>
 
 namespace cb {
 
-void PTPString::pack(Buffer& buffer, int& offset) {
-  if (string.length() > PTPString::MAX_CHARS)
-    string = string.substr(0, PTPString::MAX_CHARS);
-  numChars = string.length() + 1;
-  Packet::pack(buffer, offset);
+void PTPStringCodec::pack(std::string& value, Buffer& buffer, int& offset) {
+  // Strings can't have more UTF-16 units than bytes, so only long ones need to
+  // be measured
+  if (value.length() > PTPStringCodec::MAX_CHARS &&
+      utf16Length(value) > PTPStringCodec::MAX_CHARS)
+    value.resize(utf16Prefix(value, PTPStringCodec::MAX_CHARS));
+
+  // The count is patched in once the string has been converted
+  int countOffset = offset;
+  uint8_t numChars = 0;
+  Codec<uint8_t>::pack(numChars, buffer, offset);
+  int stringOffset = offset;
+  Codec<std::string>::pack(value, buffer, offset);
+  numChars = (offset - stringOffset) / sizeof(uint16_t);
+  Codec<uint8_t>::pack(numChars, buffer, countOffset);
 };
 
-void PTPString::unpack(const Buffer& buffer,
-                       int& offset,
-                       std::optional<int> limitOffset) {
+void PTPStringCodec::unpack(std::string& value,
+                            const Buffer& buffer,
+                            int& offset,
+                            std::optional<int> limitOffset) {
   int limit = getUnpackLimit(buffer.size(), limitOffset);
   // Deal with "empty" string, which consists of a single 0x00 byte
   if (offset >= limit || buffer[offset] == 0x00) {
-    numChars = 0;
-    string.clear();
+    value.clear();
     if (offset < limit)
       offset++;
     return;
   }
-  Packet::unpack(buffer, offset, limitOffset);
+  uint8_t numChars;
+  Codec<uint8_t>::unpack(numChars, buffer, offset, limitOffset);
+  Codec<std::string>::unpack(value, buffer, offset, limitOffset, numChars);
+};
+
+int PTPStringCodec::packedSize(std::string& value) {
+  int numUnits = utf16Length(value);
+  if (numUnits > PTPStringCodec::MAX_CHARS)
+    numUnits = utf16Length(
+        std::string_view(value).substr(0, utf16Prefix(value, MAX_CHARS)));
+  return sizeof(uint8_t) + (numUnits + 1) * sizeof(uint16_t);
+}
+
+void PTPString::pack(Buffer& buffer, int& offset) {
+  int startOffset = offset;
+  PTPStringCodec::pack(string, buffer, offset);
+  numChars = buffer[startOffset];
+};
+
+void PTPString::unpack(const Buffer& buffer,
+                       int& offset,
+                       std::optional<int> limitOffset) {
+  PTPStringCodec::unpack(string, buffer, offset, limitOffset);
+  numChars = string.empty() ? 0 : utf16Length(string) + 1;
 };
 
 bool DeviceInfo::isOpSupported(uint16_t operationCode,
@@ -2,7 +2,7 @@
 #define CB_CONTROL_PTP_PTPDATA_H
 
 #include <cb/exception.h>
-#include <cb/packet.h>
+#include <cb/schema.h>
 
 #include <map>
 #include <typeindex>
@@ -38,7 +38,8 @@ struct OperationRequestData {
 struct OperationResponseData {
   const uint16_t responseCode;
   const std::array<uint32_t, 5> params;
-  const std::vector<uint8_t> data;
+  // Not const, so that responses are moved rather than copied on return
+  std::vector<uint8_t> data;
 
   OperationResponseData(uint16_t responseCode,
                         std::array<uint32_t, 5> params = {},
@@ -46,15 +47,75 @@ struct OperationResponseData {
       : responseCode(responseCode), params(params), data(std::move(data)) {}
 };
 
+// Array prefixed by its 32-bit element count
+template <std::integral T>
+struct PTPArrayCodec {
+  static void pack(std::vector<T>& values, Buffer& buffer, int& offset) {
+    uint32_t numElements = values.size();
+    Codec<uint32_t>::pack(numElements, buffer, offset);
+    VectorCodec<T>::pack(values, buffer, offset);
+  }
+
+  static int packedSize(std::vector<T>& values) {
+    return sizeof(uint32_t) + VectorCodec<T>::packedSize(values);
+  }
+
+  static void unpack(std::vector<T>& values,
+                     const Buffer& buffer,
+                     int& offset,
+                     std::optional<int> limitOffset) {
+    uint32_t numElements = 0;
+    Codec<uint32_t>::unpack(numElements, buffer, offset, limitOffset);
+    VectorCodec<T>::unpack(values, buffer, offset, limitOffset, numElements);
+  }
+};
+
+// Wide string prefixed by its 8-bit character count (including terminator)
+struct PTPStringCodec {
+  // PTP strings are limited to 255 UTF-16 units (including null terminator)
+  static const int MAX_CHARS = 254;
+
+  static void pack(std::string& value, Buffer& buffer, int& offset);
+  static void unpack(std::string& value,
+                     const Buffer& buffer,
+                     int& offset,
+                     std::optional<int> limitOffset);
+  static int packedSize(std::string& value);
+};
+
+// Arrays and strings within PTP datasets carry PTP length prefixes
+template <typename T>
+struct PTPCodec : Codec<T> {};
+
+template <std::integral T>
+struct PTPCodec<std::vector<T>> : PTPArrayCodec<T> {};
+
+template <>
+struct PTPCodec<std::string> : PTPStringCodec {};
+
+template <auto M>
+using PTPMember = Member<M, PTPCodec<MemberType<M>>>;
+
 template <std::integral T>
 class PTPArray : public Packet {
  public:
   uint32_t numElements = 0;
   std::vector<T>& array;
 
-  PTPArray(std::vector<T>& array) : array(array) {
-    field(this->numElements);
-    field(this->array, this->numElements);
+  PTPArray(std::vector<T>& array) : array(array) {}
+
+  void pack(Buffer& buffer, int& offset) override {
+    numElements = array.size();
+    PTPArrayCodec<T>::pack(array, buffer, offset);
+  }
+
+  int packedSize() override { return PTPArrayCodec<T>::packedSize(array); }
+
+  void unpack(const Buffer& buffer,
+              int& offset,
+              std::optional<int> limitOffset) override {
+    PTPArrayCodec<T>::unpack(array, buffer, offset, limitOffset);
+    numElements = array.size();
   }
 };
 
@@ -63,23 +124,18 @@ class PTPString : public Packet {
   uint8_t numChars = 0;
   std::string& string;
 
-  PTPString(std::string& string) : string(string) {
-    field(this->numChars);
-    field(this->string);
-  }
+  PTPString(std::string& string) : string(string) {}
 
   void pack(Buffer& buffer, int& offset) override;
   void unpack(const Buffer& buffer,
               int& offset,
               std::optional<int> limitOffset) override;
-
- private:
-  // PTP strings are limited to 255 characters (including null terminator)
-  static const int MAX_CHARS = 254;
+  int packedSize() override { return PTPStringCodec::packedSize(string); }
 };
 
 class PTPPacket : public Packet {
  public:
+  using Packet::Packet;
   using Packet::field;
 
   template <std::integral T>
@@ -92,7 +148,7 @@ class PTPPacket : public Packet {
   }
 };
 
-class DeviceInfo : public PTPPacket {
+class DeviceInfo : public SchemaPacket<DeviceInfo, PTPPacket> {
  public:
   uint16_t standardVersion = 0;
   uint32_t vendorExtensionId = 0;
@@ -109,22 +165,20 @@ class DeviceInfo : public PTPPacket {
   std::string deviceVersion;
   std::string serialNumber;
 
-  DeviceInfo() {
-    field(this->standardVersion);
-    field(this->vendorExtensionId);
-    field(this->vendorExtensionVersion);
-    field(this->vendorExtensionDesc);
-    field(this->functionalMode);
-    field(this->operationsSupported);
-    field(this->eventsSupported);
-    field(this->devicePropertiesSupported);
-    field(this->captureFormats);
-    field(this->imageFormats);
-    field(this->manufacturer);
-    field(this->model);
-    field(this->deviceVersion);
-    field(this->serialNumber);
-  }
+  using Schema = PacketSchema<PTPMember<&DeviceInfo::standardVersion>,
+                              PTPMember<&DeviceInfo::vendorExtensionId>,
+                              PTPMember<&DeviceInfo::vendorExtensionVersion>,
+                              PTPMember<&DeviceInfo::vendorExtensionDesc>,
+                              PTPMember<&DeviceInfo::functionalMode>,
+                              PTPMember<&DeviceInfo::operationsSupported>,
+                              PTPMember<&DeviceInfo::eventsSupported>,
+                              PTPMember<&DeviceInfo::devicePropertiesSupported>,
+                              PTPMember<&DeviceInfo::captureFormats>,
+                              PTPMember<&DeviceInfo::imageFormats>,
+                              PTPMember<&DeviceInfo::manufacturer>,
+                              PTPMember<&DeviceInfo::model>,
+                              PTPMember<&DeviceInfo::deviceVersion>,
+                              PTPMember<&DeviceInfo::serialNumber>>;
 
   bool isOpSupported(uint16_t operationCode,
                      uint32_t vendorExtensionId = 0) const;
@@ -134,8 +188,21 @@ class DeviceInfo : public PTPPacket {
 
 extern const std::map<std::type_index, uint16_t> DataTypeMap;
 
+// The fields every DevicePropDesc starts with, to peek at its data type
+// before unpacking the values
+class DevicePropDescHeader
+    : public SchemaPacket<DevicePropDescHeader, PTPPacket> {
+ public:
+  uint16_t devicePropertyCode = 0;
+  uint16_t dataType = 0;
+
+  using Schema =
+      PacketSchema<PTPMember<&DevicePropDescHeader::devicePropertyCode>,
+                   TypeMember<&DevicePropDescHeader::dataType>>;
+};
+
 template <typename T>
-class DevicePropDesc : public PTPPacket {
+class DevicePropDesc : public SchemaPacket<DevicePropDesc<T>, PTPPacket> {
  public:
   uint16_t devicePropertyCode = 0;
   uint16_t dataType = 0;
@@ -144,6 +211,13 @@ class DevicePropDesc : public PTPPacket {
   T currentValue;
   Buffer form;
 
+  using Schema = PacketSchema<PTPMember<&DevicePropDesc::devicePropertyCode>,
+                              TypeMember<&DevicePropDesc::dataType>,
+                              PTPMember<&DevicePropDesc::getSet>,
+                              PTPMember<&DevicePropDesc::factoryDefaultValue>,
+                              PTPMember<&DevicePropDesc::currentValue>,
+                              Member<&DevicePropDesc::form>>;
+
   DevicePropDesc() {
     if (!DataTypeMap.contains(typeid(T))) {
       // TODO: Specific exception type
@@ -151,51 +225,45 @@ class DevicePropDesc : public PTPPacket {
                       ExceptionType::UnsupportedType);
     }
     dataType = DataTypeMap.at(typeid(T));
-
-    field(this->devicePropertyCode);
-    typeField(this->dataType);
-    field(this->getSet);
-    field(this->factoryDefaultValue);
-    field(this->currentValue);
-    Packet::field(this->form);
   }
 };
 
-class PropDescForm : public Packet {
+class PropDescForm : public SchemaPacket<PropDescForm, Packet> {
  public:
   uint8_t formFlag = 0;
 
-  PropDescForm(uint8_t formFlag = 0) : formFlag(formFlag) {
-    typeField(this->formFlag);
-  }
+  using Schema = PacketSchema<TypeMember<&PropDescForm::formFlag>>;
+
+  PropDescForm(uint8_t formFlag = 0) : formFlag(formFlag) {}
 };
 
 template <std::integral T>
-class PropDescRange : public PropDescForm {
+class PropDescRange : public SchemaPacket<PropDescRange<T>, PropDescForm> {
  public:
   T minimumValue = 0;
   T maximumValue = 0;
   T stepSize = 0;
 
-  PropDescRange() : PropDescForm(0x01) {
-    field(this->minimumValue);
-    field(this->maximumValue);
-    field(this->stepSize);
-  }
+  using Schema =
+      PropDescForm::Schema::Append<Member<&PropDescRange::minimumValue>,
+                                   Member<&PropDescRange::maximumValue>,
+                                   Member<&PropDescRange::stepSize>>;
+
+  PropDescRange() : PropDescRange::SchemaPacket(0x01) {}
 };
 
 // TODO: Will this only ever be integral? Or should it stay like this to support
 // other types?
 template <typename T>
-class PropDescEnum : public PropDescForm {
+class PropDescEnum : public SchemaPacket<PropDescEnum<T>, PropDescForm> {
  public:
   uint16_t numValues = 0;
   std::vector<T> supportedValues;
 
-  PropDescEnum() : PropDescForm(0x02) {
-    field(this->numValues);
-    field(this->supportedValues, this->numValues);
-  }
+  using Schema = PropDescForm::Schema::Append<
+      CountedMember<&PropDescEnum::numValues, &PropDescEnum::supportedValues>>;
+
+  PropDescEnum() : PropDescEnum::SchemaPacket(0x02) {}
 };
 
 /* PTP Enums */
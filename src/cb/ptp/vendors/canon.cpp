@@ -1,5 +1,7 @@
 #include "canon.h"
 
+#include <cb/dispatch.h>
+
 namespace cb {
 
 void CanonPTPCamera::openSession() {
@@ -23,11 +25,11 @@ void CanonPTPCamera::openSession() {
 
   invalidateCachedDI();
 
-  startEventThread();
+  startEventPolling();
 }
 
 void CanonPTPCamera::closeSession() {
-  stopEventThread();
+  stopEventPolling();
 
   // if (isEosM())
   //   eosSetDeviceProp(EOSPropertyCode::EVFOutputDevice, 0x00);
@@ -85,11 +87,25 @@ bool CanonPTPCamera::isEosM() {
 }
 
 void CanonPTPCamera::getEvents() {
-  Buffer data = recv(CanonOperationCode::EOSGetEvent).data;
-  EOSEventData eventData;
+  OperationResponseData response = recv(CanonOperationCode::EOSGetEvent);
+  handleEvents(response.data);
+}
+
+Task<void> CanonPTPCamera::getEventsAsync(Scheduler& scheduler) {
+  OperationResponseData response =
+      co_await recvAsync(scheduler, CanonOperationCode::EOSGetEvent);
+  handleEvents(response.data);
+}
+
+void CanonPTPCamera::handleEvents(const Buffer& data) {
+  using EventDispatch = PacketDispatch<EOSEventPacket, EOSPropChanged>;
+
   eventData.unpack(data);
+
+  EventDispatch::Result packet;
   for (const Buffer& event : eventData.events) {
-    if (auto propChanged = EOSEventPacket::unpackAs<EOSPropChanged>(event)) {
+    EventDispatch::unpack(event, packet);
+    if (auto propChanged = std::get_if<EOSPropChanged>(&packet)) {
       // TODO: Figure out a good way to detect capture
       // if (propChanged->propertyCode == EOSPropertyCode::AvailableShots) {
       //   pushEvent<CaptureEvent>();
@@ -21,6 +21,7 @@ class CanonPTPCamera : public PTPCamera {
   void closeSession() override;
 
   void getEvents() override;
+  Task<void> getEventsAsync(Scheduler& scheduler) override;
 
   std::unique_ptr<DeviceInfo> getDeviceInfo() override;
 
@@ -33,6 +34,12 @@ class CanonPTPCamera : public PTPCamera {
     send(CanonOperationCode::EOSSetDevicePropValueEx, {},
          EOSDeviceProp<T>(devicePropertyCode, value).pack());
   }
+
+  // Reused between polls so the event buffers keep their capacity
+  EOSEventData eventData;
+
+  // Pushes events for the EOSGetEvent data phase in `data`
+  void handleEvents(const Buffer& data);
 };
 
 }  // namespace cb
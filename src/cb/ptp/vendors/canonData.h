@@ -7,74 +7,72 @@
 
 namespace cb {
 
-class EOSDeviceInfo : public PTPPacket {
+class EOSDeviceInfo : public SchemaPacket<EOSDeviceInfo, PTPPacket> {
  public:
   uint32_t length;
   std::vector<uint32_t> eventsSupported;
   std::vector<uint32_t> devicePropertiesSupported;
 
-  EOSDeviceInfo() {
-    lengthField(this->length);
-    field(this->eventsSupported);
-    field(this->devicePropertiesSupported);
-    field(this->unknown);
-  }
-
  private:
   // On my camera I got {0x00, 0x01, 0x02, 0x04, 0x08}
   std::vector<uint32_t> unknown;
+
+ public:
+  using Schema =
+      PacketSchema<LengthMember<&EOSDeviceInfo::length>,
+                   PTPMember<&EOSDeviceInfo::eventsSupported>,
+                   PTPMember<&EOSDeviceInfo::devicePropertiesSupported>,
+                   PTPMember<&EOSDeviceInfo::unknown>>;
 };
 
 template <std::unsigned_integral T>
-class EOSDeviceProp : public PTPPacket {
+class EOSDeviceProp : public SchemaPacket<EOSDeviceProp<T>, PTPPacket> {
  public:
   uint32_t length = 0;
   uint32_t devicePropertyCode = 0;
   T value = 0;
 
+  using Schema =
+      PacketSchema<LengthMember<&EOSDeviceProp::length>,
+                   TypeMember<&EOSDeviceProp::devicePropertyCode>,
+                   Member<&EOSDeviceProp::value>>;
+
   EOSDeviceProp(uint32_t devicePropertyCode, T value)
-      : devicePropertyCode(devicePropertyCode), value(value) {
-    lengthField(this->length);
-    typeField(this->devicePropertyCode);
-    field(this->value);
-  }
+      : devicePropertyCode(devicePropertyCode), value(value) {}
   EOSDeviceProp() : EOSDeviceProp(0, 0) {}
 };
 
-class EOSEventPacket : public Packet {
+class EOSEventPacket : public SchemaPacket<EOSEventPacket, Packet> {
  public:
   uint32_t length = 0;
   uint32_t eventType = 0;
 
-  EOSEventPacket(uint32_t eventType) : eventType(eventType) {
-    lengthField(this->length);
-    typeField(this->eventType);
-  }
-  EOSEventPacket() : EOSEventPacket(0) {}
+  using Schema = PacketSchema<LengthMember<&EOSEventPacket::length>,
+                              TypeMember<&EOSEventPacket::eventType>>;
 
-  template <typename T>
-    requires(std::derived_from<T, EOSEventPacket>)
-  static std::unique_ptr<T> unpackAs(const Buffer& buffer) {
-    return Packet::unpackAs<EOSEventPacket, T>(buffer);
-  }
+  EOSEventPacket(uint32_t eventType) : eventType(eventType) {}
+  EOSEventPacket() : EOSEventPacket(0) {}
 };
 
-class EOSEventData : public Packet {
+class EOSEventData : public SchemaPacket<EOSEventData, Packet> {
  public:
   std::vector<Buffer> events;
 
-  EOSEventData() { field<EOSEventPacket>(this->events); }
+  using Schema = PacketSchema<
+      Member<&EOSEventData::events,
+             VectorCodec<Buffer, PacketBufferCodec<EOSEventPacket>>>>;
 };
 
-class EOSPropChanged : public EOSEventPacket {
+class EOSPropChanged : public SchemaPacket<EOSPropChanged, EOSEventPacket> {
  public:
   uint32_t propertyCode = 0;
   uint32_t propertyValue = 0;
 
-  EOSPropChanged() : EOSEventPacket(0xc189) {
-    field(this->propertyCode);
-    field(this->propertyValue);
-  }
+  using Schema = EOSEventPacket::Schema::Append<
+      Member<&EOSPropChanged::propertyCode>,
+      Member<&EOSPropChanged::propertyValue>>;
+
+  EOSPropChanged() : SchemaPacket(0xc189) {}
 };
 
 /* Canon vendor PTP Enums */
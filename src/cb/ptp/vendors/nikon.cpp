@@ -7,11 +7,11 @@ void NikonPTPCamera::openSession() {
 
   invalidateCachedDI();
 
-  startEventThread();
+  startEventPolling();
 }
 
 void NikonPTPCamera::closeSession() {
-  stopEventThread();
+  stopEventPolling();
 
   PTP::closeSession();
 }
@@ -29,4 +29,8 @@ void NikonPTPCamera::getEvents() {
   recv(NikonOperationCode::CheckEvents);
 }
 
+Task<void> NikonPTPCamera::getEventsAsync(Scheduler& scheduler) {
+  co_await recvAsync(scheduler, NikonOperationCode::CheckEvents);
+}
+
 }
\ No newline at end of file
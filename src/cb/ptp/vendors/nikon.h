@@ -19,6 +19,7 @@ class NikonPTPCamera : public PTPCamera {
   void closeSession() override;
 
   void getEvents() override;
+  Task<void> getEventsAsync(Scheduler& scheduler) override;
 
   std::unique_ptr<DeviceInfo> getDeviceInfo() override;
 };
@@ -0,0 +1,202 @@
+#include <cb/reactor.h>
+
+#include <climits>
+
+namespace cb {
+
+namespace {
+
+std::mutex activeMutex;
+std::shared_ptr<Reactor> activeReactor;
+
+}  // namespace
+
+bool Reactor::watch(Socket& socket, Callback onReadable) {
+  return addWatch(socket, std::move(onReadable), false);
+}
+
+bool Reactor::watchWritable(Socket& socket, Callback onWritable) {
+  return addWatch(socket, std::move(onWritable), true);
+}
+
+bool Reactor::addWatch(Socket& socket, Callback callback, bool writable) {
+  SocketHandle handle = socket.getHandle();
+  if (handle == NO_SOCKET_HANDLE)
+    return false;
+
+  {
+    std::lock_guard lock(mutex);
+    if (!addHandle(handle, writable))
+      return false;
+    watches[handle] = {nextId++, &socket,
+                       std::make_shared<Callback>(std::move(callback))};
+  }
+  // Backends which copy their handle set at the start of a wait pick it up
+  wake();
+  return true;
+}
+
+void Reactor::unwatch(Socket& socket) {
+  std::unique_lock lock(mutex);
+  for (auto it = watches.begin(); it != watches.end(); ++it) {
+    if (it->second.socket != &socket)
+      continue;
+    int id = it->second.id;
+    removeHandle(it->first);
+    watches.erase(it);
+    awaitIdle(lock, id);
+    return;
+  }
+}
+
+int Reactor::addTimer(std::chrono::milliseconds interval, Callback onExpired) {
+  int id;
+  {
+    std::lock_guard lock(mutex);
+    id = nextId++;
+    timers[id] = {Clock::now() + interval, interval,
+                  std::make_shared<Callback>(std::move(onExpired))};
+  }
+  wake();
+  return id;
+}
+
+void Reactor::removeTimer(int id) {
+  std::unique_lock lock(mutex);
+  timers.erase(id);
+  awaitIdle(lock, id);
+}
+
+void Reactor::post(Callback task) {
+  {
+    std::lock_guard lock(mutex);
+    tasks.push_back(std::move(task));
+  }
+  wake();
+}
+
+void Reactor::run() {
+  {
+    std::lock_guard lock(mutex);
+    loopThread = std::this_thread::get_id();
+    stopped = false;
+  }
+
+  while (true) {
+    {
+      std::lock_guard lock(mutex);
+      if (stopped)
+        break;
+    }
+    runOnce(UINT_MAX);
+  }
+
+  std::lock_guard lock(mutex);
+  loopThread = std::thread::id();
+}
+
+void Reactor::stop() {
+  {
+    std::lock_guard lock(mutex);
+    stopped = true;
+  }
+  wake();
+}
+
+void Reactor::runOnce(unsigned int timeoutMs) {
+  std::unique_lock lock(mutex);
+
+  // Sleep no later than the next timer is due, and not at all with tasks
+  // waiting
+  int timeout = timeoutMs >= INT_MAX ? -1 : timeoutMs;
+  if (!tasks.empty())
+    timeout = 0;
+  auto now = Clock::now();
+  for (auto& [id, timer] : timers) {
+    long long untilDue = std::chrono::duration_cast<std::chrono::milliseconds>(
+                             timer.due - now)
+                             .count();
+    if (untilDue < 0)
+      untilDue = 0;
+    if (timeout < 0 || untilDue < timeout)
+      timeout = untilDue;
+  }
+
+  ready.clear();
+  lock.unlock();
+  waitReady(timeout);
+  lock.lock();
+
+  std::vector<Callback> dueTasks;
+  dueTasks.swap(tasks);
+  lock.unlock();
+  for (Callback& task : dueTasks)
+    task();
+  lock.lock();
+
+  // Watches may have been removed by the callbacks before them
+  for (SocketHandle handle : ready) {
+    auto it = watches.find(handle);
+    if (it != watches.end())
+      invoke(lock, it->second.id, it->second.callback);
+  }
+
+  now = Clock::now();
+  std::vector<int> dueTimers;
+  for (auto& [id, timer] : timers) {
+    if (timer.due <= now)
+      dueTimers.push_back(id);
+  }
+  for (int id : dueTimers) {
+    auto it = timers.find(id);
+    if (it == timers.end())
+      continue;
+    std::shared_ptr<Callback> callback = it->second.callback;
+    invoke(lock, id, callback);
+
+    it = timers.find(id);
+    if (it != timers.end())
+      it->second.due = Clock::now() + it->second.interval;
+  }
+}
+
+void Reactor::handleReady(SocketHandle handle) {
+  ready.push_back(handle);
+}
+
+void Reactor::invoke(std::unique_lock<std::mutex>& lock,
+                     int id,
+                     std::shared_ptr<Callback> callback) {
+  running = id;
+  lock.unlock();
+  try {
+    (*callback)();
+  } catch (...) {
+    lock.lock();
+    running = 0;
+    idle.notify_all();
+    throw;
+  }
+  lock.lock();
+  running = 0;
+  idle.notify_all();
+}
+
+void Reactor::awaitIdle(std::unique_lock<std::mutex>& lock, int id) {
+  // A callback removing itself would wait forever
+  if (std::this_thread::get_id() == loopThread)
+    return;
+  idle.wait(lock, [&] { return running != id; });
+}
+
+void Reactor::setActive(std::shared_ptr<Reactor> reactor) {
+  std::lock_guard lock(activeMutex);
+  activeReactor = std::move(reactor);
+}
+
+std::shared_ptr<Reactor> Reactor::getActive() {
+  std::lock_guard lock(activeMutex);
+  return activeReactor;
+}
+
+}  // namespace cb
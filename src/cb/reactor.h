@@ -0,0 +1,138 @@
+#ifndef CB_CONTROL_REACTOR_H
+#define CB_CONTROL_REACTOR_H
+
+#include <cb/socket.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace cb {
+
+// Single-threaded event loop. Sockets, timers and posted tasks from any number
+// of cameras and discovery services are registered with one reactor, and their
+// callbacks all run on the thread in run(), so the thread count stays the same
+// however many cameras there are. Registration is thread-safe.
+//
+// Readiness is level-triggered, but bytes that a socket has already read ahead
+// don't count, so callbacks should read until a recv() with a timeout of 0
+// comes up empty.
+class Reactor {
+ public:
+  typedef std::function<void()> Callback;
+
+  virtual ~Reactor() = default;
+
+  // Calls `onReadable` whenever `socket` has bytes to read, returning false if
+  // the socket isn't open. The socket must be unwatched before it is closed.
+  bool watch(Socket& socket, Callback onReadable);
+  // Like watch(), but calls `onWritable` whenever `socket` has room to send,
+  // which is also when a pending connect finishes. A socket is watched for
+  // one or the other at a time.
+  bool watchWritable(Socket& socket, Callback onWritable);
+  void unwatch(Socket& socket);
+
+  // Calls `onExpired` every `interval` (measured from the end of the previous
+  // call) until removed, returning an ID for removeTimer()
+  int addTimer(std::chrono::milliseconds interval, Callback onExpired);
+  // Once this returns, the callback won't be called again and isn't running
+  // on another thread, so whatever it refers to may be destroyed
+  void removeTimer(int id);
+
+  // Runs `task` once on the loop thread
+  void post(Callback task);
+
+  // Called on the loop thread when a transfer finishes, with the number of
+  // bytes moved or a negative errno value if it failed or timed out. A read
+  // passes the bytes it brought in, which are only valid during the call.
+  typedef std::function<void(int result, BufferView received)>
+      TransferCallback;
+
+  // Whether the backend does socket reads and writes itself (io_uring), taking
+  // them through submitRecv() and submitSend() instead of reporting readiness
+  // for the caller to do them
+  virtual bool canTransfer() const { return false; }
+  // Reads whatever `handle` has once it has something, up to a buffer of the
+  // backend's choosing, or fails after `timeoutMs`. A read expecting at least
+  // `length` bytes may wait for more than the first to arrive, so long
+  // transfers take fewer completions. Returns false if the read couldn't be
+  // submitted, in which case `onDone` is never called.
+  virtual bool submitRecv(SocketHandle, int, unsigned int, TransferCallback) {
+    return false;
+  }
+  // Sends as much of `data` as the socket takes, which must stay valid until
+  // `onDone` is called
+  virtual bool submitSend(SocketHandle, BufferView, unsigned int,
+                          TransferCallback) {
+    return false;
+  }
+  // Ends the transfers still pending on `handle` early, as failed
+  virtual void cancelTransfers(SocketHandle) {}
+
+  // Runs callbacks until stop() is called
+  void run();
+  void stop();
+  // Waits at most `timeoutMs` (or until the next timer is due) for a socket to
+  // become ready, then runs whatever callbacks are due
+  void runOnce(unsigned int timeoutMs);
+
+  // The reactor that objects created by the library (e.g. cameras) register
+  // with, if any. Without one, they fall back to a thread of their own.
+  static void setActive(std::shared_ptr<Reactor> reactor);
+  static std::shared_ptr<Reactor> getActive();
+
+ protected:
+  // Platform hooks. handleReady() must be called from waitReady() for every
+  // handle that has become readable, or writable if added with `writable`.
+  virtual bool addHandle(SocketHandle handle, bool writable) = 0;
+  virtual void removeHandle(SocketHandle handle) = 0;
+  // Waits up to `timeoutMs` (or indefinitely for -1) for a handle to become
+  // ready or for wake() to be called
+  virtual void waitReady(int timeoutMs) = 0;
+  // Interrupts waitReady() from another thread
+  virtual void wake() = 0;
+
+  void handleReady(SocketHandle handle);
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Watch {
+    int id;
+    Socket* socket;
+    std::shared_ptr<Callback> callback;
+  };
+
+  struct Timer {
+    Clock::time_point due;
+    std::chrono::milliseconds interval;
+    std::shared_ptr<Callback> callback;
+  };
+
+  std::mutex mutex;
+  std::condition_variable idle;
+  std::map<SocketHandle, Watch> watches;
+  std::map<int, Timer> timers;
+  std::vector<Callback> tasks;
+  int nextId = 1;
+  // ID of the watch or timer whose callback is running, if any
+  int running = 0;
+  bool stopped = false;
+  std::thread::id loopThread;
+
+  // Handles reported by waitReady() in the current pass
+  std::vector<SocketHandle> ready;
+
+  void invoke(std::unique_lock<std::mutex>& lock,
+              int id,
+              std::shared_ptr<Callback> callback);
+  void awaitIdle(std::unique_lock<std::mutex>& lock, int id);
+  bool addWatch(Socket& socket, Callback callback, bool writable);
+};
+
+}  // namespace cb
+
+#endif
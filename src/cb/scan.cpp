@@ -0,0 +1,110 @@
+#include <cb/scan.h>
+
+#include <bit>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CB_CONTROL_SCAN_AVX2
+#include <immintrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CB_CONTROL_SCAN_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace cb {
+
+#ifdef CB_CONTROL_SCAN_AVX2
+// Compiled for AVX2 regardless of the target flags and only called once the
+// CPU is known to support it
+__attribute__((target("avx2"))) static const uint8_t* findAVX2(
+    const uint8_t* begin,
+    const uint8_t* end,
+    const uint8_t* bytes,
+    int numBytes) {
+  __m256i needles[ByteScanner::MAX_SIMD_BYTES];
+  for (int i = 0; i < numBytes; i++)
+    needles[i] = _mm256_set1_epi8(bytes[i]);
+
+  while (end - begin >= 32) {
+    __m256i block = _mm256_loadu_si256((const __m256i*)begin);
+    __m256i matches = _mm256_cmpeq_epi8(block, needles[0]);
+    for (int i = 1; i < numBytes; i++)
+      matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(block, needles[i]));
+
+    uint32_t mask = _mm256_movemask_epi8(matches);
+    if (mask != 0)
+      return begin + std::countr_zero(mask);
+    begin += 32;
+  }
+  return begin;
+}
+
+static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+#endif
+
+#ifdef CB_CONTROL_SCAN_SSE2
+static const uint8_t* findSSE2(const uint8_t* begin,
+                               const uint8_t* end,
+                               const uint8_t* bytes,
+                               int numBytes) {
+  __m128i needles[ByteScanner::MAX_SIMD_BYTES];
+  for (int i = 0; i < numBytes; i++)
+    needles[i] = _mm_set1_epi8(bytes[i]);
+
+  while (end - begin >= 16) {
+    __m128i block = _mm_loadu_si128((const __m128i*)begin);
+    __m128i matches = _mm_cmpeq_epi8(block, needles[0]);
+    for (int i = 1; i < numBytes; i++)
+      matches = _mm_or_si128(matches, _mm_cmpeq_epi8(block, needles[i]));
+
+    uint32_t mask = _mm_movemask_epi8(matches);
+    if (mask != 0)
+      return begin + std::countr_zero(mask);
+    begin += 16;
+  }
+  return begin;
+}
+#endif
+
+ByteScanner::ByteScanner(std::string_view bytes) {
+  for (char c : bytes) {
+    uint8_t byte = c;
+    if (table[byte])
+      continue;
+    table[byte] = true;
+    if (numBytes < MAX_SIMD_BYTES)
+      this->bytes[numBytes] = byte;
+    numBytes++;
+  }
+}
+
+const uint8_t* ByteScanner::find(const uint8_t* begin,
+                                 const uint8_t* end) const {
+  if (numBytes == 0)
+    return end;
+
+  // Whole blocks are scanned with SIMD; the remainder (and any match within
+  // it) is left to the table below
+  if (numBytes <= MAX_SIMD_BYTES) {
+#ifdef CB_CONTROL_SCAN_AVX2
+    if (hasAVX2) {
+      begin = findAVX2(begin, end, bytes.data(), numBytes);
+      if (end - begin >= 32)
+        return begin;
+    }
+#endif
+#ifdef CB_CONTROL_SCAN_SSE2
+    begin = findSSE2(begin, end, bytes.data(), numBytes);
+    if (end - begin >= 16)
+      return begin;
+#endif
+  }
+
+  while (begin < end && !table[*begin])
+    begin++;
+  return begin;
+}
+
+}  // namespace cb
\ No newline at end of file
@@ -0,0 +1,31 @@
+#ifndef CB_CONTROL_SCAN_H
+#define CB_CONTROL_SCAN_H
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace cb {
+
+// Finds the first occurrence of any byte in a small set. Up to MAX_SIMD_BYTES
+// bytes are compared 32 or 16 at a time with AVX2 or SSE2 where available;
+// larger sets and other platforms fall back to a lookup table.
+class ByteScanner {
+ public:
+  static const int MAX_SIMD_BYTES = 8;
+
+  ByteScanner(std::string_view bytes = "");
+
+  // Returns the first position in [begin, end) holding one of the bytes, or
+  // `end` if there is none
+  const uint8_t* find(const uint8_t* begin, const uint8_t* end) const;
+
+ private:
+  std::array<bool, 256> table = {};
+  std::array<uint8_t, MAX_SIMD_BYTES> bytes = {};
+  int numBytes = 0;
+};
+
+}  // namespace cb
+
+#endif
\ No newline at end of file
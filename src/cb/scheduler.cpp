@@ -0,0 +1,294 @@
+#include <cb/exception.h>
+#include <cb/logger.h>
+#include <cb/scheduler.h>
+
+#include <atomic>
+#include <climits>
+
+namespace cb {
+
+// Coroutine that starts right away and destroys itself when done, which is
+// what spawned tasks are wrapped in. The scheduler keeps track of it until
+// then, so it can destroy it if the scheduler goes first.
+struct SpawnedTask {
+  struct promise_type {
+    Scheduler& scheduler;
+
+    promise_type(Scheduler& scheduler, Task<void>&) : scheduler(scheduler) {}
+
+    SpawnedTask get_return_object() {
+      std::lock_guard lock(scheduler.mutex);
+      scheduler.spawned.insert(
+          std::coroutine_handle<promise_type>::from_promise(*this).address());
+      return {};
+    }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept {
+      std::lock_guard lock(scheduler.mutex);
+      scheduler.spawned.erase(
+          std::coroutine_handle<promise_type>::from_promise(*this).address());
+      return {};
+    }
+    void return_void() {}
+    void unhandled_exception() {}
+  };
+};
+
+namespace {
+
+std::mutex activeMutex;
+std::shared_ptr<Scheduler> activeScheduler;
+
+// Tasks of a whenAll() still running, counting whenAll() itself until it has
+// suspended, so the last one to finish is the one to resume it
+struct Join {
+  std::atomic<size_t> remaining;
+  std::coroutine_handle<> waiting;
+};
+
+Task<void> runJoined(Scheduler& scheduler,
+                     Task<void> task,
+                     std::shared_ptr<Join> join) {
+  try {
+    co_await std::move(task);
+  } catch (const std::exception& e) {
+    Logger::log("Spawned task failed: %s", e.what());
+  }
+  if (join->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    scheduler.resume(join->waiting);
+}
+
+SpawnedTask runSpawned(Scheduler& scheduler, Task<void> task) {
+  co_await scheduler.schedule();
+  try {
+    co_await std::move(task);
+  } catch (const std::exception& e) {
+    Logger::log("Spawned task failed: %s", e.what());
+  }
+}
+
+}  // namespace
+
+Scheduler::Scheduler(std::shared_ptr<Reactor> reactor, int threadCount)
+    : reactor(std::move(reactor)) {
+  for (int i = 0; i < threadCount; i++)
+    workers.emplace_back([this]() { work(); });
+}
+
+Scheduler::~Scheduler() {
+  {
+    std::lock_guard lock(mutex);
+    stopped = true;
+  }
+  available.notify_all();
+  workers.clear();
+
+  // Callbacks already running see the waits finished, and the removals wait
+  // for them, so none can touch the scheduler afterwards
+  std::unordered_set<std::shared_ptr<SocketWait>> pendingWaits;
+  {
+    std::lock_guard lock(mutex);
+    pendingWaits.swap(waits);
+  }
+  for (const std::shared_ptr<SocketWait>& wait : pendingWaits) {
+    std::lock_guard lock(wait->mutex);
+    wait->isFinished = true;
+  }
+  for (const std::shared_ptr<SocketWait>& wait : pendingWaits) {
+    if (wait->socket)
+      reactor->unwatch(*wait->socket);
+    if (wait->timer != 0)
+      reactor->removeTimer(wait->timer);
+    // Sends would otherwise go on reading from frames destroyed below
+    if (wait->transferHandle != NO_SOCKET_HANDLE)
+      reactor->cancelTransfers(wait->transferHandle);
+  }
+
+  // Destroying the outermost frames destroys the tasks they were awaiting
+  std::unordered_set<void*> frames;
+  {
+    std::lock_guard lock(mutex);
+    frames.swap(spawned);
+    ready.clear();
+  }
+  for (void* frame : frames)
+    std::coroutine_handle<>::from_address(frame).destroy();
+}
+
+void Scheduler::setActive(std::shared_ptr<Scheduler> scheduler) {
+  std::lock_guard lock(activeMutex);
+  activeScheduler = std::move(scheduler);
+}
+
+std::shared_ptr<Scheduler> Scheduler::getActive() {
+  std::lock_guard lock(activeMutex);
+  return activeScheduler;
+}
+
+void Scheduler::spawn(Task<void> task) {
+  runSpawned(*this, std::move(task));
+}
+
+Task<void> Scheduler::whenAll(std::vector<Task<void>> tasks) {
+  struct Awaiter {
+    Join& join;
+
+    bool await_ready() { return false; }
+    bool await_suspend(std::coroutine_handle<> handle) {
+      join.waiting = handle;
+      return join.remaining.fetch_sub(1, std::memory_order_acq_rel) != 1;
+    }
+    void await_resume() {}
+  };
+
+  auto join = std::make_shared<Join>();
+  join->remaining = tasks.size() + 1;
+  for (Task<void>& task : tasks)
+    spawn(runJoined(*this, std::move(task), join));
+  co_await Awaiter{*join};
+}
+
+void Scheduler::resume(std::coroutine_handle<> handle) {
+  std::lock_guard lock(mutex);
+  ready.push_back(handle);
+  available.notify_one();
+}
+
+void Scheduler::work() {
+  while (true) {
+    std::coroutine_handle<> handle;
+    {
+      std::unique_lock lock(mutex);
+      available.wait(lock, [this]() { return stopped || !ready.empty(); });
+      if (stopped)
+        return;
+      handle = ready.front();
+      ready.pop_front();
+    }
+    handle.resume();
+  }
+}
+
+bool Scheduler::waitReady(std::shared_ptr<SocketWait> wait,
+                          Socket* socket,
+                          unsigned int timeoutMs,
+                          bool writable) {
+  // Callbacks can't finish the wait until it has been set up
+  std::lock_guard lock(wait->mutex);
+  wait->socket = socket;
+  if (socket) {
+    auto onReady = [this, wait]() { finishWait(wait, true); };
+    if (!(writable ? reactor->watchWritable(*socket, onReady)
+                   : reactor->watch(*socket, onReady)))
+      return false;
+  }
+  if (!socket || timeoutMs < INT_MAX) {
+    wait->timer =
+        reactor->addTimer(std::chrono::milliseconds(timeoutMs),
+                          [this, wait]() { finishWait(wait, false); });
+  }
+  std::lock_guard schedulerLock(mutex);
+  waits.insert(wait);
+  return true;
+}
+
+void Scheduler::finishWait(std::shared_ptr<SocketWait> wait, bool isReady) {
+  // Readiness and the timeout may both fire; only the first one counts
+  std::lock_guard lock(wait->mutex);
+  if (wait->isFinished)
+    return;
+  wait->isFinished = true;
+
+  // Called on the reactor's thread, so neither removal waits
+  if (wait->socket)
+    reactor->unwatch(*wait->socket);
+  if (wait->timer != 0)
+    reactor->removeTimer(wait->timer);
+
+  // Once the wait is out of `waits`, the destructor no longer waits for this
+  // callback, so the scheduler mustn't be touched after the lock is released
+  wait->isReady = isReady;
+  std::lock_guard schedulerLock(mutex);
+  waits.erase(wait);
+  ready.push_back(wait->handle);
+  available.notify_one();
+}
+
+bool Scheduler::submitTransfer(std::shared_ptr<SocketWait> wait,
+                               Socket& socket,
+                               BufferView sending,
+                               int length,
+                               unsigned int timeoutMs) {
+  SocketHandle handle = socket.getHandle();
+  if (handle == NO_SOCKET_HANDLE)
+    return false;
+
+  // Completions can't finish the transfer until it has been set up
+  std::lock_guard lock(wait->mutex);
+  wait->transferHandle = handle;
+  auto onDone = [this, wait](int result, BufferView received) {
+    finishTransfer(wait, result, received);
+  };
+  bool isSubmitted =
+      sending.empty()
+          ? reactor->submitRecv(handle, length, timeoutMs, onDone)
+          : reactor->submitSend(handle, sending, timeoutMs, onDone);
+  if (!isSubmitted)
+    return false;
+  std::lock_guard schedulerLock(mutex);
+  waits.insert(wait);
+  return true;
+}
+
+void Scheduler::finishTransfer(std::shared_ptr<SocketWait> wait,
+                               int result,
+                               BufferView received) {
+  // Finished already if the scheduler is being destroyed, in which case the
+  // coroutine and whatever `onData` writes to may be gone
+  std::lock_guard lock(wait->mutex);
+  if (wait->isFinished)
+    return;
+  wait->isFinished = true;
+
+  wait->result = result;
+  if (result > 0 && wait->onData)
+    wait->result = wait->onData(received);
+  std::lock_guard schedulerLock(mutex);
+  waits.erase(wait);
+  ready.push_back(wait->handle);
+  available.notify_one();
+}
+
+AsyncMutex::Lock AsyncMutex::lockBlocking() {
+  std::binary_semaphore handedOver(0);
+  {
+    std::lock_guard lock(mutex);
+    if (!isLocked) {
+      isLocked = true;
+      return Lock(*this);
+    }
+    waiters.push_back({nullptr, nullptr, &handedOver});
+  }
+  handedOver.acquire();
+  return Lock(*this);
+}
+
+void AsyncMutex::unlock() {
+  Waiter next;
+  {
+    std::lock_guard lock(mutex);
+    if (waiters.empty()) {
+      isLocked = false;
+      return;
+    }
+    // Ownership passes straight to the next waiter
+    next = waiters.front();
+    waiters.pop_front();
+  }
+  if (next.handedOver)
+    next.handedOver->release();
+  else
+    next.scheduler->resume(next.handle);
+}
+
+}  // namespace cb
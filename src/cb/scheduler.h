@@ -0,0 +1,262 @@
+#ifndef CB_CONTROL_SCHEDULER_H
+#define CB_CONTROL_SCHEDULER_H
+
+#include <cb/reactor.h>
+#include <cb/task.h>
+
+#include <deque>
+#include <functional>
+#include <optional>
+#include <semaphore>
+#include <unordered_set>
+#include <vector>
+
+namespace cb {
+
+// Runs coroutines on a small pool of worker threads. Coroutines waiting for a
+// socket or a timeout are suspended on the reactor instead of holding on to a
+// thread, so many camera operations can be in flight on a few threads.
+class Scheduler {
+ public:
+  // `reactor` must be running, e.g. on its own thread
+  Scheduler(std::shared_ptr<Reactor> reactor, int threadCount = 2);
+  // Stops the workers, stops waiting on the reactor and destroys the spawned
+  // tasks that haven't finished. Those must not be waiting on an AsyncMutex
+  // that outlives the scheduler.
+  ~Scheduler();
+
+  Scheduler(const Scheduler&) = delete;
+  Scheduler& operator=(const Scheduler&) = delete;
+
+  // Runs `task` on a worker without waiting for it. Exceptions escaping it
+  // are logged.
+  void spawn(Task<void> task);
+
+  // Runs `tasks` at once and finishes when all of them have, without holding
+  // a thread in the meantime. Exceptions escaping them are logged, as with
+  // spawn().
+  Task<void> whenAll(std::vector<Task<void>> tasks);
+
+  // Resumes `handle` on a worker
+  void resume(std::coroutine_handle<> handle);
+
+  // co_await schedule() continues on a worker
+  auto schedule() {
+    struct Awaiter {
+      Scheduler& scheduler;
+
+      bool await_ready() { return false; }
+      void await_suspend(std::coroutine_handle<> handle) {
+        scheduler.resume(handle);
+      }
+      void await_resume() {}
+    };
+    return Awaiter{*this};
+  }
+
+  // co_await readable(socket, timeoutMs) suspends until the socket has bytes
+  // to read, returning false on timeout or if the socket isn't open. Only one
+  // coroutine may wait on a socket at a time.
+  auto readable(Socket& socket, unsigned int timeoutMs) {
+    return SocketAwaiter{*this, &socket, timeoutMs, false, nullptr};
+  }
+
+  // Like readable(), but waits until the socket has room to send or a pending
+  // connect has finished
+  auto writable(Socket& socket, unsigned int timeoutMs) {
+    return SocketAwaiter{*this, &socket, timeoutMs, true, nullptr};
+  }
+
+  // Whether the reactor does socket reads and writes itself, so sockets can
+  // hand them over with recv() and send() instead of waiting for readiness
+  bool canTransfer() const { return reactor->canTransfer(); }
+
+  // co_await recv(socket, length, timeoutMs, onData) reads through the
+  // reactor (see Reactor::submitRecv()), expecting at least `length` bytes and
+  // calling `onData` with what arrives before resuming. Returns what `onData`
+  // returned, or the read's result if it brought in nothing, or std::nullopt
+  // without suspending if the read couldn't be submitted. Only one coroutine
+  // may read a socket at a time.
+  auto recv(Socket& socket,
+            int length,
+            unsigned int timeoutMs,
+            std::function<int(BufferView)> onData) {
+    return TransferAwaiter{*this, &socket, BufferView(), length, timeoutMs,
+                           std::move(onData), nullptr, false};
+  }
+
+  // Likewise sends as much of `data` as the socket takes, returning how much
+  // that was or a negative value on failure
+  auto send(Socket& socket, BufferView data, unsigned int timeoutMs) {
+    return TransferAwaiter{*this, &socket, data, (int)data.size(), timeoutMs,
+                           nullptr, nullptr, false};
+  }
+
+  // co_await sleepFor(duration) continues on a worker once `duration` has
+  // passed, without holding a thread in the meantime
+  auto sleepFor(std::chrono::milliseconds duration) {
+    unsigned int timeoutMs = duration.count() > 0 ? duration.count() : 0;
+    return SocketAwaiter{*this, nullptr, timeoutMs, false, nullptr};
+  }
+
+  // The scheduler that objects created by the library (e.g. cameras) run
+  // their background work on, if any. Without one, they fall back to a
+  // thread of their own.
+  static void setActive(std::shared_ptr<Scheduler> scheduler);
+  static std::shared_ptr<Scheduler> getActive();
+
+ private:
+  friend struct SpawnedTask;
+
+  struct SocketWait {
+    std::mutex mutex;
+    bool isFinished = false;
+    bool isReady = false;
+    int timer = 0;
+    // Null for a sleep, which only waits for the timer
+    Socket* socket = nullptr;
+    std::coroutine_handle<> handle;
+
+    // Set instead of `socket` for a transfer done by the reactor, along with
+    // its result and, for a read, where the bytes go
+    SocketHandle transferHandle = NO_SOCKET_HANDLE;
+    int result = 0;
+    std::function<int(BufferView)> onData;
+  };
+
+  struct SocketAwaiter {
+    Scheduler& scheduler;
+    Socket* socket;
+    unsigned int timeoutMs;
+    bool writable;
+    std::shared_ptr<SocketWait> wait;
+
+    bool await_ready() { return false; }
+    bool await_suspend(std::coroutine_handle<> handle) {
+      // Set up before the wait starts, as it may resume right away on another
+      // thread
+      wait = std::make_shared<SocketWait>();
+      wait->handle = handle;
+      return scheduler.waitReady(wait, socket, timeoutMs, writable);
+    }
+    bool await_resume() { return wait->isReady; }
+  };
+
+  struct TransferAwaiter {
+    Scheduler& scheduler;
+    Socket* socket;
+    BufferView sending;
+    int length;
+    unsigned int timeoutMs;
+    std::function<int(BufferView)> onData;
+    std::shared_ptr<SocketWait> wait;
+    bool isSubmitted;
+
+    bool await_ready() { return false; }
+    bool await_suspend(std::coroutine_handle<> handle) {
+      wait = std::make_shared<SocketWait>();
+      wait->handle = handle;
+      wait->onData = std::move(onData);
+      isSubmitted =
+          scheduler.submitTransfer(wait, *socket, sending, length, timeoutMs);
+      return isSubmitted;
+    }
+    std::optional<int> await_resume() {
+      if (!isSubmitted)
+        return std::nullopt;
+      return wait->result;
+    }
+  };
+
+  std::shared_ptr<Reactor> reactor;
+  std::mutex mutex;
+  std::condition_variable available;
+  std::deque<std::coroutine_handle<>> ready;
+  bool stopped = false;
+  // Outermost frames of the spawned tasks, which own the frames they await
+  std::unordered_set<void*> spawned;
+  // Waits still registered with the reactor
+  std::unordered_set<std::shared_ptr<SocketWait>> waits;
+  std::vector<std::jthread> workers;
+
+  // Returns false (so the caller doesn't suspend) if the socket can't be
+  // watched
+  bool waitReady(std::shared_ptr<SocketWait> wait,
+                 Socket* socket,
+                 unsigned int timeoutMs,
+                 bool writable);
+  void finishWait(std::shared_ptr<SocketWait> wait, bool isReady);
+  // Returns false (so the caller doesn't suspend) if the reactor didn't take
+  // the transfer. Sends `sending`, or reads `length` bytes if that is empty.
+  bool submitTransfer(std::shared_ptr<SocketWait> wait,
+                      Socket& socket,
+                      BufferView sending,
+                      int length,
+                      unsigned int timeoutMs);
+  void finishTransfer(std::shared_ptr<SocketWait> wait,
+                      int result,
+                      BufferView received);
+  void work();
+};
+
+// Mutex for coroutines, which may resume on another thread than the one they
+// locked on. Code outside of coroutines can take it too, blocking its thread.
+// Waiters of either kind get the mutex in the order they arrived.
+class AsyncMutex {
+ public:
+  class Lock {
+   public:
+    Lock(AsyncMutex& mutex) : mutex(&mutex) {}
+    Lock(Lock&& o) noexcept : mutex(std::exchange(o.mutex, nullptr)) {}
+    ~Lock() {
+      if (mutex)
+        mutex->unlock();
+    }
+
+   private:
+    AsyncMutex* mutex;
+  };
+
+  // co_await lock(scheduler) returns a Lock which unlocks when destroyed
+  auto lock(Scheduler& scheduler) {
+    struct Awaiter {
+      AsyncMutex& mutex;
+      Scheduler& scheduler;
+
+      bool await_ready() { return false; }
+      bool await_suspend(std::coroutine_handle<> handle) {
+        std::lock_guard lock(mutex.mutex);
+        if (!mutex.isLocked) {
+          mutex.isLocked = true;
+          return false;
+        }
+        mutex.waiters.push_back({handle, &scheduler});
+        return true;
+      }
+      Lock await_resume() { return Lock(mutex); }
+    };
+    return Awaiter{*this, scheduler};
+  }
+
+  // Blocks until the mutex is free. Must not be called from a coroutine
+  // running on a scheduler, whose workers the current owner may need.
+  Lock lockBlocking();
+
+ private:
+  // A suspended coroutine and its scheduler, or a blocked thread
+  struct Waiter {
+    std::coroutine_handle<> handle;
+    Scheduler* scheduler = nullptr;
+    std::binary_semaphore* handedOver = nullptr;
+  };
+
+  std::mutex mutex;
+  bool isLocked = false;
+  std::deque<Waiter> waiters;
+
+  void unlock();
+};
+
+}  // namespace cb
+
+#endif
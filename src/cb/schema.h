@@ -0,0 +1,390 @@
+#ifndef CB_CONTROL_SCHEMA_H
+#define CB_CONTROL_SCHEMA_H
+
+#include <cb/packet.h>
+
+namespace cb {
+
+template <typename T>
+struct MemberPointer;
+
+template <typename C, typename T>
+struct MemberPointer<T C::*> {
+  using Class = C;
+  using Type = T;
+};
+
+template <auto M>
+using MemberType = typename MemberPointer<decltype(M)>::Type;
+
+enum class FieldRole {
+  Value,
+  Length,
+  Type,
+};
+
+// Packet member encoded with codec `C`, which is deduced from the member type
+// by default (see the field() overloads on Packet for the equivalents)
+template <auto M, typename C = Codec<MemberType<M>>>
+struct Member {
+  static constexpr FieldRole role = FieldRole::Value;
+  static constexpr auto pointer = M;
+
+  template <typename P>
+  static void pack(P& packet, Buffer& buffer, int& offset) {
+    C::pack(packet.*M, buffer, offset);
+  }
+
+  template <typename P>
+  static int packedSize(P& packet) {
+    return C::packedSize(packet.*M);
+  }
+
+  // Codecs may reference the member instead of copying it, as for BufferView
+  template <typename P>
+  static void packSegments(P& packet, SegmentBuffer& segments) {
+    if constexpr (requires { C::packSegments(packet.*M, segments); }) {
+      C::packSegments(packet.*M, segments);
+    } else {
+      int offset = segments.buffer.size();
+      C::pack(packet.*M, segments.buffer, offset);
+    }
+  }
+
+  template <typename P>
+  static void unpack(P& packet,
+                     const Buffer& buffer,
+                     int& offset,
+                     std::optional<int> limitOffset) {
+    C::unpack(packet.*M, buffer, offset, limitOffset);
+  }
+
+  template <typename P>
+  static uint32_t get(P& packet) {
+    return static_cast<uint32_t>(packet.*M);
+  }
+
+  template <typename P>
+  static void set(P& packet, uint32_t value) {
+    packet.*M = static_cast<MemberType<M>>(value);
+  }
+};
+
+// Special length field which is automatically populated with the packet
+// length when packing and bounds the following fields when unpacking
+template <auto M>
+  requires std::unsigned_integral<MemberType<M>>
+struct LengthMember : Member<M> {
+  static constexpr FieldRole role = FieldRole::Length;
+};
+
+// Special type field which is used when conditionally unpacking
+template <auto M>
+  requires std::unsigned_integral<MemberType<M>>
+struct TypeMember : Member<M> {
+  static constexpr FieldRole role = FieldRole::Type;
+};
+
+// Element count followed by the elements themselves. The count member is
+// updated from the vector size when packing.
+template <auto CountM,
+          auto ValuesM,
+          typename ElementCodec =
+              Codec<typename MemberType<ValuesM>::value_type>>
+  requires std::unsigned_integral<MemberType<CountM>>
+struct CountedMember {
+  static constexpr FieldRole role = FieldRole::Value;
+
+  using T = typename MemberType<ValuesM>::value_type;
+
+  template <typename P>
+  static void pack(P& packet, Buffer& buffer, int& offset) {
+    packet.*CountM = static_cast<MemberType<CountM>>((packet.*ValuesM).size());
+    Codec<MemberType<CountM>>::pack(packet.*CountM, buffer, offset);
+    VectorCodec<T, ElementCodec>::pack(packet.*ValuesM, buffer, offset);
+  }
+
+  template <typename P>
+  static int packedSize(P& packet) {
+    return sizeof(MemberType<CountM>) +
+           VectorCodec<T, ElementCodec>::packedSize(packet.*ValuesM);
+  }
+
+  template <typename P>
+  static void unpack(P& packet,
+                     const Buffer& buffer,
+                     int& offset,
+                     std::optional<int> limitOffset) {
+    Codec<MemberType<CountM>>::unpack(packet.*CountM, buffer, offset,
+                                      limitOffset);
+    VectorCodec<T, ElementCodec>::unpack(packet.*ValuesM, buffer, offset,
+                                         limitOffset, packet.*CountM);
+  }
+};
+
+// Whether schema member `Mem` encodes the packet member `M`
+template <typename Mem, auto M>
+constexpr bool bindsMember() {
+  if constexpr (requires { Mem::pointer; }) {
+    using Pointer = std::remove_cv_t<decltype(Mem::pointer)>;
+    if constexpr (std::same_as<Pointer, decltype(M)>)
+      return Mem::pointer == M;
+  }
+  return false;
+}
+
+// Compile-time list of the members making up a packet, in wire order
+template <typename... Members>
+struct PacketSchema {
+  template <typename... More>
+  using Append = PacketSchema<Members..., More...>;
+
+  static constexpr bool hasLength =
+      ((Members::role == FieldRole::Length) || ...);
+  static constexpr bool hasType = ((Members::role == FieldRole::Type) || ...);
+
+  // Packs all members in order and returns the offset at which the length
+  // member was written, so it can be patched once the full length is known
+  template <typename P>
+  static int pack(P& packet, Buffer& buffer, int& offset) {
+    int lengthOffset = offset;
+    (
+        [&] {
+          if constexpr (Members::role == FieldRole::Length)
+            lengthOffset = offset;
+          Members::pack(packet, buffer, offset);
+        }(),
+        ...);
+    return lengthOffset;
+  }
+
+  template <typename P>
+  static int packedSize(P& packet) {
+    return (0 + ... + Members::packedSize(packet));
+  }
+
+  // Same as pack(), but members may reference their payloads in `segments`
+  // instead of copying them. The length must already have been set.
+  template <typename P>
+  static void packSegments(P& packet, SegmentBuffer& segments) {
+    (
+        [&] {
+          if constexpr (requires { Members::packSegments(packet, segments); }) {
+            Members::packSegments(packet, segments);
+          } else {
+            int offset = segments.buffer.size();
+            Members::pack(packet, segments.buffer, offset);
+          }
+        }(),
+        ...);
+  }
+
+  // Re-packs only the member with role `R` in place at `offset`
+  template <FieldRole R, typename P>
+  static void patch(P& packet, Buffer& buffer, int offset) {
+    (
+        [&] {
+          if constexpr (Members::role == R)
+            Members::pack(packet, buffer, offset);
+        }(),
+        ...);
+  }
+
+  // Position in the schema of the member bound to `M`, or -1 if there is none
+  template <auto M>
+  static constexpr int indexOf() {
+    int index = -1;
+    int i = 0;
+    (
+        [&] {
+          if (bindsMember<Members, M>())
+            index = i;
+          i++;
+        }(),
+        ...);
+    return index;
+  }
+
+  // Offset of each member from the start of the packed packet
+  template <typename P>
+  static std::array<int, sizeof...(Members)> offsets(P& packet) {
+    std::array<int, sizeof...(Members)> result;
+    int i = 0;
+    int offset = 0;
+    ((result[i++] = offset, offset += Members::packedSize(packet)), ...);
+    return result;
+  }
+
+  // Re-packs only the member bound to `M` in place at `offset`
+  template <auto M, typename P>
+  static void patchMember(P& packet, Buffer& buffer, int offset) {
+    (
+        [&] {
+          if constexpr (bindsMember<Members, M>())
+            Members::pack(packet, buffer, offset);
+        }(),
+        ...);
+  }
+
+  // Once the length member has been read, it bounds all following members
+  template <typename P>
+  static void unpack(P& packet,
+                     const Buffer& buffer,
+                     int& offset,
+                     std::optional<int>& limitOffset) {
+    int startOffset = offset;
+    set<FieldRole::Length>(packet, 0);
+    (
+        [&] {
+          if constexpr (hasLength) {
+            uint32_t length = get<FieldRole::Length>(packet);
+            if (length > 0)
+              limitOffset = getUnpackLimit(startOffset + length, limitOffset);
+          }
+          Members::unpack(packet, buffer, offset, limitOffset);
+        }(),
+        ...);
+  }
+
+  template <FieldRole R, typename P>
+  static uint32_t get(P& packet) {
+    uint32_t value = 0;
+    (
+        [&] {
+          if constexpr (Members::role == R)
+            value = Members::get(packet);
+        }(),
+        ...);
+    return value;
+  }
+
+  template <FieldRole R, typename P>
+  static void set(P& packet, uint32_t value) {
+    (
+        [&] {
+          if constexpr (Members::role == R)
+            Members::set(packet, value);
+        }(),
+        ...);
+  }
+};
+
+// Packet whose fields are described at compile time by `Derived::Schema`
+// rather than registered through field() in the constructor, so constructing,
+// packing and unpacking it allocate nothing and involve no per-field virtual
+// calls. Fields still registered through field() are handled after the schema
+// members, so existing subclasses keep working.
+//
+// Schema packets can be copied, which copies the schema members of `Derived`
+// and of every schema packet it derives from. Runtime fields are not copied,
+// so packets that register any must delete their copy constructors.
+template <typename Derived, typename Base>
+  requires std::derived_from<Base, Packet>
+class SchemaPacket : public Base {
+ public:
+  using Base::Base;
+
+  SchemaPacket() = default;
+  SchemaPacket(const SchemaPacket& o)
+    requires std::copy_constructible<Base>
+      : Base(o) {}
+  SchemaPacket(const SchemaPacket&)
+    requires(!std::copy_constructible<Base>)
+      : Base(typename Base::SchemaCopy()) {}
+
+  SchemaPacket& operator=(const SchemaPacket& o) {
+    if constexpr (std::is_copy_assignable_v<Base>)
+      Base::operator=(o);
+    return *this;
+  }
+
+  using Packet::pack;
+  using Packet::unpack;
+
+  void pack(Buffer& buffer, int& offset) override {
+    using Schema = typename Derived::Schema;
+
+    int startOffset = offset;
+    int lengthOffset = Schema::pack(self(), buffer, offset);
+    for (std::unique_ptr<IField>& field : this->fields)
+      field->pack(buffer, offset);
+
+    if constexpr (Schema::hasLength) {
+      Schema::template set<FieldRole::Length>(self(), offset - startOffset);
+      Schema::template patch<FieldRole::Length>(self(), buffer, lengthOffset);
+    }
+  }
+
+  void unpack(const Buffer& buffer,
+              int& offset,
+              std::optional<int> limitOffset = std::nullopt) override {
+    using Schema = typename Derived::Schema;
+
+    int startOffset = offset;
+    Schema::unpack(self(), buffer, offset, limitOffset);
+    for (std::unique_ptr<IField>& field : this->fields) {
+      if (getLength() > 0)
+        limitOffset = getUnpackLimit(startOffset + getLength(), limitOffset);
+      field->unpack(buffer, offset, limitOffset);
+    }
+  }
+
+  // The length is known up front from packedSize(), so nothing needs patching
+  // and payload views never have to be copied
+  void packSegments(SegmentBuffer& segments) override {
+    using Schema = typename Derived::Schema;
+
+    if (!this->fields.empty()) {
+      Packet::packSegments(segments);
+      return;
+    }
+
+    if constexpr (Schema::hasLength)
+      Schema::template set<FieldRole::Length>(self(), packedSize());
+    Schema::packSegments(self(), segments);
+  }
+
+  int packedSize() override {
+    using Schema = typename Derived::Schema;
+
+    int size = Schema::packedSize(self());
+    for (std::unique_ptr<IField>& field : this->fields)
+      size += field->packedSize();
+    return size;
+  }
+
+  uint32_t getLength() override {
+    using Schema = typename Derived::Schema;
+
+    if constexpr (Schema::hasLength)
+      return Schema::template get<FieldRole::Length>(self());
+    return Packet::getLength();
+  }
+
+  uint32_t getType() override {
+    using Schema = typename Derived::Schema;
+
+    if constexpr (Schema::hasType)
+      return Schema::template get<FieldRole::Type>(self());
+    return Packet::getType();
+  }
+
+  // Unpacks only the schema members of `Derived` (for the base packet of a
+  // family, just the header) and returns the type
+  static uint32_t peekType(const Buffer& buffer) {
+    using Schema = typename Derived::Schema;
+
+    Derived header;
+    int offset = 0;
+    std::optional<int> limitOffset;
+    Schema::unpack(header, buffer, offset, limitOffset);
+    return Schema::template get<FieldRole::Type>(header);
+  }
+
+ private:
+  Derived& self() { return static_cast<Derived&>(*this); }
+};
+
+}  // namespace cb
+
+#endif
\ No newline at end of file
@@ -1,10 +1,28 @@
 #include <cb/exception.h>
+#include <cb/scheduler.h>
 #include <cb/socket.h>
 
+#include <algorithm>
+#include <bit>
 #include <chrono>
 
 namespace cb {
 
+namespace {
+
+// Longest an async send waits for room in the socket's send buffer, as the
+// platforms' blocking sends do
+const unsigned int SEND_TIMEOUT_MS = 10000;
+
+}  // namespace
+
+int SocketMetrics::readSizeBucket(int size) {
+  if (size <= 0)
+    return 0;
+  return std::min<int>(std::bit_width((unsigned int)size),
+                       READ_SIZE_BUCKETS - 1);
+}
+
 int Socket::sendAttempt(Buffer& buffer) {
   int result = send(buffer);
   if (result < buffer.size()) {
@@ -14,6 +32,15 @@ int Socket::sendAttempt(Buffer& buffer) {
   return result;
 }
 
+int Socket::sendAttempt(SegmentBuffer& segments) {
+  int result = send(segments.segments());
+  if (result < segments.size()) {
+    close();
+    throw Exception(ExceptionContext::Socket, ExceptionType::SendFailure);
+  }
+  return result;
+}
+
 int Socket::recvAttempt(Buffer& buffer,
                         unsigned int timeoutMs,
                         int targetBytes) {
@@ -25,33 +52,193 @@ int Socket::recvAttempt(Buffer& buffer,
   return result;
 }
 
-int BufferedSocket::send(const Buffer& buffer) {
+int Socket::recvAttempt(Packet& packet, Buffer& buffer, unsigned int timeoutMs) {
+  buffer.clear();
+  packet.resetUnpack();
+
+  auto endTime = std::chrono::steady_clock::now() +
+                 std::chrono::milliseconds(timeoutMs);
+
+  // Always try to recv() at least once, as with a timeout of 0
+  int needed = packet.unpackSome(buffer);
+  while (needed > 0) {
+    long long timeoutDeltaMs =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            endTime - std::chrono::steady_clock::now())
+            .count();
+    if (timeoutDeltaMs < 0)
+      timeoutDeltaMs = 0;
+
+    if (recvSome(buffer, timeoutDeltaMs, needed) <= 0) {
+      close();
+      throw Exception(ExceptionContext::Socket, ExceptionType::TimedOut);
+    }
+    needed = packet.unpackSome(buffer);
+  }
+
+  return buffer.size();
+}
+
+Task<int> Socket::sendAttemptAsync(Scheduler& scheduler, Buffer& buffer) {
+  if (!canTransfer() || !scheduler.canTransfer())
+    co_return sendAttempt(buffer);
+
   int totalSent = 0;
   while (totalSent < buffer.size()) {
-    int buffBytes = buffer.size() - totalSent;
-    if (buffBytes > buffLen)
-      buffBytes = buffLen;
+    BufferView unsent = BufferView(buffer).subspan(totalSent);
+    std::optional<int> result =
+        co_await scheduler.send(*this, unsent, SEND_TIMEOUT_MS);
+    // Sent here instead if the reactor didn't take it
+    if (result)
+      countSent(unsent, *result);
+    else
+      result = send(std::span<const BufferView>(&unsent, 1));
 
-    std::vector<uint8_t>::const_iterator begin = buffer.begin() + totalSent;
-    std::copy(begin, begin + buffBytes, buff);
+    if (*result <= 0) {
+      close();
+      throw Exception(ExceptionContext::Socket, ExceptionType::SendFailure);
+    }
+    totalSent += *result;
+  }
 
-    int sentBytes = 0;
-    while (sentBytes < buffBytes) {
-      int result = send(buff + sentBytes, buffBytes - sentBytes);
+  co_return totalSent;
+}
 
-      // TODO: Close socket (or mark as closed) if appropriate
-      if (result == BUFFERED_SOCKET_ERROR)
-        return totalSent + sentBytes;
+Task<int> Socket::recvAttemptAsync(Scheduler& scheduler,
+                                   Buffer& buffer,
+                                   unsigned int timeoutMs,
+                                   int targetBytes) {
+  auto endTime = std::chrono::steady_clock::now() +
+                 std::chrono::milliseconds(timeoutMs);
 
-      sentBytes += result;
+  int totalReceived = 0;
+  while (totalReceived < targetBytes) {
+    int result = co_await recvSomeAsync(scheduler, buffer, endTime,
+                                        targetBytes - totalReceived);
+    if (result <= 0) {
+      close();
+      throw Exception(ExceptionContext::Socket, ExceptionType::TimedOut);
     }
+    totalReceived += result;
+  }
 
-    totalSent += buffBytes;
+  co_return totalReceived;
+}
+
+Task<int> Socket::recvAttemptAsync(Scheduler& scheduler,
+                                   Packet& packet,
+                                   Buffer& buffer,
+                                   unsigned int timeoutMs) {
+  buffer.clear();
+  packet.resetUnpack();
+
+  auto endTime = std::chrono::steady_clock::now() +
+                 std::chrono::milliseconds(timeoutMs);
+
+  int needed = packet.unpackSome(buffer);
+  while (needed > 0) {
+    int received = co_await recvSomeAsync(scheduler, buffer, endTime, needed);
+    if (received <= 0) {
+      close();
+      throw Exception(ExceptionContext::Socket, ExceptionType::TimedOut);
+    }
+    needed = packet.unpackSome(buffer);
+  }
+
+  co_return buffer.size();
+}
+
+Task<int> Socket::recvSomeAsync(Scheduler& scheduler,
+                                Buffer& buffer,
+                                std::chrono::steady_clock::time_point endTime,
+                                int maxLength) {
+  // Bytes may already be waiting, e.g. in the read-ahead buffer, which the
+  // reactor can't see. While a transfer streams in, they usually are, and
+  // reading them here saves a pass through the reactor for each read.
+  int result = recvSome(buffer, 0, maxLength);
+  if (result > 0)
+    co_return result;
+
+  long long timeoutMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            endTime - std::chrono::steady_clock::now())
+                            .count();
+  if (timeoutMs <= 0)
+    co_return 0;
+
+  auto waitStart = std::chrono::steady_clock::now();
+  if (canTransfer() && scheduler.canTransfer()) {
+    // Waits and reads in one go, the bytes landing through takeReceived()
+    std::optional<int> received = co_await scheduler.recv(
+        *this, maxLength, timeoutMs,
+        [this, &buffer, maxLength](BufferView data) {
+          return takeReceived(data, buffer, maxLength);
+        });
+    if (received) {
+      countWait(std::chrono::steady_clock::now() - waitStart);
+      co_return *received > 0 ? *received : 0;
+    }
+  }
+
+  bool isReadable = co_await scheduler.readable(*this, timeoutMs);
+  countWait(std::chrono::steady_clock::now() - waitStart);
+  if (!isReadable)
+    co_return 0;
+  // Readable with nothing to read means the peer closed the connection
+  co_return recvSome(buffer, 0, maxLength);
+}
+
+int BufferedSocket::send(const Buffer& buffer) {
+  int totalSent = 0;
+  while (totalSent < buffer.size()) {
+    int result = send(reinterpret_cast<const char*>(buffer.data()) + totalSent,
+                      buffer.size() - totalSent);
+    countSend(result);
+
+    // TODO: Close socket (or mark as closed) if appropriate
+    if (result == BUFFERED_SOCKET_ERROR)
+      return totalSent;
+
+    totalSent += result;
   }
 
   return totalSent;
 }
 
+int BufferedSocket::send(std::span<const BufferView> segments) {
+  // Copied so the front segment can be trimmed after a partial write
+  pending.assign(segments.begin(), segments.end());
+  std::span<BufferView> unsent(pending);
+
+  int totalSent = 0;
+  while (true) {
+    while (!unsent.empty() && unsent.front().empty())
+      unsent = unsent.subspan(1);
+    if (unsent.empty())
+      return totalSent;
+
+    int result = sendSome(unsent);
+    countSend(result);
+
+    // TODO: Close socket (or mark as closed) if appropriate
+    if (result == BUFFERED_SOCKET_ERROR || result == 0)
+      return totalSent;
+    totalSent += result;
+
+    // Skip past whatever was sent, which may end partway through a segment
+    while (!unsent.empty() && result >= (int)unsent.front().size()) {
+      result -= unsent.front().size();
+      unsent = unsent.subspan(1);
+    }
+    if (result > 0)
+      unsent.front() = unsent.front().subspan(result);
+  }
+}
+
+int BufferedSocket::sendSome(std::span<const BufferView> segments) {
+  return send(reinterpret_cast<const char*>(segments.front().data()),
+              segments.front().size());
+}
+
 int BufferedSocket::recv(Buffer& buffer,
                          unsigned int timeoutMs,
                          std::optional<int> length) {
@@ -63,7 +250,7 @@ int BufferedSocket::recv(Buffer& buffer,
   auto now = std::chrono::steady_clock::now();
   auto endTime = now + std::chrono::milliseconds(timeoutMs);
 
-  // We read blocks of up to SOCKET_BUFF_SIZE into the buffer until we reach
+  // We read blocks of up to `readSize` into the buffer until we reach
   // `length` bytes or timeout. Using a do/while loop so that we always try to
   // recv() at least once, regardless of timeout/length.
   int totalReceived = 0;
@@ -75,23 +262,21 @@ int BufferedSocket::recv(Buffer& buffer,
     if (timeoutDeltaMs < 0)
       timeoutDeltaMs = 0;
 
-    if (!wait(timeoutDeltaMs))
+    if (aheadStart == aheadEnd && !timedWait(timeoutDeltaMs))
       return totalReceived;
 
-    int buffBytes = buffLen;
+    int readBytes = readSize;
     if (length.has_value())
-      buffBytes = length.value() - totalReceived;
-    if (buffBytes > buffLen)
-      buffBytes = buffLen;
+      readBytes = length.value() - totalReceived;
+    if (readBytes > readSize)
+      readBytes = readSize;
 
-    int result = recv(buff, buffBytes);
+    int result = read(buffer, readBytes);
 
     // TODO: Close socket (or mark as closed) if appropriate
     if (result == BUFFERED_SOCKET_ERROR)
       return totalReceived;
 
-    buffer.insert(buffer.end(), buff, buff + result);
-
     totalReceived += result;
     now = std::chrono::steady_clock::now();
   } while (now < endTime &&
@@ -100,4 +285,125 @@ int BufferedSocket::recv(Buffer& buffer,
   return totalReceived;
 }
 
+int BufferedSocket::recvSome(Buffer& buffer,
+                             unsigned int timeoutMs,
+                             int maxLength) {
+  if (aheadStart == aheadEnd && !timedWait(timeoutMs))
+    return 0;
+
+  int readBytes = maxLength;
+  if (readBytes > readSize)
+    readBytes = readSize;
+
+  int result = read(buffer, readBytes);
+
+  // TODO: Close socket (or mark as closed) if appropriate
+  if (result == BUFFERED_SOCKET_ERROR)
+    return 0;
+
+  return result;
+}
+
+int BufferedSocket::read(Buffer& buffer, int length) {
+  if (aheadStart == aheadEnd) {
+    // Reads as large as a whole read-ahead would be go straight to `buffer`
+    if (!readAhead || length >= readSize)
+      return recvInto(buffer, length);
+
+    if (aheadBuffer.size() < readSize)
+      aheadBuffer.resize(readSize);
+    int result = recv(aheadBuffer.data(), readSize);
+    countRecv(result);
+    if (result <= 0)
+      return result;
+    aheadStart = 0;
+    aheadEnd = result;
+  }
+
+  int served = std::min(length, aheadEnd - aheadStart);
+  buffer.insert(buffer.end(), aheadBuffer.begin() + aheadStart,
+                aheadBuffer.begin() + aheadStart + served);
+  aheadStart += served;
+  return served;
+}
+
+int BufferedSocket::recvInto(Buffer& buffer, int length) {
+  // Growing the buffer zero-fills the new bytes, which costs far less than
+  // the copy out of a staging buffer that this replaces
+  int startSize = buffer.size();
+  buffer.resize(startSize + length);
+
+  int result = recv(reinterpret_cast<char*>(buffer.data()) + startSize, length);
+  countRecv(result);
+  buffer.resize(startSize + (result > 0 ? result : 0));
+  return result;
+}
+
+SocketMetrics BufferedSocket::getMetrics() const {
+  SocketMetrics metrics;
+  metrics.bytesSent = bytesSent.load(std::memory_order_relaxed);
+  metrics.bytesReceived = bytesReceived.load(std::memory_order_relaxed);
+  metrics.sendCalls = sendCalls.load(std::memory_order_relaxed);
+  metrics.recvCalls = recvCalls.load(std::memory_order_relaxed);
+  metrics.waitCalls = waitCalls.load(std::memory_order_relaxed);
+  metrics.waitTime =
+      std::chrono::nanoseconds(waitNs.load(std::memory_order_relaxed));
+  for (int i = 0; i < SocketMetrics::READ_SIZE_BUCKETS; i++)
+    metrics.readSizes[i] = readSizes[i].load(std::memory_order_relaxed);
+  return metrics;
+}
+
+void BufferedSocket::countSend(int result) {
+  sendCalls.fetch_add(1, std::memory_order_relaxed);
+  if (result > 0)
+    bytesSent.fetch_add(result, std::memory_order_relaxed);
+}
+
+void BufferedSocket::countRecv(int result) {
+  recvCalls.fetch_add(1, std::memory_order_relaxed);
+  if (result == BUFFERED_SOCKET_ERROR)
+    return;
+  bytesReceived.fetch_add(result, std::memory_order_relaxed);
+  readSizes[SocketMetrics::readSizeBucket(result)].fetch_add(
+      1, std::memory_order_relaxed);
+}
+
+void BufferedSocket::countWait(std::chrono::steady_clock::duration waited) {
+  waitCalls.fetch_add(1, std::memory_order_relaxed);
+  waitNs.fetch_add(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count(),
+      std::memory_order_relaxed);
+}
+
+int BufferedSocket::takeReceived(BufferView received,
+                                 Buffer& buffer,
+                                 int maxLength) {
+  if (aheadStart != aheadEnd)
+    return read(buffer, maxLength);
+  if (received.empty())
+    return 0;
+
+  countRecv(received.size());
+  int served = std::min<int>(maxLength, received.size());
+  buffer.insert(buffer.end(), received.begin(), received.begin() + served);
+  aheadBuffer.assign(received.begin() + served, received.end());
+  aheadStart = 0;
+  aheadEnd = aheadBuffer.size();
+  return served;
+}
+
+void BufferedSocket::countSent(BufferView, int result) {
+  countSend(result < 0 ? BUFFERED_SOCKET_ERROR : result);
+}
+
+bool BufferedSocket::timedWait(unsigned int timeoutMs) {
+  if (timeoutMs == 0)
+    return wait(0);
+
+  auto start = std::chrono::steady_clock::now();
+  bool isReady = wait(timeoutMs);
+  countWait(std::chrono::steady_clock::now() - start);
+  return isReady;
+}
+
 }
\ No newline at end of file
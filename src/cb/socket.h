@@ -2,15 +2,69 @@
 #define CB_CONTROL_SOCKET_H
 
 #include <cb/packet.h>
+#include <cb/task.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 
 namespace cb {
 
+// Platform handle of an open socket (a file descriptor or a SOCKET), for
+// waiting on many sockets at once
+typedef std::intptr_t SocketHandle;
+
+#define NO_SOCKET_HANDLE -1
+
+class Scheduler;
+
+// Options common to all sockets. Those left unset keep the platform's
+// defaults.
+struct SocketOptions {
+  // Kernel send and receive buffer sizes in bytes. Bulk transfers such as
+  // image downloads keep more data in flight with a larger receive buffer.
+  std::optional<int> sendBufferSize;
+  std::optional<int> receiveBufferSize;
+  // Fewest bytes that must be queued before the socket counts as readable
+  std::optional<int> receiveLowWater;
+  // Microseconds to busy-poll the device queue while waiting for data, trading
+  // CPU time for latency (Linux only)
+  std::optional<int> busyPollUs;
+};
+
+// Counts of what a socket has done since it was created, to tell time spent
+// waiting on the peer apart from many small reads
+struct SocketMetrics {
+  // Reads of up to 2^(READ_SIZE_BUCKETS - 2) bytes get their own bucket
+  static const int READ_SIZE_BUCKETS = 22;
+
+  uint64_t bytesSent = 0;
+  uint64_t bytesReceived = 0;
+  // Platform writes, reads and waits, including failed ones. Checks for data
+  // that don't wait (a timeout of 0) aren't counted as waits.
+  uint64_t sendCalls = 0;
+  uint64_t recvCalls = 0;
+  uint64_t waitCalls = 0;
+  // Time spent in waits, whether blocked or suspended on a scheduler
+  std::chrono::nanoseconds waitTime{0};
+  // readSizes[i] counts reads of [2^(i - 1), 2^i) bytes, so readSizes[0]
+  // counts reads that returned nothing. The last bucket also counts anything
+  // larger.
+  std::array<uint64_t, READ_SIZE_BUCKETS> readSizes = {};
+
+  // Index into readSizes of a read of `size` bytes
+  static int readSizeBucket(int size);
+};
+
 // TODO: Use noexcept?
 class Socket {
  public:
   virtual ~Socket() = default;
 
   virtual int send(const Buffer& buffer) = 0;  // Should not throw exceptions
+  // Sends the segments in order as one stream, without joining them first
+  virtual int send(std::span<const BufferView> segments) = 0;
   // Attempts to append `length` bytes to the buffer, waiting until enough bytes
   // have accumulated or until `timeoutMs` milliseconds have passed.
   // If `length` is left blank, this waits until socket is available or timeout
@@ -22,35 +76,167 @@ class Socket {
 
   virtual bool close() = 0;  // Should not throw exceptions
 
+  // Returns NO_SOCKET_HANDLE if the socket isn't open or the platform doesn't
+  // expose one
+  virtual SocketHandle getHandle() const { return NO_SOCKET_HANDLE; }
+
+  // Sets the most bytes a single read asks the platform for. Larger reads
+  // mean fewer syscalls for bulk transfers, but may grow buffers by up to this
+  // much when the length to receive is not known up front.
+  virtual void setReadSize(int readSize) = 0;
+
+  // Waits until the socket is available or timeout, then appends the result of
+  // a single read of at most `maxLength` bytes
+  virtual int recvSome(Buffer& buffer,
+                       unsigned int timeoutMs,
+                       int maxLength) = 0;  // Should not throw exceptions
+
   // TODO: Make these the main send/recv functions? But those are virtual?
   int sendAttempt(Buffer& buffer);
+  int sendAttempt(SegmentBuffer& segments);
   int recvAttempt(Buffer& buffer, unsigned int timeoutMs, int targetBytes);
+  // Receives a whole packet into `buffer`, feeding each read to
+  // Packet::unpackSome() as it arrives and never reading past the packet
+  int recvAttempt(Packet& packet, Buffer& buffer, unsigned int timeoutMs);
+
+  // Like sendAttempt(), but handing the write to `scheduler`'s reactor if it
+  // does socket I/O itself, so sends from many cameras go to the kernel
+  // together. Otherwise this sends right away, as requests fit in the
+  // socket's send buffer and don't wait for the peer.
+  Task<int> sendAttemptAsync(Scheduler& scheduler, Buffer& buffer);
+
+  // Like recvAttempt(), but suspending on `scheduler` instead of blocking
+  // while there is nothing to read
+  Task<int> recvAttemptAsync(Scheduler& scheduler,
+                             Buffer& buffer,
+                             unsigned int timeoutMs,
+                             int targetBytes);
+  Task<int> recvAttemptAsync(Scheduler& scheduler,
+                             Packet& packet,
+                             Buffer& buffer,
+                             unsigned int timeoutMs);
+
+  // Returns what the socket has done so far. Safe to call from any thread,
+  // though counts made at the same time may not all be in the result. Sockets
+  // that don't keep metrics return all zeroes.
+  virtual SocketMetrics getMetrics() const { return {}; }
+
+ protected:
+  // Counts a wait which didn't go through the socket itself
+  virtual void countWait(std::chrono::steady_clock::duration) {}
+
+  // Whether reads and writes may be handed to a reactor that does socket I/O
+  // itself (see Reactor::submitRecv()). Those bypass the socket's own calls,
+  // so what they move goes through takeReceived() and countSent().
+  virtual bool canTransfer() const { return false; }
+  // Appends up to `maxLength` bytes to `buffer` from those read ahead or, if
+  // there are none, from `received`, keeping the rest of it for later reads.
+  // Returns how many were appended.
+  virtual int takeReceived(BufferView, Buffer&, int) { return 0; }
+  // Counts a write of `sent` (or a failed one, for a negative `result`)
+  virtual void countSent(BufferView, int) {}
+
+ private:
+  // Forwards countWait() to the socket it wraps
+  template <typename T>
+    requires std::derived_from<T, Socket>
+  friend class RecordingSocket;
+
+  // Appends the result of a single read of at most `maxLength` bytes, waiting
+  // on `scheduler` until `endTime` for something to read
+  Task<int> recvSomeAsync(Scheduler& scheduler,
+                          Buffer& buffer,
+                          std::chrono::steady_clock::time_point endTime,
+                          int maxLength);
 };
 
 #define BUFFERED_SOCKET_ERROR -1
 
+// Socket on top of a platform's plain read and write calls. Received bytes are
+// read straight into the tail of the destination buffer, and sent bytes are
+// written straight from the source, so nothing is staged in between.
+//
+// Stream sockets may also read ahead: reads smaller than `readSize` then pull
+// as much as the platform has (up to `readSize`) into a read-ahead buffer and
+// are served from it, so framing layers that read a header at a time get
+// several packets per platform read. Datagram sockets must not read ahead,
+// as each read has to return exactly one datagram.
 class BufferedSocket : public virtual Socket {
  public:
-  BufferedSocket(int buffLen = 1024)
-      : buffLen(buffLen), buff(new char[buffLen]) {}
-  virtual ~BufferedSocket() { delete[] buff; }
+  BufferedSocket(int readSize = 1024, bool readAhead = false)
+      : readSize(readSize), readAhead(readAhead) {}
+  virtual ~BufferedSocket() = default;
+
+  void setReadSize(int readSize) override { this->readSize = readSize; }
+
+  SocketMetrics getMetrics() const override;
 
  protected:
   int send(const Buffer& buffer) override;
+  int send(std::span<const BufferView> segments) override;
   int recv(Buffer& buffer,
            unsigned int timeoutMs,
            std::optional<int> length) override;
+  int recvSome(Buffer& buffer, unsigned int timeoutMs, int maxLength) override;
 
   virtual int send(const char* buff, int length) = 0;
   virtual int recv(char* buff, int length) = 0;
+  // Sends as much of the segments as a single write allows, straight from
+  // their memory. By default this only writes the first segment; platforms
+  // with vectored writes should override it.
+  virtual int sendSome(std::span<const BufferView> segments);
   // Wait until socket available for reading, returning false on failure or
   // timeout. For a timeout of 0, return whether socket is immediately
   // available for reading.
   virtual bool wait(unsigned int timeoutMs) = 0;
 
+  // Drops whatever was read ahead, e.g. when the connection is closed
+  void discardReadAhead() { aheadStart = aheadEnd = 0; }
+
+  // Count platform calls made outside of BufferedSocket, e.g. batched reads,
+  // given their results
+  void countSend(int result);
+  void countRecv(int result);
+  void countWait(std::chrono::steady_clock::duration waited) override;
+
+  // Stream sockets, which may read ahead, can take reads and writes done
+  // elsewhere
+  bool canTransfer() const override { return readAhead; }
+  int takeReceived(BufferView received, Buffer& buffer, int maxLength) override;
+  void countSent(BufferView sent, int result) override;
+
  private:
-  int buffLen = 0;
-  char* buff;
+  int readSize = 0;
+  const bool readAhead = false;
+
+  // Received bytes not yet handed out are aheadBuffer[aheadStart, aheadEnd).
+  // It is only refilled once drained, so it never needs to wrap around.
+  std::vector<char> aheadBuffer;
+  int aheadStart = 0;
+  int aheadEnd = 0;
+
+  // Appends at most `length` bytes to `buffer`, serving them from the
+  // read-ahead buffer if it holds any
+  int read(Buffer& buffer, int length);
+  // Reads at most `length` bytes onto the end of `buffer`
+  int recvInto(Buffer& buffer, int length);
+
+  // Segments still to be sent by send(), kept to avoid allocating per send
+  std::vector<BufferView> pending;
+
+  // Counted by the thread using the socket and read by getMetrics() from any
+  // other, so relaxed atomics are enough
+  std::atomic<uint64_t> bytesSent = 0;
+  std::atomic<uint64_t> bytesReceived = 0;
+  std::atomic<uint64_t> sendCalls = 0;
+  std::atomic<uint64_t> recvCalls = 0;
+  std::atomic<uint64_t> waitCalls = 0;
+  std::atomic<int64_t> waitNs = 0;
+  std::array<std::atomic<uint64_t>, SocketMetrics::READ_SIZE_BUCKETS>
+      readSizes = {};
+
+  // wait(), counted unless it is only a check
+  bool timedWait(unsigned int timeoutMs);
 };
 
 template <typename T>
@@ -0,0 +1,131 @@
+#ifndef CB_CONTROL_TASK_H
+#define CB_CONTROL_TASK_H
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace cb {
+
+template <typename T>
+class Task;
+
+namespace detail {
+
+class TaskPromiseBase {
+ public:
+  // Resumes whoever awaited the task once it finishes, without growing the
+  // stack
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+    template <typename P>
+    std::coroutine_handle<> await_suspend(
+        std::coroutine_handle<P> handle) noexcept {
+      std::coroutine_handle<> continuation = handle.promise().continuation;
+      return continuation ? continuation : std::noop_coroutine();
+    }
+    void await_resume() noexcept {}
+  };
+
+  std::suspend_always initial_suspend() noexcept { return {}; }
+  FinalAwaiter final_suspend() noexcept { return {}; }
+  void unhandled_exception() { exception = std::current_exception(); }
+
+  std::coroutine_handle<> continuation;
+  std::exception_ptr exception;
+};
+
+template <typename T>
+class TaskPromise : public TaskPromiseBase {
+ public:
+  Task<T> get_return_object();
+  void return_value(T value) { result.emplace(std::move(value)); }
+
+  T takeResult() {
+    if (exception)
+      std::rethrow_exception(exception);
+    return std::move(*result);
+  }
+
+ private:
+  std::optional<T> result;
+};
+
+template <>
+class TaskPromise<void> : public TaskPromiseBase {
+ public:
+  Task<void> get_return_object();
+  void return_void() {}
+
+  void takeResult() {
+    if (exception)
+      std::rethrow_exception(exception);
+  }
+};
+
+}  // namespace detail
+
+// Coroutine which starts when it is first awaited and hands its result (or
+// exception) to the awaiting coroutine, which it resumes on whichever thread
+// it finishes on. Tasks are run from outside a coroutine with
+// Scheduler::spawn().
+template <typename T = void>
+class [[nodiscard]] Task {
+ public:
+  using promise_type = detail::TaskPromise<T>;
+
+  Task(Task&& o) noexcept : handle(std::exchange(o.handle, nullptr)) {}
+  Task& operator=(Task&& o) noexcept {
+    if (this != &o) {
+      if (handle)
+        handle.destroy();
+      handle = std::exchange(o.handle, nullptr);
+    }
+    return *this;
+  }
+  ~Task() {
+    if (handle)
+      handle.destroy();
+  }
+
+  auto operator co_await() && noexcept {
+    struct Awaiter {
+      std::coroutine_handle<promise_type> handle;
+
+      bool await_ready() noexcept { return !handle || handle.done(); }
+      std::coroutine_handle<> await_suspend(
+          std::coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+      }
+      T await_resume() { return handle.promise().takeResult(); }
+    };
+    return Awaiter{handle};
+  }
+
+ private:
+  friend promise_type;
+
+  explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+  std::coroutine_handle<promise_type> handle;
+};
+
+namespace detail {
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+  return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+  return Task<void>(
+      std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+}  // namespace detail
+
+}  // namespace cb
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef CB_CONTROL_TEMPLATE_H
+#define CB_CONTROL_TEMPLATE_H
+
+#include <cb/schema.h>
+#include <cb/task.h>
+
+#include <concepts>
+#include <utility>
+
+namespace cb {
+
+class Scheduler;
+
+// Members whose packed size does not depend on their value, so patching them
+// never moves the members after them
+template <typename T>
+struct IsFixedSize : std::bool_constant<std::integral<T>> {};
+
+template <typename T, size_t N>
+struct IsFixedSize<std::array<T, N>> : std::bool_constant<std::integral<T>> {};
+
+// Schema packet which is packed once up front. Its fixed-size members are then
+// changed by patching their bytes in place at offsets worked out when packing,
+// so sending the same shape of packet over and over (e.g. operation requests
+// and event polls) costs a few stores rather than a full pack().
+template <typename T>
+  requires std::derived_from<T, Packet>
+class PacketTemplate {
+ public:
+  // Constructs the packet from `args`. The constraint keeps this from
+  // hijacking copies of the template itself.
+  template <typename... Args>
+    requires std::constructible_from<T, Args...>
+  PacketTemplate(Args&&... args)
+      : packet(std::forward<Args>(args)...),
+        buffer(packet.pack()),
+        offsets(T::Schema::offsets(packet)) {}
+
+  // Copies keep the packed bytes and offsets, so they need no repacking
+  PacketTemplate(const PacketTemplate&) = default;
+  PacketTemplate& operator=(const PacketTemplate&) = default;
+
+  template <auto M>
+    requires IsFixedSize<MemberType<M>>::value
+  void set(const MemberType<M>& value) {
+    constexpr int index = T::Schema::template indexOf<M>();
+    static_assert(index >= 0, "Only schema members can be patched");
+
+    packet.*M = value;
+    T::Schema::template patchMember<M>(packet, buffer, offsets[index]);
+  }
+
+  const T& get() const { return packet; }
+  const Buffer& data() const { return buffer; }
+
+  template <typename S>
+  int send(S& socket) {
+    return socket.sendAttempt(buffer);
+  }
+
+  template <typename S>
+  Task<int> sendAsync(Scheduler& scheduler, S& socket) {
+    return socket.sendAttemptAsync(scheduler, buffer);
+  }
+
+ private:
+  T packet;
+  Buffer buffer;
+  decltype(T::Schema::offsets(std::declval<T&>())) offsets;
+};
+
+}  // namespace cb
+
+#endif
\ No newline at end of file
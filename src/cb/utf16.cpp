@@ -0,0 +1,260 @@
+#include <cb/utf16.h>
+
+#include <algorithm>
+#include <bit>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CB_CONTROL_UTF16_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace cb {
+
+static const uint32_t REPLACEMENT_CHAR = 0xFFFD;
+
+struct DecodedChar {
+  uint32_t codePoint;
+  int length;  // In bytes
+};
+
+// Decodes the character starting at `p`. Invalid or truncated sequences
+// decode as U+FFFD with a length of one byte. The position is returned rather
+// than advanced through a reference so callers can keep it in a register.
+static DecodedChar decodeUtf8(const uint8_t* p, const uint8_t* end) {
+  uint8_t lead = p[0];
+  if (lead < 0x80)
+    return {lead, 1};
+
+  int numTrailing = 0;
+  uint32_t codePoint = 0;
+  uint8_t min = 0x80, max = 0xBF;  // Range of the first trailing byte
+  if (lead >= 0xC2 && lead <= 0xDF) {
+    numTrailing = 1;
+    codePoint = lead & 0x1F;
+  } else if (lead >= 0xE0 && lead <= 0xEF) {
+    numTrailing = 2;
+    codePoint = lead & 0x0F;
+    if (lead == 0xE0)
+      min = 0xA0;  // Overlong
+    else if (lead == 0xED)
+      max = 0x9F;  // Surrogates
+  } else if (lead >= 0xF0 && lead <= 0xF4) {
+    numTrailing = 3;
+    codePoint = lead & 0x07;
+    if (lead == 0xF0)
+      min = 0x90;  // Overlong
+    else if (lead == 0xF4)
+      max = 0x8F;  // Above U+10FFFF
+  } else {
+    return {REPLACEMENT_CHAR, 1};
+  }
+
+  if (end - p <= numTrailing || p[1] < min || p[1] > max)
+    return {REPLACEMENT_CHAR, 1};
+  for (int i = 2; i <= numTrailing; i++) {
+    if (p[i] < 0x80 || p[i] > 0xBF)
+      return {REPLACEMENT_CHAR, 1};
+  }
+
+  for (int i = 1; i <= numTrailing; i++)
+    codePoint = codePoint << 6 | (p[i] & 0x3F);
+  return {codePoint, numTrailing + 1};
+}
+
+// Writes `codePoint` to `dst`, which must have room for 4 bytes
+static inline void storeUtf8(uint32_t codePoint, char*& dst) {
+  if (codePoint < 0x80) {
+    *dst++ = codePoint;
+  } else if (codePoint < 0x800) {
+    *dst++ = 0xC0 | codePoint >> 6;
+    *dst++ = 0x80 | (codePoint & 0x3F);
+  } else if (codePoint < 0x10000) {
+    *dst++ = 0xE0 | codePoint >> 12;
+    *dst++ = 0x80 | (codePoint >> 6 & 0x3F);
+    *dst++ = 0x80 | (codePoint & 0x3F);
+  } else {
+    *dst++ = 0xF0 | codePoint >> 18;
+    *dst++ = 0x80 | (codePoint >> 12 & 0x3F);
+    *dst++ = 0x80 | (codePoint >> 6 & 0x3F);
+    *dst++ = 0x80 | (codePoint & 0x3F);
+  }
+}
+
+static inline void storeUnit(uint16_t unit, uint8_t*& dst) {
+  *dst++ = unit & 0xFF;
+  *dst++ = unit >> 8;
+}
+
+static inline uint16_t loadUnit(const uint8_t* src) {
+  return src[0] | src[1] << 8;
+}
+
+// Non-ASCII text is decoded a block at a time before the vector check is
+// retried, so mixed text does not pay for a failed check on every character
+static const int BLOCK_BYTES = 16;
+
+static inline const uint8_t* blockEnd(const uint8_t* p, const uint8_t* end) {
+  return end - p < BLOCK_BYTES ? end : p + BLOCK_BYTES;
+}
+
+int utf16Length(std::string_view value) {
+  const uint8_t* p = (const uint8_t*)value.data();
+  const uint8_t* end = p + value.size();
+
+  int numUnits = 0;
+  while (p < end) {
+#ifdef CB_CONTROL_UTF16_SSE2
+    while (end - p >= BLOCK_BYTES &&
+           _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)p)) == 0) {
+      p += BLOCK_BYTES;
+      numUnits += BLOCK_BYTES;
+    }
+#endif
+
+    for (const uint8_t* stop = blockEnd(p, end); p < stop;) {
+      if (*p < 0x80) {
+        p++;
+        numUnits++;
+      } else {
+        DecodedChar c = decodeUtf8(p, end);
+        p += c.length;
+        numUnits += c.codePoint >= 0x10000 ? 2 : 1;
+      }
+    }
+  }
+  return numUnits;
+}
+
+int utf16Prefix(std::string_view value, int maxUnits) {
+  const uint8_t* begin = (const uint8_t*)value.data();
+  const uint8_t* p = begin;
+  const uint8_t* end = begin + value.size();
+
+  int numUnits = 0;
+  while (p < end && numUnits < maxUnits) {
+    DecodedChar c = decodeUtf8(p, end);
+    int charUnits = c.codePoint >= 0x10000 ? 2 : 1;
+    if (numUnits + charUnits > maxUnits)
+      break;
+    numUnits += charUnits;
+    p += c.length;
+  }
+  return p - begin;
+}
+
+int utf8ToUtf16LE(std::string_view value, uint8_t* dst) {
+  uint8_t* start = dst;
+  const uint8_t* p = (const uint8_t*)value.data();
+  const uint8_t* end = p + value.size();
+
+  while (p < end) {
+#ifdef CB_CONTROL_UTF16_SSE2
+    // Widen 16 ASCII characters at a time by interleaving with zero bytes
+    const __m128i zero = _mm_setzero_si128();
+    while (end - p >= BLOCK_BYTES) {
+      __m128i block = _mm_loadu_si128((const __m128i*)p);
+      if (_mm_movemask_epi8(block) != 0)
+        break;
+      _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi8(block, zero));
+      _mm_storeu_si128((__m128i*)(dst + 16), _mm_unpackhi_epi8(block, zero));
+      p += BLOCK_BYTES;
+      dst += BLOCK_BYTES * 2;
+    }
+#endif
+
+    for (const uint8_t* stop = blockEnd(p, end); p < stop;) {
+      if (*p < 0x80) {
+        storeUnit(*p++, dst);
+        continue;
+      }
+
+      DecodedChar c = decodeUtf8(p, end);
+      uint32_t codePoint = c.codePoint;
+      p += c.length;
+      if (codePoint < 0x10000) {
+        storeUnit(codePoint, dst);
+      } else {
+        codePoint -= 0x10000;
+        storeUnit(0xD800 | codePoint >> 10, dst);
+        storeUnit(0xDC00 | (codePoint & 0x3FF), dst);
+      }
+    }
+  }
+  return (dst - start) / 2;
+}
+
+// Number of units before the first null unit in `src`, or `maxUnits`
+static int findNullUnit(const uint8_t* src, int maxUnits) {
+  int i = 0;
+#ifdef CB_CONTROL_UTF16_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  for (; maxUnits - i >= 8; i += 8) {
+    __m128i block = _mm_loadu_si128((const __m128i*)(src + i * 2));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(block, zero));
+    if (mask != 0)
+      return i + std::countr_zero((unsigned)mask) / 2;
+  }
+#endif
+  for (; i < maxUnits; i++) {
+    if (loadUnit(src + i * 2) == 0)
+      return i;
+  }
+  return maxUnits;
+}
+
+int utf16LEToUtf8(const uint8_t* src, int maxUnits, std::string& value) {
+  int numUnits = findNullUnit(src, maxUnits);
+
+  // Sized for ASCII first, then grown once to the worst case (3 bytes per
+  // unit) on the first character that needs more than one byte
+  size_t start = value.size();
+  value.resize(start + numUnits);
+  char* dst = value.data() + start;
+  bool isAscii = true;
+
+  int i = 0;
+  while (i < numUnits) {
+#ifdef CB_CONTROL_UTF16_SSE2
+    // Narrow 8 units at a time while they are all ASCII
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i nonAsciiBits = _mm_set1_epi16((short)0xFF80);
+    while (numUnits - i >= 8) {
+      __m128i block = _mm_loadu_si128((const __m128i*)(src + i * 2));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi16(
+              _mm_and_si128(block, nonAsciiBits), zero)) != 0xFFFF)
+        break;
+      _mm_storel_epi64((__m128i*)dst, _mm_packus_epi16(block, block));
+      dst += 8;
+      i += 8;
+    }
+#endif
+
+    for (int stop = std::min(i + 8, numUnits); i < stop;) {
+      uint32_t codePoint = loadUnit(src + i * 2);
+      i++;
+      if (codePoint >= 0x80 && isAscii) {
+        size_t written = dst - value.data();
+        value.resize(written + (numUnits - i + 1) * 3);
+        dst = value.data() + written;
+        isAscii = false;
+      }
+
+      if (codePoint >= 0xD800 && codePoint <= 0xDBFF && i < numUnits) {
+        uint16_t low = loadUnit(src + i * 2);
+        if (low >= 0xDC00 && low <= 0xDFFF) {
+          codePoint = 0x10000 + ((codePoint - 0xD800) << 10 | (low - 0xDC00));
+          i++;
+        }
+      }
+      if (codePoint >= 0xD800 && codePoint <= 0xDFFF)
+        codePoint = REPLACEMENT_CHAR;
+      storeUtf8(codePoint, dst);
+    }
+  }
+
+  value.resize(dst - value.data());
+  return numUnits;
+}
+
+}  // namespace cb
\ No newline at end of file
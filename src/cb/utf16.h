@@ -0,0 +1,31 @@
+#ifndef CB_CONTROL_UTF16_H
+#define CB_CONTROL_UTF16_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace cb {
+
+// Conversions between UTF-8 strings and the UTF-16LE strings used on the wire
+// (e.g. by PTP). Runs of ASCII are converted in bulk with SSE2 where
+// available. Invalid UTF-8 and unpaired surrogates become U+FFFD.
+
+// Number of UTF-16 code units needed to encode `value`
+int utf16Length(std::string_view value);
+
+// Byte length of the longest prefix of `value` that fits in `maxUnits` UTF-16
+// code units without splitting a character
+int utf16Prefix(std::string_view value, int maxUnits);
+
+// Writes `value` to `dst` and returns the number of units written. There are
+// never more units than bytes in `value`, so that bounds the space needed.
+int utf8ToUtf16LE(std::string_view value, uint8_t* dst);
+
+// Appends up to `maxUnits` code units from `src` to `value`, stopping early at
+// a null unit. Returns the number of units before the null (or `maxUnits`).
+int utf16LEToUtf8(const uint8_t* src, int maxUnits, std::string& value);
+
+}  // namespace cb
+
+#endif
\ No newline at end of file